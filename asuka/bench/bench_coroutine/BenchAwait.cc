@@ -0,0 +1,158 @@
+//
+// Created by xi on 19-3-31.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <asuka/coroutine/Coroutine.h>
+#include <asuka/coroutine/Runtime.h>
+#include <asuka/coroutine/Sync.h>
+
+using namespace asuka;
+
+// 100K requests each waiting for a Future:
+// coroutines awaiting it on one thread, coroutines awaiting it on a Runtime
+// with the values set from another thread, and, as the blocking alternative,
+// one thread per request in Future::Wait (1K only, 100K threads is not an option).
+// 100K guarded mmap-ed stacks take 200K mappings, above the usual vm.max_map_count,
+// so coroutines get plain heap stacks, or share one stack on a single thread.
+
+using Clock = std::chrono::steady_clock;
+
+double Nanos(Clock::time_point start, long n)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(n);
+}
+
+long MaxRssMb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024;
+}
+
+void BenchOneThread(long n, const SharedStackPtr& shared_stack)
+{
+    std::vector<Promise<long>> promises(static_cast<size_t>(n));
+    std::vector<CoroutinePtr> coroutines;
+    coroutines.reserve(static_cast<size_t>(n));
+    long sum = 0;
+
+    auto start = Clock::now();
+    for (long i = 0; i < n; ++i)
+    {
+        auto func = [&promises, &sum, i] {
+            sum += Coroutine::Await(promises[i].GetFuture()).Value();
+        };
+        coroutines.push_back(shared_stack ? Coroutine::CreateCoroutineOnSharedStack(shared_stack, func)
+                                          : Coroutine::CreateCoroutine(func));
+        Coroutine::Send(coroutines.back());
+    }
+    double suspend = Nanos(start, n);
+
+    start = Clock::now();
+    for (long i = 0; i < n; ++i)
+    {
+        promises[i].SetValue(i);
+    }
+    double resume = Nanos(start, n);
+    printf("%-12s %6ld awaits: %7.1f ns to start and suspend, %7.1f ns to resume and finish%s\n",
+           shared_stack ? "shared stack" : "one thread", n, suspend, resume,
+           sum == n * (n - 1) / 2 ? "" : " (WRONG SUM)");
+}
+
+void BenchRuntime(long n, size_t workers)
+{
+    std::vector<Promise<long>> promises(static_cast<size_t>(n));
+    std::atomic<long> waiting(0);
+    std::atomic<long> sum(0);
+    WaitGroup wg;
+    wg.Add(n);
+    Runtime runtime(workers);
+
+    auto start = Clock::now();
+    for (long i = 0; i < n; ++i)
+    {
+        runtime.Spawn([&promises, &waiting, &sum, &wg, i] {
+            waiting.fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add(Coroutine::Await(promises[i].GetFuture()).Value(), std::memory_order_relaxed);
+            wg.Done();
+        });
+    }
+    while (waiting.load(std::memory_order_relaxed) < n)
+    {
+        std::this_thread::yield();
+    }
+    double suspend = Nanos(start, n);
+
+    start = Clock::now();
+    for (long i = 0; i < n; ++i)
+    {
+        promises[i].SetValue(i);
+    }
+    wg.Wait();
+    double resume = Nanos(start, n);
+    printf("runtime(%zu)   %6ld awaits: %7.1f ns to start and suspend, %7.1f ns to resume and finish%s\n",
+           workers, n, suspend, resume, sum == n * (n - 1) / 2 ? "" : " (WRONG SUM)");
+}
+
+void BenchThreads(long n)
+{
+    std::vector<Promise<long>> promises(static_cast<size_t>(n));
+    std::vector<std::thread> threads;
+    std::atomic<long> waiting(0);
+    std::atomic<long> sum(0);
+
+    auto start = Clock::now();
+    for (long i = 0; i < n; ++i)
+    {
+        threads.emplace_back([&promises, &waiting, &sum, i] {
+            Future<long> future = promises[i].GetFuture();
+            waiting.fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add(future.Wait().Value(), std::memory_order_relaxed);
+        });
+    }
+    while (waiting.load(std::memory_order_relaxed) < n)
+    {
+        std::this_thread::yield();
+    }
+    double suspend = Nanos(start, n);
+
+    start = Clock::now();
+    for (long i = 0; i < n; ++i)
+    {
+        promises[i].SetValue(i);
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    double resume = Nanos(start, n);
+    printf("threads      %6ld waits:  %7.1f ns to start and block,   %7.1f ns to wake and join%s\n",
+           n, suspend, resume, sum == n * (n - 1) / 2 ? "" : " (WRONG SUM)");
+}
+
+int main(int argc, char* argv[])
+{
+    const long kAwaits = argc > 1 ? atol(argv[1]) : 100 * 1000;
+
+    StackAllocator::SetDefault(new HeapStackAllocator());
+
+    BenchOneThread(kAwaits, std::make_shared<SharedStack>());
+    printf("max rss %ld MB\n", MaxRssMb());
+    BenchOneThread(kAwaits, SharedStackPtr());
+    printf("max rss %ld MB\n", MaxRssMb());
+    for (size_t workers : {1, 2, 4})
+    {
+        BenchRuntime(kAwaits, workers);
+    }
+    printf("max rss %ld MB\n", MaxRssMb());
+    BenchThreads(1000);
+    return 0;
+}
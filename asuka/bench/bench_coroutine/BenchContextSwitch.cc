@@ -0,0 +1,43 @@
+//
+// Created by xi on 19-3-2.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include <asuka/coroutine/Coroutine.h>
+
+using namespace asuka;
+
+// Send/Yield round trip: main -> coroutine -> main
+
+void Loop()
+{
+    while (true)
+    {
+        Coroutine::Yield();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const long kRounds = argc > 1 ? atol(argv[1]) : 10 * 1000 * 1000;
+
+    CoroutinePtr co(Coroutine::CreateCoroutine(Loop));
+    Coroutine::Send(co); // warm up, enter Loop
+
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < kRounds; ++i)
+    {
+        Coroutine::Send(co);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    printf("backend: %s, sizeof(Context): %zu, sizeof(Coroutine): %zu\n",
+           detail::Context::Backend(), sizeof(detail::Context), sizeof(Coroutine));
+    printf("%ld Send/Yield round trips, %.2f ns per round trip\n",
+           kRounds, ns / static_cast<double>(kRounds));
+    return 0;
+}
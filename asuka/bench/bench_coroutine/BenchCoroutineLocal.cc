@@ -0,0 +1,133 @@
+//
+// Created by xi on 19-4-9.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <asuka/coroutine/Coroutine.h>
+#include <asuka/coroutine/CoroutineLocal.h>
+
+using namespace asuka;
+
+// Request context of the running coroutine: a CoroutineLocal<long>, against
+// a std::map<unsigned, VoidPtr> keyed on Coroutine::GetCurrentId(), the way
+// it is done without it, and a thread_local, what it would cost if it were
+// right. Reads in a loop with 100 coroutines on the thread, then the cost for
+// a short-lived coroutine of making the value and dropping it at the end.
+
+using Clock = std::chrono::steady_clock;
+
+const int kCoroutines = 100;
+
+volatile long g_sink = 0;
+
+CoroutineLocal<long> g_local;
+
+std::map<unsigned int, VoidPtr> g_map;
+
+thread_local long t_value = 0;
+
+double NsPer(Clock::time_point start, long n)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(n);
+}
+
+__attribute__((noinline)) long ReadLocal()
+{
+    return ++*g_local;
+}
+
+__attribute__((noinline)) long ReadMap()
+{
+    return ++*std::static_pointer_cast<long>(g_map.find(Coroutine::GetCurrentId())->second);
+}
+
+__attribute__((noinline)) long ReadThreadLocal()
+{
+    return ++t_value;
+}
+
+template <typename F>
+void BenchRead(const char* name, long rounds, F read)
+{
+    std::vector<CoroutinePtr> coroutines;
+    for (int i = 0; i < kCoroutines; ++i)
+    {
+        coroutines.push_back(Coroutine::CreateCoroutine([read, rounds] {
+            g_map[Coroutine::GetCurrentId()] = std::make_shared<long>(0);
+            Coroutine::Yield();
+            for (long r = 0; r < rounds; ++r)
+            {
+                g_sink = read();
+            }
+            g_map.erase(Coroutine::GetCurrentId());
+        }));
+        Coroutine::Send(coroutines.back());
+    }
+    auto start = Clock::now();
+    for (auto& co : coroutines)
+    {
+        Coroutine::Send(co);
+    }
+    printf("read %-14s %6.2f ns\n", name, NsPer(start, rounds * kCoroutines));
+}
+
+void BenchLifetime(long rounds)
+{
+    auto start = Clock::now();
+    for (long i = 0; i < rounds; ++i)
+    {
+        CoroutinePtr co = Coroutine::CreateCoroutine([] { g_sink = 1; });
+        Coroutine::Send(co);
+    }
+    double bare = NsPer(start, rounds);
+
+    start = Clock::now();
+    for (long i = 0; i < rounds; ++i)
+    {
+        CoroutinePtr co = Coroutine::CreateCoroutine([] { g_sink = ++*g_local; });
+        Coroutine::Send(co);
+    }
+    double local = NsPer(start, rounds);
+
+    start = Clock::now();
+    for (long i = 0; i < rounds; ++i)
+    {
+        CoroutinePtr co = Coroutine::CreateCoroutine([] {
+            auto& value = g_map[Coroutine::GetCurrentId()];
+            value = std::make_shared<long>(0);
+            g_sink = ++*std::static_pointer_cast<long>(value);
+            g_map.erase(Coroutine::GetCurrentId());
+        });
+        Coroutine::Send(co);
+    }
+    double map = NsPer(start, rounds);
+    printf("short-lived coroutine: bare %.1f ns, CoroutineLocal +%.1f ns, std::map +%.1f ns (%d others in it)\n",
+           bare, local - bare, map - bare, kCoroutines);
+}
+
+int main(int argc, char* argv[])
+{
+    const long kRounds = argc > 1 ? atol(argv[1]) : 100 * 1000;
+
+    // the others live meanwhile, the map holds kCoroutines entries
+    std::vector<CoroutinePtr> others;
+    for (int i = 0; i < kCoroutines; ++i)
+    {
+        others.push_back(Coroutine::CreateCoroutine([] {
+            g_map[Coroutine::GetCurrentId()] = std::make_shared<long>(0);
+            Coroutine::Yield();
+        }));
+        Coroutine::Send(others.back());
+    }
+    BenchRead("CoroutineLocal", kRounds, ReadLocal);
+    BenchRead("std::map", kRounds, ReadMap);
+    BenchRead("thread_local", kRounds, ReadThreadLocal);
+    BenchLifetime(kRounds * 10);
+    return 0;
+}
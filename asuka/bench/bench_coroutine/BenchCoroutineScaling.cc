@@ -0,0 +1,62 @@
+//
+// Created by xi on 19-3-6.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <asuka/coroutine/Coroutine.h>
+
+using namespace asuka;
+
+// every thread runs its own Send/Yield loop, total switches per second
+// shall grow linearly with threads up to the number of cores
+
+void Loop()
+{
+    while (true)
+    {
+        Coroutine::Yield();
+    }
+}
+
+void ThreadFunc(long rounds)
+{
+    CoroutinePtr co(Coroutine::CreateCoroutine(Loop));
+    for (long i = 0; i < rounds; ++i)
+    {
+        Coroutine::Send(co);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const long kRounds = argc > 1 ? atol(argv[1]) : 5 * 1000 * 1000;
+    const unsigned int kMaxThreads = argc > 2 ? static_cast<unsigned int>(atoi(argv[2]))
+                                              : std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int n = 1; n <= kMaxThreads; n *= 2)
+    {
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            threads.emplace_back(ThreadFunc, kRounds);
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        auto end = std::chrono::steady_clock::now();
+        double sec = std::chrono::duration<double>(end - start).count();
+        printf("%3u threads: %.2f M round trips/s\n", n,
+               static_cast<double>(kRounds) * n / sec / 1e6);
+        if (n < kMaxThreads && n * 2 > kMaxThreads)
+        {
+            n = kMaxThreads / 2;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+//
+// Created by xi on 19-4-7.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <asuka/coroutine/Coroutine.h>
+#include <asuka/coroutine/CoroutineStats.h>
+
+using namespace asuka;
+
+// Built twice, as coroutine_stats_bench linking coroutine_stats and as
+// coroutine_nostats_bench linking coroutine: the cost of the counting on a
+// Send/Yield round trip and on making a coroutine (painting its stack), and
+// what CoroutineStats shows of a workload of handlers of mixed stack depths.
+
+using Clock = std::chrono::steady_clock;
+
+volatile long g_sink = 0;
+
+double NsPer(Clock::time_point start, long n)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(n);
+}
+
+void BenchSwitch(long rounds)
+{
+    CoroutinePtr co(Coroutine::CreateCoroutine([] {
+        while (true)
+        {
+            Coroutine::Yield();
+        }
+    }));
+    Coroutine::Send(co);
+    auto start = Clock::now();
+    for (long i = 0; i < rounds; ++i)
+    {
+        Coroutine::Send(co);
+    }
+    printf("Send/Yield round trip  %7.2f ns\n", NsPer(start, rounds));
+}
+
+void BenchCreate(long rounds)
+{
+    auto start = Clock::now();
+    for (long i = 0; i < rounds; ++i)
+    {
+        CoroutinePtr co = Coroutine::CreateCoroutine([] { g_sink = 1; });
+        Coroutine::Send(co);
+    }
+    printf("create, run, destroy   %7.2f ns\n", NsPer(start, rounds));
+}
+
+// a handler using about depth KB of stack, yielding rounds times
+__attribute__((noinline)) long Handle(int depth, int rounds)
+{
+    volatile char frame[1000];
+    frame[0] = static_cast<char>(depth);
+    if (depth > 1)
+    {
+        return Handle(depth - 1, rounds) + frame[0];
+    }
+    long work = 0;
+    for (int i = 0; i < rounds; ++i)
+    {
+        for (int k = 0; k < 1000; ++k)
+        {
+            work += k ^ i;
+        }
+        Coroutine::Yield();
+    }
+    return work;
+}
+
+void Workload()
+{
+    const int kHandlers = 1000;
+    std::vector<CoroutinePtr> handlers;
+    for (int i = 0; i < kHandlers; ++i)
+    {
+        // mostly shallow, a few deep ones, and a few busy ones
+        int depth = i % 100 == 0 ? 6 : 1 + i % 3;
+        int rounds = i % 250 == 0 ? 100 : 5;
+        handlers.push_back(Coroutine::CreateCoroutine([depth, rounds] { g_sink = Handle(depth, rounds); }));
+    }
+    bool running = true;
+    while (running)
+    {
+        running = false;
+        for (auto& co : handlers)
+        {
+            if (co->state() != Coroutine::State::kFinished)
+            {
+                Coroutine::Send(co);
+                running = true;
+            }
+        }
+    }
+    std::vector<CoroutineStats> live(CoroutineStats::Live());
+    if (!CoroutineStats::kEnabled)
+    {
+        printf("workload: %zu coroutines registered, link coroutine_stats to count\n", live.size());
+        return;
+    }
+    std::sort(live.begin(), live.end(),
+              [](const CoroutineStats& a, const CoroutineStats& b) { return a.run_ns > b.run_ns; });
+    printf("workload: the hottest of %zu handlers\n", live.size());
+    for (size_t i = 0; i < 5 && i < live.size(); ++i)
+    {
+        printf("  id %6u  sends %4lu  yields %4lu  run %8.1f us  stack %5zu of %zu bytes\n",
+               live[i].id, live[i].sends, live[i].yields, static_cast<double>(live[i].run_ns) / 1000,
+               live[i].stack_high_water, live[i].stack_size);
+    }
+    handlers.clear();
+    CoroutineStats::Totals totals = CoroutineStats::Total();
+    const LatencyHistogram& used = totals.stack_high_water;
+    printf("stack high water of %lu coroutines: p50 %lu p99 %lu max %lu bytes\n",
+           used.count(), used.Percentile(50), used.Percentile(99), used.max());
+}
+
+int main(int argc, char* argv[])
+{
+    const long kRounds = argc > 1 ? atol(argv[1]) : 10 * 1000 * 1000;
+
+    printf("stats %s, sizeof(Coroutine) %zu\n", CoroutineStats::kEnabled ? "on" : "off", sizeof(Coroutine));
+    BenchSwitch(kRounds);
+    BenchCreate(kRounds / 10);
+    Workload();
+    return 0;
+}
@@ -0,0 +1,61 @@
+//
+// Created by xi on 19-3-10.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include <asuka/coroutine/Generator.h>
+
+using namespace asuka;
+
+// yield n ints by Generator<int> and by the VoidPtr API
+
+void TypedCount(long n)
+{
+    for (long i = 0; i < n; ++i)
+    {
+        Generator<long>::Yield(i);
+    }
+}
+
+void VoidPtrCount(long n)
+{
+    for (long i = 0; i < n; ++i)
+    {
+        Coroutine::Yield(std::make_shared<long>(i));
+    }
+}
+
+double Seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    const long kCount = argc > 1 ? atol(argv[1]) : 100 * 1000 * 1000;
+
+    long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i : Generator<long>(TypedCount, kCount))
+    {
+        sum += i;
+    }
+    double typed_sec = Seconds(start);
+
+    long sum2 = 0;
+    start = std::chrono::steady_clock::now();
+    CoroutinePtr co(Coroutine::CreateCoroutine(VoidPtrCount, kCount));
+    for (long i = 0; i < kCount; ++i)
+    {
+        sum2 += *std::static_pointer_cast<long>(Coroutine::Send(co));
+    }
+    double void_ptr_sec = Seconds(start);
+
+    printf("%ld ints (checksum %s)\n", kCount, sum == sum2 ? "ok" : "mismatch");
+    printf("Generator<long>: %.2f ns per value\n", typed_sec * 1e9 / static_cast<double>(kCount));
+    printf("VoidPtr:         %.2f ns per value\n", void_ptr_sec * 1e9 / static_cast<double>(kCount));
+    return sum == sum2 ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+//
+// Created by xi on 19-3-15.
+//
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <asuka/coroutine/Reactor.h>
+
+using namespace asuka;
+
+// loopback echo: many concurrent clients ping-pong fixed size messages,
+// server and clients share one reactor thread
+
+const size_t kMessageSize = 64;
+
+int g_clients = 1000;
+int g_messages = 100;
+int g_finished = 0;
+std::vector<double> g_latencies_us;
+
+void Echo(Reactor* reactor, int fd)
+{
+    char buf[kMessageSize * 4];
+    ssize_t n;
+    while ((n = reactor->Read(fd, buf, sizeof(buf))) > 0)
+    {
+        reactor->Write(fd, buf, static_cast<size_t>(n));
+    }
+    reactor->Close(fd);
+}
+
+void Server(Reactor* reactor, int listen_fd)
+{
+    int fd;
+    while ((fd = reactor->Accept(listen_fd, nullptr, nullptr)) >= 0)
+    {
+        reactor->Spawn(Echo, reactor, fd);
+    }
+}
+
+void Client(Reactor* reactor, const struct sockaddr_in* addr)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (reactor->Connect(fd, reinterpret_cast<const struct sockaddr*>(addr), sizeof(*addr)) != 0)
+    {
+        perror("connect");
+        abort();
+    }
+    char buf[kMessageSize] = {};
+    for (int i = 0; i < g_messages; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        reactor->Write(fd, buf, sizeof(buf));
+        size_t received = 0;
+        while (received < kMessageSize)
+        {
+            ssize_t n = reactor->Read(fd, buf + received, kMessageSize - received);
+            if (n <= 0)
+            {
+                abort();
+            }
+            received += static_cast<size_t>(n);
+        }
+        g_latencies_us.push_back(std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    reactor->Close(fd);
+    if (++g_finished == g_clients)
+    {
+        reactor->Stop();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    g_clients = argc > 1 ? atoi(argv[1]) : 1000;
+    g_messages = argc > 2 ? atoi(argv[2]) : 100;
+
+    int listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (::bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listen_fd, 4096) != 0 ||
+        ::getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &len) != 0)
+    {
+        perror("listen");
+        return 1;
+    }
+
+    Reactor reactor;
+    reactor.Spawn(Server, &reactor, listen_fd);
+    for (int i = 0; i < g_clients; ++i)
+    {
+        reactor.Spawn(Client, &reactor, &addr);
+    }
+    g_latencies_us.reserve(static_cast<size_t>(g_clients) * static_cast<size_t>(g_messages));
+    auto start = std::chrono::steady_clock::now();
+    reactor.Loop();
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ::close(listen_fd);
+
+    std::sort(g_latencies_us.begin(), g_latencies_us.end());
+    auto percentile = [](double p) {
+        return g_latencies_us[static_cast<size_t>(p * static_cast<double>(g_latencies_us.size() - 1))];
+    };
+    printf("%d clients x %d messages of %zu bytes: %.0f round trips/s\n",
+           g_clients, g_messages, kMessageSize, static_cast<double>(g_latencies_us.size()) / sec);
+    printf("latency us: p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+           percentile(0.5), percentile(0.9), percentile(0.99), g_latencies_us.back());
+    return 0;
+}
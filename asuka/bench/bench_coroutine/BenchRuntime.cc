@@ -0,0 +1,84 @@
+//
+// Created by xi on 19-3-12.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include <asuka/coroutine/Runtime.h>
+
+using namespace asuka;
+
+// fan-out/fan-in: a root coroutine spawns kFanOut children per request,
+// each child does some work with a few yields, the last child finishes the request
+
+struct Request
+{
+    std::atomic<int> remaining;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool done = false;
+};
+
+volatile unsigned long g_sink;
+
+void Child(Request* request, int work)
+{
+    unsigned long x = 0;
+    for (int round = 0; round < 4; ++round)
+    {
+        for (int i = 0; i < work; ++i)
+        {
+            x = x * 6364136223846793005ul + 1442695040888963407ul;
+        }
+        Runtime::Yield();
+    }
+    g_sink = x;
+    if (request->remaining.fetch_sub(1) == 1)
+    {
+        std::lock_guard<std::mutex> lock(request->mutex);
+        request->done = true;
+        request->cond.notify_one();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t kWorkers = argc > 1 ? static_cast<size_t>(atoi(argv[1])) : 0;
+    const int kRequests = argc > 2 ? atoi(argv[2]) : 100;
+    const int kFanOut = argc > 3 ? atoi(argv[3]) : 1000;
+    const int kWork = argc > 4 ? atoi(argv[4]) : 1000;
+
+    Runtime runtime(kWorkers);
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < kRequests; ++r)
+    {
+        Request request;
+        request.remaining = kFanOut;
+        runtime.Spawn([&runtime, &request, kFanOut, kWork] {
+            for (int i = 0; i < kFanOut; ++i)
+            {
+                runtime.Spawn(Child, &request, kWork);
+            }
+        });
+        std::unique_lock<std::mutex> lock(request.mutex);
+        request.cond.wait(lock, [&request] { return request.done; });
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%zu workers, %d requests x %d children: %.2f ms per request, %.0f children/s\n",
+           runtime.num_workers(), kRequests, kFanOut, sec * 1e3 / kRequests,
+           static_cast<double>(kRequests) * kFanOut / sec);
+    auto stats = runtime.Stats();
+    for (size_t i = 0; i < stats.size(); ++i)
+    {
+        printf("  worker %2zu: resumed %9lu, steals %7lu, stolen %8lu, utilization %5.1f%%\n", i,
+               static_cast<unsigned long>(stats[i].resumed), static_cast<unsigned long>(stats[i].steals),
+               static_cast<unsigned long>(stats[i].stolen), stats[i].utilization * 100);
+    }
+    return 0;
+}
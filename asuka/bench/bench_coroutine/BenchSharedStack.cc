@@ -0,0 +1,87 @@
+//
+// Created by xi on 19-3-8.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+
+#include <asuka/coroutine/Coroutine.h>
+
+using namespace asuka;
+
+// n mostly idle coroutines, each parked with a small live frame,
+// compare resident memory and round-robin switch cost of both modes
+
+size_t ResidentBytes()
+{
+    long pages = 0;
+    long resident = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp)
+    {
+        if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+        {
+            resident = 0;
+        }
+        fclose(fp);
+    }
+    return static_cast<size_t>(resident) * static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+void Idle()
+{
+    volatile char frame[256];
+    frame[0] = 0;
+    while (true)
+    {
+        Coroutine::Yield();
+        frame[0] = static_cast<char>(frame[0] + 1);
+    }
+}
+
+void Run(const char* mode, size_t n, size_t rounds, bool shared)
+{
+    size_t rss_before = ResidentBytes();
+    SharedStackPtr shared_stack(shared ? std::make_shared<SharedStack>() : nullptr);
+    std::vector<CoroutinePtr> coroutines;
+    coroutines.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        coroutines.push_back(shared ? Coroutine::CreateCoroutineOnSharedStack(shared_stack, Idle)
+                                    : Coroutine::CreateCoroutine(Idle));
+        Coroutine::Send(coroutines.back());
+    }
+    size_t rss = ResidentBytes() - rss_before;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; ++round)
+    {
+        for (auto& co : coroutines)
+        {
+            Coroutine::Send(co);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    printf("%-8s %8zu coroutines: RSS %8.1f MB (%6zu bytes/coroutine), %.1f ns per Send/Yield",
+           mode, n, static_cast<double>(rss) / 1024 / 1024, rss / n,
+           ns / static_cast<double>(rounds * n));
+    if (shared)
+    {
+        printf(", saved %zu bytes/coroutine", coroutines.front()->saved_size());
+    }
+    printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+    // private stacks take two VMAs each, keep n under vm.max_map_count / 2
+    const size_t kCoroutines = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 30 * 1000;
+    const size_t kRounds = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 20;
+    Run("private", kCoroutines, kRounds, false);
+    Run("shared", kCoroutines, kRounds, true);
+    return 0;
+}
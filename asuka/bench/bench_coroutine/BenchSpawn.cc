@@ -0,0 +1,101 @@
+//
+// Created by xi on 19-3-18.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <array>
+#include <chrono>
+
+#include <asuka/coroutine/Coroutine.h>
+
+using namespace asuka;
+
+// spawn-run-finish latency of short coroutines:
+// CreateCoroutine (pooled) vs make_shared (heap), with heap allocations counted
+
+namespace
+{
+
+size_t g_allocations = 0;
+
+} // namespace
+
+// not inlined, or the compiler pairs operator new with free and warns
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    ++g_allocations;
+    void* p = malloc(size);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void Short(long* counter)
+{
+    ++*counter;
+}
+
+int Square(int x)
+{
+    return x * x;
+}
+
+double Seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Create>
+void Bench(const char* name, long n, Create create)
+{
+    create(); // warm up pools and caches
+    size_t allocations = g_allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < n; ++i)
+    {
+        CoroutinePtr co(create());
+        Coroutine::Send(co);
+    }
+    double sec = Seconds(start);
+    printf("%-28s %8.1f ns per spawn, %.2f allocations per spawn\n", name,
+           sec * 1e9 / static_cast<double>(n),
+           static_cast<double>(g_allocations - allocations) / static_cast<double>(n));
+}
+
+int main(int argc, char* argv[])
+{
+    const long kCount = argc > 1 ? atol(argv[1]) : 1000 * 1000;
+    long counter = 0;
+    std::array<long, 8> big = {}; // too large to be stored in place
+
+    Bench("CreateCoroutine void", kCount, [&] {
+        return Coroutine::CreateCoroutine(Short, &counter);
+    });
+    Bench("make_shared void", kCount, [&] {
+        return std::make_shared<Coroutine>(Short, &counter);
+    });
+    Bench("CreateCoroutine int", kCount, [] {
+        return Coroutine::CreateCoroutine(Square, 3);
+    });
+    Bench("make_shared int", kCount, [] {
+        return std::make_shared<Coroutine>(Square, 3);
+    });
+    Bench("CreateCoroutine big capture", kCount, [&] {
+        return Coroutine::CreateCoroutine([big, &counter] { counter += big[0]; });
+    });
+    return 0;
+}
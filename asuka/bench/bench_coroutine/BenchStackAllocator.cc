@@ -0,0 +1,57 @@
+//
+// Created by xi on 19-3-4.
+//
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+
+#include <asuka/coroutine/Coroutine.h>
+
+using namespace asuka;
+
+// create and destroy n coroutines, at most batch alive at the same time
+// (every mmap-ed stack takes two VMAs, keep it under vm.max_map_count)
+
+void Nothing() {}
+
+double CreateDestroy(StackAllocator* allocator, size_t n, size_t batch)
+{
+    StackAllocator::SetDefault(allocator);
+    std::vector<CoroutinePtr> coroutines;
+    coroutines.reserve(batch);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < n; )
+    {
+        size_t count = std::min(batch, n - done);
+        for (size_t i = 0; i < count; ++i)
+        {
+            coroutines.push_back(Coroutine::CreateCoroutine(Nothing));
+        }
+        coroutines.clear();
+        done += count;
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main()
+{
+    HeapStackAllocator heap;
+    PooledStackAllocator pooled;
+    const size_t kCounts[] = {1000, 100 * 1000, 1000 * 1000};
+    // within and beyond the per-thread cache
+    const size_t kBatches[] = {PooledStackAllocator::kDefaultMaxCachedStacks, 10 * 1000};
+    for (size_t batch : kBatches)
+    {
+        for (size_t n : kCounts)
+        {
+            double heap_sec = CreateDestroy(&heap, n, batch);
+            double pooled_sec = CreateDestroy(&pooled, n, batch);
+            printf("%8zu coroutines, %5zu alive: heap %.0f ns/op, pooled mmap %.0f ns/op\n", n, batch,
+                   heap_sec * 1e9 / static_cast<double>(n), pooled_sec * 1e9 / static_cast<double>(n));
+        }
+    }
+    StackAllocator::SetDefault(&pooled);
+    return 0;
+}
@@ -0,0 +1,75 @@
+//
+// Created by xi on 19-3-20.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <mutex>
+
+#include <asuka/coroutine/Runtime.h>
+#include <asuka/coroutine/Sync.h>
+
+using namespace asuka;
+
+// thousands of coroutines on a Runtime contend for one counter,
+// guarded by CoMutex and by std::mutex
+
+double Seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Mutex>
+void Increase(Mutex* mutex, long* counter, long rounds, bool yield_inside, WaitGroup* wg)
+{
+    for (long i = 0; i < rounds; ++i)
+    {
+        std::lock_guard<Mutex> lock(*mutex);
+        ++*counter;
+        if (yield_inside)
+        {
+            // e.g. waiting for I/O with the lock held
+            Runtime::Yield();
+        }
+    }
+    wg->Done();
+}
+
+template <typename Mutex>
+void Bench(const char* name, Runtime& runtime, long coroutines, long rounds, bool yield_inside)
+{
+    Mutex mutex;
+    long counter = 0;
+    WaitGroup wg;
+    wg.Add(coroutines);
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < coroutines; ++i)
+    {
+        runtime.Spawn(Increase<Mutex>, &mutex, &counter, rounds, yield_inside, &wg);
+    }
+    wg.Wait();
+    double sec = Seconds(start);
+    long total = coroutines * rounds;
+    printf("%-28s %6ld coroutines: %8.1f ns per lock%s\n", name, coroutines,
+           sec * 1e9 / static_cast<double>(total), counter == total ? "" : " (WRONG COUNT)");
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t kWorkers = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 4;
+    const long kLocks = 1000 * 1000;
+
+    Runtime runtime(kWorkers);
+    printf("%zu workers, %ld locks per run\n", kWorkers, kLocks);
+    for (long coroutines : {100L, 1000L, 10000L})
+    {
+        long rounds = kLocks / coroutines;
+        Bench<CoMutex>("CoMutex", runtime, coroutines, rounds, false);
+        Bench<std::mutex>("std::mutex", runtime, coroutines, rounds, false);
+        // std::mutex can not be held across Yield: another coroutine of the
+        // same worker thread would lock it again and deadlock
+        Bench<CoMutex>("CoMutex, Yield while held", runtime, coroutines, rounds / 10, true);
+    }
+    return 0;
+}
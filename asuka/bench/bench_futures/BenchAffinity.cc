@@ -0,0 +1,78 @@
+//
+// Created by xi on 19-3-29.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+
+#include <asuka/utils/EventLoopScheduler.h>
+#include <asuka/futures/Future.h>
+
+using namespace asuka;
+
+// a 20-stage Then chain pinned to one EventLoopScheduler, started from
+// another thread: continuations run inline once in the loop, against every
+// stage going through the loop queue as before, with HopScheduler which
+// forwards to the loop but never claims to be current
+
+const int kStages = 20;
+
+class HopScheduler : public Scheduler
+{
+public:
+    explicit HopScheduler(Scheduler* sched) :
+        sched_(sched)
+    {}
+
+    void Schedule(std::function<void ()> func) override
+    {
+        sched_->Schedule(std::move(func));
+    }
+
+    void SchedulerLater(std::chrono::milliseconds duration, std::function<void ()> func) override
+    {
+        sched_->SchedulerLater(duration, std::move(func));
+    }
+
+private:
+    Scheduler* sched_;
+};
+
+void Bench(const char* name, Scheduler* sched, long rounds)
+{
+    uint64_t saved = sched->hops_saved();
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < rounds; ++i)
+    {
+        Promise<long> pm;
+        auto last = pm.GetFuture();
+        for (int stage = 0; stage < kStages; ++stage)
+        {
+            last = last.Then(sched, [](long v) { return v + 1; });
+        }
+        pm.SetValue(i);
+        last.Wait().Check();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("%-16s %8.1f ns per chain, %5.2f hops saved per chain\n", name,
+           ns / static_cast<double>(rounds),
+           static_cast<double>(sched->hops_saved() - saved) / static_cast<double>(rounds));
+}
+
+int main()
+{
+    EventLoopScheduler loop;
+    std::thread thread([&loop] { loop.Loop(); });
+    HopScheduler hop(&loop);
+    const long kRounds = 20 * 1000;
+    for (int i = 0; i < 2; ++i)
+    {
+        Bench("inline in loop", &loop, kRounds);
+        Bench("hop every stage", &hop, kRounds);
+    }
+    loop.Stop();
+    thread.join();
+    return 0;
+}
@@ -0,0 +1,170 @@
+//
+// Created by xi on 19-4-3.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <asuka/utils/ThreadPoolScheduler.h>
+#include <asuka/futures/Future.h>
+
+using namespace asuka;
+
+// Hedged fan-out on a ThreadPoolScheduler: each request sends kBranches
+// copies, the first does kChunks chunks of CPU work, the others four times
+// as many, then each goes through kStages Then stages of one chunk.
+// The first reply wins, measured after all the work has drained:
+// with a hand-made first-of which cancels nothing, as WhenAny did before,
+// with WhenAny and producers which ignore the cancel (only the stages are
+// dropped), and with producers polling Promise::IsCancelled between chunks.
+
+const int kBranches = 4;
+const int kChunks = 20;
+const int kStages = 4;
+
+std::atomic<long> g_chunks(0);
+std::atomic<long> g_stages(0);
+// producers and stages alive, run or not
+std::atomic<long> g_live(0);
+
+// a few microseconds of CPU
+void Chunk()
+{
+    volatile uint64_t x = 0;
+    for (int i = 0; i < 2000; ++i)
+    {
+        x = x * 31 + static_cast<uint64_t>(i);
+    }
+    g_chunks.fetch_add(1, std::memory_order_relaxed);
+}
+
+// leaves g_live when the stage or producer is gone, run or dropped,
+// shared by the copies std::function makes
+class Live
+{
+public:
+    Live()
+    {
+        g_live.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Live(const Live&) = delete;
+    Live& operator=(const Live&) = delete;
+
+    ~Live()
+    {
+        g_live.fetch_sub(1, std::memory_order_release);
+    }
+};
+
+Future<int> Branch(ThreadPoolScheduler* pool, int index, bool poll)
+{
+    auto pm = std::make_shared<Promise<int>>();
+    Future<int> future = pm->GetFuture();
+    pool->Schedule([pm, index, poll, live = std::make_shared<Live>()] {
+        int chunks = index == 0 ? kChunks : kChunks * 4;
+        for (int i = 0; i < chunks; ++i)
+        {
+            if (poll && pm->IsCancelled())
+            {
+                return;
+            }
+            Chunk();
+        }
+        pm->SetValue(index);
+    });
+    for (int stage = 0; stage < kStages; ++stage)
+    {
+        future = future.Then(pool, [live = std::make_shared<Live>()](int v) {
+            g_stages.fetch_add(1, std::memory_order_relaxed);
+            Chunk();
+            return v;
+        });
+    }
+    return future;
+}
+
+// the first result, nothing cancelled
+Future<int> FirstOf(std::vector<Future<int>>& futures)
+{
+    auto pm = std::make_shared<Promise<int>>();
+    auto done = std::make_shared<std::atomic<bool>>(false);
+    Future<int> result = pm->GetFuture();
+    for (auto& future : futures)
+    {
+        detail::AttachCallback(future, [pm, done](Try<int>&& t) {
+            if (!done->exchange(true))
+            {
+                pm->SetValue(std::move(t));
+            }
+        });
+    }
+    return result;
+}
+
+double CpuMs()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e3 +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e3;
+}
+
+enum class Mode
+{
+    kNoCancel,
+    kIgnore,
+    kPoll,
+};
+
+void Bench(const char* name, Mode mode, long requests)
+{
+    ThreadPoolScheduler pool;
+    g_chunks = 0;
+    g_stages = 0;
+    double cpu = CpuMs();
+    auto start = std::chrono::steady_clock::now();
+    double latency = 0;
+    for (long i = 0; i < requests; ++i)
+    {
+        auto sent = std::chrono::steady_clock::now();
+        std::vector<Future<int>> futures;
+        for (int b = 0; b < kBranches; ++b)
+        {
+            futures.push_back(Branch(&pool, b, mode == Mode::kPoll));
+        }
+        Future<int> first = mode == Mode::kNoCancel ? FirstOf(futures)
+                                                    : WhenAny(futures.begin(), futures.end())
+                                                          .Then([](std::pair<size_t, Try<int>>&& p) {
+                                                              return std::move(p.second).Value();
+                                                          });
+        first.Wait().Check();
+        latency += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent).count();
+    }
+    // the losers run on, or not
+    while (g_live.load(std::memory_order_acquire) > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    long stages = static_cast<long>(kBranches) * kStages * requests;
+    printf("%-26s %8.1f us per request, %7.1f ms cpu, %7.1f ms wall, %7ld chunks, %6ld of %ld stages dropped\n",
+           name, latency / static_cast<double>(requests), CpuMs() - cpu, wall, g_chunks.load(),
+           stages - g_stages.load(), stages);
+}
+
+int main(int argc, char* argv[])
+{
+    const long kRequests = argc > 1 ? atol(argv[1]) : 1000;
+    Bench("no cancel", Mode::kNoCancel, kRequests);
+    Bench("WhenAny, producers ignore", Mode::kIgnore, kRequests);
+    Bench("WhenAny, producers poll", Mode::kPoll, kRequests);
+    return 0;
+}
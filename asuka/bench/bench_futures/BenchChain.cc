@@ -0,0 +1,130 @@
+//
+// Created by xi on 19-3-26.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <chrono>
+
+#include <asuka/futures/Future.h>
+
+using namespace asuka;
+
+// a 10-stage Then chain: time per chain and heap allocations per link,
+// with the value set after the chain is built and before
+
+namespace
+{
+
+size_t g_allocations = 0;
+
+} // namespace
+
+// not inlined, or the compiler pairs operator new with free and warns
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    ++g_allocations;
+    void* p = malloc(size);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void* operator new(size_t size, std::align_val_t align)
+{
+    ++g_allocations;
+    void* p = aligned_alloc(static_cast<size_t>(align), (size + static_cast<size_t>(align) - 1) &
+                                                        ~(static_cast<size_t>(align) - 1));
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p, std::align_val_t) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+    free(p);
+}
+
+const int kStages = 10;
+
+volatile long g_sink = 0;
+
+double Seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+Future<long> Chain(Future<long>&& fut)
+{
+    for (int i = 0; i < kStages; ++i)
+    {
+        fut = fut.Then([](long v) { return v + 1; });
+    }
+    return std::move(fut);
+}
+
+void SetAfter(long i)
+{
+    Promise<long> pm;
+    auto last = Chain(pm.GetFuture());
+    pm.SetValue(i);
+    last.Then([](long v) { g_sink = v; });
+}
+
+void SetBefore(long i)
+{
+    Promise<long> pm;
+    auto fut = pm.GetFuture();
+    pm.SetValue(i);
+    auto last = Chain(std::move(fut));
+    last.Then([](long v) { g_sink = v; });
+}
+
+template <typename Run>
+void Bench(const char* name, long n, Run run)
+{
+    size_t allocations = g_allocations;
+    run(0);
+    printf("%-28s %.2f allocations per link cold\n", name,
+           static_cast<double>(g_allocations - allocations) / (kStages + 1));
+    allocations = g_allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < n; ++i)
+    {
+        run(i);
+    }
+    double sec = Seconds(start);
+    printf("%-28s %8.1f ns per chain, %.2f allocations per link\n", name,
+           sec * 1e9 / static_cast<double>(n),
+           static_cast<double>(g_allocations - allocations) / static_cast<double>(n * (kStages + 1)));
+}
+
+int main()
+{
+    printf("sizeof(detail::State<long>) %zu, alignof %zu\n",
+           sizeof(detail::State<long>), alignof(detail::State<long>));
+    const long n = 200 * 1000;
+    Bench("value set after the chain", n, SetAfter);
+    Bench("value set before the chain", n, SetBefore);
+    return 0;
+}
@@ -0,0 +1,114 @@
+//
+// Created by xi on 19-4-8.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <asuka/utils/EventLoopScheduler.h>
+#include <asuka/futures/Future.h>
+#include <asuka/futures/Stats.h>
+
+using namespace asuka;
+
+// A backend with a bimodal latency, 2 ms mostly and 40 ms one time in twenty,
+// as when a replica is slow, simulated by timers of an EventLoopScheduler.
+// Waves of requests go to it plainly, and hedged after a delay: the latency
+// percentiles, how often the hedge fired and which attempt won, and how much
+// extra load the backups put on the backend.
+
+using Clock = std::chrono::steady_clock;
+
+const int kWaves = 20;
+const int kWaveSize = 250;
+
+struct Backend
+{
+    explicit Backend(EventLoopScheduler* sched) :
+        loop(sched),
+        random(42),
+        queries(0),
+        cancelled(0)
+    {}
+
+    // loop thread or the thread submitting, one at a time
+    Future<int> Query()
+    {
+        ++queries;
+        auto latency = std::chrono::milliseconds(std::uniform_int_distribution<int>(0, 19)(random) == 0 ? 40 : 2);
+        auto pm = std::make_shared<Promise<int>>();
+        Future<int> fut = pm->GetFuture();
+        // a cancelled query stops early, it would not hold the replica
+        pm->SetInterruptHandler([this] { ++cancelled; });
+        loop->SchedulerLater(latency, [pm] { pm->SetValue(1); });
+        return fut;
+    }
+
+    EventLoopScheduler* loop;
+    std::mt19937 random;
+    std::atomic<long> queries;
+    std::atomic<long> cancelled;
+};
+
+// delay 0: no hedge
+void Run(const char* name, std::chrono::milliseconds delay)
+{
+    EventLoopScheduler loop;
+    std::thread loop_thread([&loop] { loop.Loop(); });
+    Backend backend(&loop);
+    HedgeStats stats;
+    // written in the loop thread only, where every query completes
+    LatencyHistogram latency;
+
+    for (int wave = 0; wave < kWaves; ++wave)
+    {
+        Promise<void> submitted;
+        Future<void> all_submitted = submitted.GetFuture();
+        std::vector<Future<int>> done;
+        // submitted from the loop thread, Backend is not thread safe
+        loop.Schedule([&] {
+            for (int i = 0; i < kWaveSize; ++i)
+            {
+                Future<int> fut = backend.Query();
+                if (delay.count() > 0)
+                {
+                    fut = Hedge(std::move(fut), delay, [&backend] { return backend.Query(); }, &loop, &stats);
+                }
+                done.push_back(fut.Then([&latency, start = Clock::now()](int v) {
+                    latency.Record(static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count()));
+                    return v;
+                }));
+            }
+            submitted.SetValue();
+        });
+        all_submitted.Wait();
+        WhenAll(done.begin(), done.end()).Wait();
+    }
+    loop.Stop();
+    loop_thread.join();
+
+    long requests = kWaves * kWaveSize;
+    printf("%-12s p50 %6lu  p90 %6lu  p99 %6lu  max %6lu us | hedged %5.1f%%  backup won %5.1f%%  "
+           "backend queries +%4.1f%%  cancelled %ld\n",
+           name, latency.Percentile(50), latency.Percentile(90), latency.Percentile(99), latency.max(),
+           100.0 * static_cast<double>(stats.hedged.load()) / static_cast<double>(requests),
+           100.0 * static_cast<double>(stats.backup_won.load()) / static_cast<double>(requests),
+           100.0 * static_cast<double>(backend.queries.load() - requests) / static_cast<double>(requests),
+           backend.cancelled.load());
+}
+
+int main()
+{
+    printf("%d requests, backend 2 ms or 40 ms one time in twenty\n", kWaves * kWaveSize);
+    Run("no hedge", std::chrono::milliseconds(0));
+    Run("hedge 5 ms", std::chrono::milliseconds(5));
+    Run("hedge 10 ms", std::chrono::milliseconds(10));
+    Run("hedge 20 ms", std::chrono::milliseconds(20));
+    return 0;
+}
@@ -0,0 +1,199 @@
+//
+// Created by xi on 19-3-25.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <asuka/futures/Future.h>
+
+using namespace asuka;
+
+// Promise/Future completion: detail::State against the then_mutex_ protocol
+// it replaced, replicated here as MutexState with the same fields.
+// 1. value set before callback, 2. callback before value, in one thread
+// 3. two threads ping-pong, each round a state is set by the other thread
+// and the full Future link (Promise, Then, next Promise) for reference
+
+using Clock = std::chrono::steady_clock;
+
+double Seconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void Report(const char* name, double sec, long n)
+{
+    printf("%-36s %8.1f ns per op\n", name, sec * 1e9 / static_cast<double>(n));
+}
+
+// progress, value and callback guarded by then_mutex_
+template <typename T>
+struct MutexState
+{
+    enum class Progress
+    {
+        kNone,
+        kHasResult,
+        kHasCallback,
+        kDone
+    };
+
+    void SetValue(Try<T>&& value)
+    {
+        std::unique_lock<std::mutex> lock(then_mutex_);
+        if (progress_ == Progress::kHasResult || progress_ == Progress::kDone)
+        {
+            return;
+        }
+        value_ = std::move(value);
+        if (progress_ == Progress::kHasCallback)
+        {
+            progress_ = Progress::kDone;
+            lock.unlock();
+            then_(std::move(value_));
+        }
+        else
+        {
+            progress_ = Progress::kHasResult;
+        }
+    }
+
+    void SetCallback(std::function<void (Try<T>&& )>&& func)
+    {
+        std::unique_lock<std::mutex> lock(then_mutex_);
+        then_ = std::move(func);
+        if (progress_ == Progress::kHasResult)
+        {
+            progress_ = Progress::kDone;
+            lock.unlock();
+            then_(std::move(value_));
+        }
+        else
+        {
+            progress_ = Progress::kHasCallback;
+        }
+    }
+
+    Progress progress_ = Progress::kNone;
+    std::atomic<bool> retrieved_{false};
+    Try<T> value_;
+    std::mutex then_mutex_;
+    std::function<void (detail::TimeoutCallback&& )> on_timeout_;
+    std::function<void (Try<T>&& )> then_;
+};
+
+// same calls on detail::State
+template <typename T>
+struct LockFreeState : detail::State<T>
+{
+    void SetValue(Try<T>&& value)
+    {
+        if (this->Claim())
+        {
+            this->SetResult(std::move(value));
+        }
+    }
+};
+
+const long kRounds = 1000 * 1000;
+const long kPingPongRounds = 100 * 1000;
+
+volatile long g_sink = 0;
+
+template <typename StateType>
+void BenchState(const char* value_first, const char* callback_first)
+{
+    auto start = Clock::now();
+    for (long i = 0; i < kRounds; ++i)
+    {
+        StateType state;
+        state.SetValue(Try<long>(i));
+        state.SetCallback([](Try<long>&& v) { g_sink = v.Value(); });
+    }
+    Report(value_first, Seconds(start), kRounds);
+
+    start = Clock::now();
+    for (long i = 0; i < kRounds; ++i)
+    {
+        StateType state;
+        state.SetCallback([](Try<long>&& v) { g_sink = v.Value(); });
+        state.SetValue(Try<long>(i));
+    }
+    Report(callback_first, Seconds(start), kRounds);
+}
+
+void BenchFuture()
+{
+    auto start = Clock::now();
+    for (long i = 0; i < kRounds; ++i)
+    {
+        Promise<long> pm;
+        auto fut = pm.GetFuture();
+        pm.SetValue(i);
+        fut.Then([](long v) { g_sink = v; });
+    }
+    Report("Future link, value then callback", Seconds(start), kRounds);
+
+    start = Clock::now();
+    for (long i = 0; i < kRounds; ++i)
+    {
+        Promise<long> pm;
+        auto fut = pm.GetFuture();
+        fut.Then([](long v) { g_sink = v; });
+        pm.SetValue(i);
+    }
+    Report("Future link, callback then value", Seconds(start), kRounds);
+}
+
+// the main thread attaches callbacks, the peer sets values as soon as it sees
+// the state, so SetCallback and SetValue race on it
+template <typename StateType>
+void BenchPingPong(const char* name)
+{
+    std::atomic<StateType*> slot(nullptr);
+    std::atomic<long> done(0);
+    std::thread peer([&] {
+        for (long i = 0; i < kPingPongRounds; ++i)
+        {
+            StateType* state;
+            while ((state = slot.exchange(nullptr, std::memory_order_acq_rel)) == nullptr)
+            {
+                std::this_thread::yield();
+            }
+            state->SetValue(Try<long>(i));
+            // the state lives on the other stack, hands it back after SetValue returns
+            done.fetch_add(1, std::memory_order_release);
+        }
+    });
+    auto start = Clock::now();
+    for (long i = 0; i < kPingPongRounds; ++i)
+    {
+        StateType state;
+        slot.store(&state, std::memory_order_release);
+        state.SetCallback([](Try<long>&& v) { g_sink = v.Value(); });
+        while (done.load(std::memory_order_acquire) <= i)
+        {
+            std::this_thread::yield();
+        }
+    }
+    Report(name, Seconds(start), kPingPongRounds);
+    peer.join();
+}
+
+int main()
+{
+    // libstdc++ skips locking until the process has started a thread
+    std::thread([] {}).join();
+    BenchState<LockFreeState<long>>("State value then callback", "State callback then value");
+    BenchState<MutexState<long>>("MutexState value then callback", "MutexState callback then value");
+    BenchPingPong<LockFreeState<long>>("State ping-pong round trip");
+    BenchPingPong<MutexState<long>>("MutexState ping-pong round trip");
+    BenchFuture();
+    return 0;
+}
@@ -0,0 +1,96 @@
+//
+// Created by xi on 19-4-6.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+#include <asuka/utils/ThreadPoolScheduler.h>
+#include <asuka/futures/Future.h>
+#include <asuka/futures/Stats.h>
+
+using namespace asuka;
+
+// Built twice, as stats_bench with ASUKA_FUTURE_STATS and as
+// nostats_bench without: the cost of the stamps on a pending 10-stage Then
+// chain, and what FutureStats shows of a pipeline on a ThreadPoolScheduler,
+// where every request goes through 4 stages on the pool.
+
+const int kStages = 10;
+
+using Clock = std::chrono::steady_clock;
+
+volatile long g_sink = 0;
+
+void BenchChain(long rounds)
+{
+    auto start = Clock::now();
+    for (long i = 0; i < rounds; ++i)
+    {
+        Promise<long> pm;
+        Future<long> fut = pm.GetFuture();
+        for (int stage = 0; stage < kStages; ++stage)
+        {
+            fut = fut.Then([](long v) { return v + 1; });
+        }
+        pm.SetValue(i);
+        g_sink = fut.Wait().Value();
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    printf("stats %-8s %8.1f ns per %d-stage chain\n", FutureStats::kEnabled ? "on" : "off",
+           ns / static_cast<double>(rounds), kStages);
+}
+
+void Print(const char* name, const LatencyHistogram& h, const char* unit)
+{
+    printf("  %-11s %8lu recorded, mean %9.1f, p50 %8lu, p90 %8lu, p99 %8lu, max %8lu %s\n", name,
+           h.count(), h.Mean(), h.Percentile(50), h.Percentile(90), h.Percentile(99), h.max(), unit);
+}
+
+void BenchPipeline(long requests)
+{
+    FutureStats before = FutureStats::Snapshot();
+    ThreadPoolScheduler pool;
+    std::vector<Promise<long>> promises(static_cast<size_t>(requests));
+    std::vector<Future<long>> results;
+    auto start = Clock::now();
+    for (auto& pm : promises)
+    {
+        Future<long> fut = pm.GetFuture();
+        for (int stage = 0; stage < 4; ++stage)
+        {
+            fut = fut.Then(&pool, [](long v) { return v * 3 + 1; });
+        }
+        results.push_back(std::move(fut));
+    }
+    for (long i = 0; i < requests; ++i)
+    {
+        promises[static_cast<size_t>(i)].SetValue(i);
+    }
+    for (auto& fut : results)
+    {
+        g_sink = fut.Wait().Value();
+    }
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    FutureStats stats = FutureStats::Snapshot().Since(before);
+    printf("pipeline: %ld requests of 4 pool stages in %.1f ms, %zu threads\n", requests, ms, pool.threads());
+    if (!FutureStats::kEnabled)
+    {
+        printf("  nothing recorded, build with ASUKA_FUTURE_STATS\n");
+        return;
+    }
+    Print("completion", stats.completion, "ns");
+    Print("queueing", stats.queueing, "ns");
+    Print("depth", stats.depth, "Thens");
+}
+
+int main(int argc, char* argv[])
+{
+    const long kRounds = argc > 1 ? atol(argv[1]) : 1000 * 1000;
+    printf("sizeof(detail::State<long>) %zu\n", sizeof(detail::State<long>));
+    BenchChain(kRounds);
+    BenchPipeline(kRounds / 10);
+    return 0;
+}
@@ -0,0 +1,213 @@
+//
+// Created by xi on 19-4-1.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <asuka/futures/Task.h>
+#include <asuka/coroutine/Coroutine.h>
+
+using namespace asuka;
+
+// Many small requests each waiting for a value, as Task coroutines
+// (pooled and heap frames), as ucontext Coroutines in Coroutine::Await
+// (own 8 KB stacks, or one SharedStack) and as Then callbacks:
+// bytes held per pending request, ns to start and suspend one, ns to resume
+// and finish one. Short tasks created and finished one after another, where
+// pooled frames are reused. Chains of awaits and Thens, 10K deep, and a
+// million deep for Task only: a Then chain completed from its head runs the
+// callbacks recursively and overflows the stack.
+// Each run is a child process so that the pools of one do not serve the next.
+
+using Clock = std::chrono::steady_clock;
+
+double Nanos(Clock::time_point start, long n)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(n);
+}
+
+size_t HeapInUse()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+void RunIsolated(const std::function<void ()>& func)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        func();
+        fflush(stdout);
+        _exit(0);
+    }
+    waitpid(pid, nullptr, 0);
+}
+
+void Report(const char* name, long n, size_t heap_before, Clock::time_point start,
+            const std::function<void ()>& resume, const long& sum)
+{
+    double suspend = Nanos(start, n);
+    double bytes = static_cast<double>(HeapInUse() - heap_before) / static_cast<double>(n);
+    start = Clock::now();
+    resume();
+    double finish = Nanos(start, n);
+    printf("%-24s %8ld pending: %7.0f bytes each, %7.1f ns to start, %7.1f ns to finish%s\n",
+           name, n, bytes, suspend, finish, sum == n * (n + 1) / 2 ? "" : " (WRONG SUM)");
+}
+
+Task<void> Handle(Future<long> future, long* sum)
+{
+    long value = (co_await std::move(future)).Value();
+    *sum += value + 1;
+}
+
+void BenchTask(long n, FrameAllocator* allocator, const char* name)
+{
+    FrameAllocator::SetDefault(allocator);
+    std::vector<Promise<long>> promises(static_cast<size_t>(n));
+    long sum = 0;
+    size_t heap = HeapInUse();
+    auto start = Clock::now();
+    for (long i = 0; i < n; ++i)
+    {
+        Handle(promises[i].GetFuture(), &sum).Start();
+    }
+    Report(name, n, heap, start, [&] {
+        for (long i = 0; i < n; ++i)
+        {
+            promises[i].SetValue(i);
+        }
+    }, sum);
+}
+
+void BenchCoroutine(long n, bool shared, const char* name)
+{
+    StackAllocator::SetDefault(new HeapStackAllocator());
+    std::vector<Promise<long>> promises(static_cast<size_t>(n));
+    std::vector<CoroutinePtr> coroutines;
+    coroutines.reserve(static_cast<size_t>(n));
+    SharedStackPtr shared_stack = shared ? std::make_shared<SharedStack>() : SharedStackPtr();
+    long sum = 0;
+    size_t heap = HeapInUse();
+    auto start = Clock::now();
+    for (long i = 0; i < n; ++i)
+    {
+        auto func = [&promises, &sum, i] {
+            sum += Coroutine::Await(promises[i].GetFuture()).Value() + 1;
+        };
+        coroutines.push_back(shared ? Coroutine::CreateCoroutineOnSharedStack(shared_stack, func)
+                                    : Coroutine::CreateCoroutine(func));
+        Coroutine::Send(coroutines.back());
+    }
+    Report(name, n, heap, start, [&] {
+        for (long i = 0; i < n; ++i)
+        {
+            promises[i].SetValue(i);
+        }
+    }, sum);
+}
+
+void BenchThen(long n)
+{
+    std::vector<Promise<long>> promises(static_cast<size_t>(n));
+    long sum = 0;
+    size_t heap = HeapInUse();
+    auto start = Clock::now();
+    for (long i = 0; i < n; ++i)
+    {
+        promises[i].GetFuture().Then([&sum](long value) {
+            sum += value + 1;
+        });
+    }
+    Report("Then", n, heap, start, [&] {
+        for (long i = 0; i < n; ++i)
+        {
+            promises[i].SetValue(i);
+        }
+    }, sum);
+}
+
+Task<long> Value(long n)
+{
+    co_return n;
+}
+
+Task<long> Add(long a, long b)
+{
+    co_return co_await Value(a) + co_await Value(b);
+}
+
+// three frames and a Future state per iteration
+void BenchChurn(long n, FrameAllocator* allocator, const char* name)
+{
+    FrameAllocator::SetDefault(allocator);
+    long sum = 0;
+    auto start = Clock::now();
+    for (long i = 0; i < n; ++i)
+    {
+        sum += Add(i, 1).Start().Wait().Value();
+    }
+    printf("%-24s %8ld in turn:  %7.1f ns each%s\n", name, n, Nanos(start, n),
+           sum == n * (n + 1) / 2 ? "" : " (WRONG SUM)");
+}
+
+Task<long> Sum(long n)
+{
+    if (n == 0)
+    {
+        co_return 0;
+    }
+    co_return n + co_await Sum(n - 1);
+}
+
+void BenchDeepTask(long depth)
+{
+    auto start = Clock::now();
+    long sum = Sum(depth).Start().Wait().Value();
+    printf("Task await chain         %8ld deep:     %7.1f ns per level%s\n", depth, Nanos(start, depth),
+           sum == depth * (depth + 1) / 2 ? "" : " (WRONG SUM)");
+}
+
+void BenchDeepThen(long depth)
+{
+    Promise<long> pm;
+    Future<long> future = pm.GetFuture();
+    auto start = Clock::now();
+    for (long i = 1; i <= depth; ++i)
+    {
+        future = future.Then([i](long value) { return value + i; });
+    }
+    pm.SetValue(0L);
+    long sum = future.Wait().Value();
+    printf("Then chain               %8ld deep:     %7.1f ns per level%s\n", depth, Nanos(start, depth),
+           sum == depth * (depth + 1) / 2 ? "" : " (WRONG SUM)");
+}
+
+int main(int argc, char* argv[])
+{
+    const long kPending = argc > 1 ? atol(argv[1]) : 1000 * 1000;
+    // 8 KB stacks for a million coroutines would be 8 GB
+    const long kStackful = kPending / 10;
+
+    RunIsolated([=] { BenchTask(kPending, new PooledFrameAllocator(), "Task, pooled frames"); });
+    RunIsolated([=] { BenchTask(kPending, new HeapFrameAllocator(), "Task, heap frames"); });
+    RunIsolated([=] { BenchThen(kPending); });
+    RunIsolated([=] { BenchCoroutine(kPending, true, "Coroutine, SharedStack"); });
+    RunIsolated([=] { BenchCoroutine(kStackful, false, "Coroutine, 8 KB stacks"); });
+    RunIsolated([=] { BenchChurn(kPending, new PooledFrameAllocator(), "Task, pooled frames"); });
+    RunIsolated([=] { BenchChurn(kPending, new HeapFrameAllocator(), "Task, heap frames"); });
+    RunIsolated([=] { BenchDeepTask(10 * 1000); });
+    RunIsolated([=] { BenchDeepThen(10 * 1000); });
+    RunIsolated([=] { BenchDeepTask(kPending); });
+    return 0;
+}
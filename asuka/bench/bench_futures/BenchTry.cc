@@ -0,0 +1,177 @@
+//
+// Created by xi on 19-4-5.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <exception>
+#include <new>
+#include <string>
+#include <utility>
+
+#include <asuka/futures/Future.h>
+
+using namespace asuka;
+
+// A Try moved through a long chain of calls, each taking it by value and
+// returning it, as Then hops do: Try against LegacyTry, the Try it replaced
+// (state in front, both branches on every copy and move), for int and for
+// std::string, then the same values through a pending Then chain.
+
+template <typename T>
+class LegacyTry
+{
+public:
+    enum class State
+    {
+        kNone,
+        kException,
+        kValue
+    };
+
+    explicit LegacyTry(T&& t) :
+        state_(State::kValue),
+        value_(std::move(t))
+    {}
+
+    ~LegacyTry()
+    {
+        if (state_ == State::kException)
+        {
+            exception_.~exception_ptr();
+        }
+        else if (state_ == State::kValue)
+        {
+            value_.~T();
+        }
+    }
+
+    LegacyTry(LegacyTry&& t) noexcept :
+        state_(t.state_)
+    {
+        if (state_ == State::kValue)
+        {
+            new (&value_) T(std::move(t.value_));
+        }
+        else if (state_ == State::kException)
+        {
+            new (&exception_) std::exception_ptr(std::move(t.exception_));
+        }
+    }
+
+    T& Value()
+    {
+        if (state_ != State::kValue)
+        {
+            std::rethrow_exception(exception_);
+        }
+        return value_;
+    }
+
+private:
+    State state_;
+    union
+    {
+        T value_;
+        std::exception_ptr exception_;
+    };
+};
+
+using Clock = std::chrono::steady_clock;
+
+size_t Weight(int v)
+{
+    return static_cast<size_t>(v);
+}
+
+size_t Weight(const std::string& v)
+{
+    return v.size();
+}
+
+const int kHops = 1000;
+
+// one hop: moved in, moved out
+template <typename TryType>
+__attribute__((noinline)) TryType Hop(TryType t)
+{
+    return TryType(std::move(t));
+}
+
+// kHops calls deep, each hop moves it twice
+template <typename T>
+__attribute__((noinline)) LegacyTry<T> LegacyHops(LegacyTry<T> t, int hops)
+{
+    if (hops == 0)
+    {
+        return t;
+    }
+    return LegacyHops<T>(Hop<LegacyTry<T>>(std::move(t)), hops - 1);
+}
+
+template <typename T>
+__attribute__((noinline)) Try<T> TryHops(Try<T> t, int hops)
+{
+    if (hops == 0)
+    {
+        return t;
+    }
+    return TryHops<T>(Hop<Try<T>>(std::move(t)), hops - 1);
+}
+
+template <typename T>
+void BenchChain(const char* name, const T& value, long rounds)
+{
+    auto start = Clock::now();
+    size_t check = 0;
+    for (long i = 0; i < rounds; ++i)
+    {
+        check += Weight(TryHops<T>(Try<T>(T(value)), kHops).Value());
+    }
+    double try_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    start = Clock::now();
+    for (long i = 0; i < rounds; ++i)
+    {
+        check += Weight(LegacyHops<T>(LegacyTry<T>(T(value)), kHops).Value());
+    }
+    double legacy_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    double hops = static_cast<double>(rounds * kHops);
+    printf("%-12s call chain: Try (sizeof %2zu) %6.2f ns per hop, LegacyTry (sizeof %2zu) %6.2f ns per hop%s\n",
+           name, sizeof(Try<T>), try_ns / hops, sizeof(LegacyTry<T>), legacy_ns / hops, check == 0 ? " (WRONG)" : "");
+}
+
+template <typename T>
+void BenchThen(const char* name, const T& value, long rounds)
+{
+    const int kStages = 100;
+    auto start = Clock::now();
+    size_t check = 0;
+    for (long i = 0; i < rounds; ++i)
+    {
+        Promise<T> pm;
+        Future<T> fut = pm.GetFuture();
+        for (int stage = 0; stage < kStages; ++stage)
+        {
+            fut = fut.Then([](T&& v) { return std::move(v); });
+        }
+        pm.SetValue(T(value));
+        check += Weight(fut.Wait().Value());
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    printf("%-12s Then chain: %6.2f ns per stage%s\n", name, ns / static_cast<double>(rounds * kStages),
+           check == 0 ? " (WRONG)" : "");
+}
+
+int main(int argc, char* argv[])
+{
+    const long kRounds = argc > 1 ? atol(argv[1]) : 10 * 1000;
+    const std::string text(100, 'x');
+
+    BenchChain<int>("int", 1, kRounds);
+    BenchChain<std::string>("std::string", text, kRounds);
+    BenchThen<int>("int", 1, kRounds / 10);
+    BenchThen<std::string>("std::string", text, kRounds / 10);
+    return 0;
+}
@@ -0,0 +1,151 @@
+//
+// Created by xi on 19-3-28.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <asuka/futures/Future.h>
+
+using namespace asuka;
+
+// wake-up latency from SetValue in one thread to the return of Wait in
+// another, and heap allocations per Wait: the futex Wait against the
+// condition variable Wait it replaced, replicated here as CondWait
+
+namespace
+{
+
+std::atomic<size_t> g_allocations(0);
+
+} // namespace
+
+// not inlined, or the compiler pairs operator new with free and warns
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+using Clock = std::chrono::steady_clock;
+
+// the old Wait: a mutex, a condition variable and the value shared with a callback
+Try<long> CondWait(Future<long>& fut)
+{
+    struct Waiter
+    {
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool ready = false;
+        Try<long> value;
+    };
+    auto waiter = std::make_shared<Waiter>();
+    detail::AttachCallback(fut, [waiter](Try<long>&& v) {
+        std::lock_guard<std::mutex> lock(waiter->mutex);
+        waiter->value = std::move(v);
+        waiter->ready = true;
+        waiter->cond.notify_one();
+    });
+    std::unique_lock<std::mutex> lock(waiter->mutex);
+    waiter->cond.wait(lock, [&waiter] { return waiter->ready; });
+    return std::move(waiter->value);
+}
+
+template <typename WaitFunc>
+void BenchLatency(const char* name, long rounds, WaitFunc wait)
+{
+    std::atomic<Promise<long>*> slot(nullptr);
+    std::atomic<int64_t> set_at(0);
+    std::thread setter([&] {
+        for (long i = 0; i < rounds; ++i)
+        {
+            Promise<long>* waiting;
+            while ((waiting = slot.exchange(nullptr, std::memory_order_acq_rel)) == nullptr)
+            {
+                std::this_thread::yield();
+            }
+            // a reference of our own, the waiter drops its promise once woken
+            Promise<long> pm(*waiting);
+            // let the waiter go to sleep
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+            set_at.store(Clock::now().time_since_epoch().count(), std::memory_order_release);
+            pm.SetValue(i);
+        }
+    });
+    std::vector<int64_t> latencies;
+    latencies.reserve(static_cast<size_t>(rounds));
+    size_t allocations = 0;
+    for (long i = 0; i < rounds; ++i)
+    {
+        Promise<long> pm;
+        auto fut = pm.GetFuture();
+        slot.store(&pm, std::memory_order_release);
+        size_t before = g_allocations.load(std::memory_order_relaxed);
+        auto value = wait(fut);
+        int64_t now = Clock::now().time_since_epoch().count();
+        allocations += g_allocations.load(std::memory_order_relaxed) - before;
+        latencies.push_back(now - set_at.load(std::memory_order_acquire));
+        value.Check();
+    }
+    setter.join();
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&latencies](double q) {
+        return static_cast<double>(latencies[static_cast<size_t>(q * static_cast<double>(latencies.size() - 1))]);
+    };
+    printf("%-12s wake-up p50 %8.0f ns, p99 %8.0f ns, %.2f allocations per wait\n", name,
+           at(0.5), at(0.99), static_cast<double>(allocations) / static_cast<double>(rounds));
+}
+
+// the result is there before Wait
+template <typename WaitFunc>
+void BenchReady(const char* name, long rounds, WaitFunc wait)
+{
+    auto start = Clock::now();
+    for (long i = 0; i < rounds; ++i)
+    {
+        Promise<long> pm;
+        auto fut = pm.GetFuture();
+        pm.SetValue(i);
+        wait(fut).Check();
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    printf("%-12s ready %8.1f ns per wait\n", name, ns / static_cast<double>(rounds));
+}
+
+int main()
+{
+    const long kRounds = 20 * 1000;
+    auto futex_wait = [](Future<long>& fut) { return fut.Wait(); };
+    for (int i = 0; i < 2; ++i)
+    {
+        BenchLatency("futex Wait", kRounds, futex_wait);
+        BenchLatency("CondWait", kRounds, CondWait);
+    }
+    BenchReady("futex Wait", 1000 * 1000, futex_wait);
+    BenchReady("CondWait", 1000 * 1000, CondWait);
+    return 0;
+}
@@ -0,0 +1,142 @@
+//
+// Created by xi on 19-3-27.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <asuka/futures/Future.h>
+
+using namespace asuka;
+
+// fan-in of 10 to 10K futures: WhenAll and WhenAny against the mutex and
+// push_back context WhenAll used to have, replicated here as MutexCollectAllContext.
+// Values are set by one thread, then by 4 threads at once.
+
+using Clock = std::chrono::steady_clock;
+
+double Seconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+template <typename T>
+struct MutexCollectAllContext
+{
+    explicit MutexCollectAllContext(size_t n) :
+        results(n)
+    {}
+
+    Promise<std::vector<Try<T>>> pm;
+    std::mutex mutex;
+    std::vector<Try<T>> results;
+    std::vector<size_t> collects;
+
+    void SetResult(size_t i, Try<T>&& t)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        results[i] = std::move(t);
+        collects.push_back(i);
+        if (collects.size() == results.size())
+        {
+            lock.unlock();
+            pm.SetValue(std::move(results));
+        }
+    }
+};
+
+template <typename T>
+Future<std::vector<Try<T>>> MutexWhenAll(std::vector<Future<T>>& futs)
+{
+    auto ctx = std::make_shared<MutexCollectAllContext<T>>(futs.size());
+    auto future = ctx->pm.GetFuture();
+    for (size_t i = 0; i < futs.size(); ++i)
+    {
+        detail::AttachCallback(futs[i], [ctx, i](Try<T>&& t) {
+            ctx->SetResult(i, std::move(t));
+        });
+    }
+    return future;
+}
+
+// promises are made outside the timing, the combinator and completion inside
+template <typename Collect>
+double Run(size_t n, int setters, Collect collect)
+{
+    std::vector<Promise<long>> pms(n);
+    std::vector<Future<long>> futs;
+    futs.reserve(n);
+    for (auto& pm : pms)
+    {
+        futs.push_back(pm.GetFuture());
+    }
+    auto start = Clock::now();
+    auto result = collect(futs);
+    if (setters == 1)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            pms[i].SetValue(static_cast<long>(i));
+        }
+    }
+    else
+    {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < setters; ++t)
+        {
+            threads.emplace_back([&pms, n, t, setters] {
+                for (size_t i = static_cast<size_t>(t); i < n; i += static_cast<size_t>(setters))
+                {
+                    pms[i].SetValue(static_cast<long>(i));
+                }
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+    }
+    auto value = result.Wait();
+    double sec = Seconds(start);
+    value.Check();
+    return sec;
+}
+
+template <typename Collect>
+void Bench(const char* name, size_t n, int setters, Collect collect)
+{
+    // about 1M elements per size
+    long rounds = static_cast<long>(1000 * 1000 / n);
+    double sec = 0;
+    for (long i = 0; i < rounds; ++i)
+    {
+        sec += Run(n, setters, collect);
+    }
+    printf("%-24s %6zu futures %d setters %8.1f ns per future\n", name, n, setters,
+           sec * 1e9 / static_cast<double>(rounds) / static_cast<double>(n));
+}
+
+int main()
+{
+    // libstdc++ skips locking until the process has started a thread
+    std::thread([] {}).join();
+    auto all = [](std::vector<Future<long>>& futs) { return WhenAll(futs.begin(), futs.end()); };
+    auto any = [](std::vector<Future<long>>& futs) { return WhenAny(futs.begin(), futs.end()); };
+    auto mutex_all = [](std::vector<Future<long>>& futs) { return MutexWhenAll(futs); };
+    for (int setters : {1, 4})
+    {
+        for (size_t n : {10, 100, 1000, 10000})
+        {
+            Bench("WhenAll", n, setters, all);
+            Bench("MutexWhenAll", n, setters, mutex_all);
+            Bench("WhenAny", n, setters, any);
+        }
+    }
+    return 0;
+}
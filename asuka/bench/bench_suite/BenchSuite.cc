@@ -0,0 +1,203 @@
+//
+// Created by xi on 19-4-4.
+//
+
+#include <stdio.h>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <asuka/bench/bench_suite/Harness.h>
+#include <asuka/coroutine/Coroutine.h>
+#include <asuka/futures/Future.h>
+
+using namespace asuka;
+using namespace asuka::bench;
+
+// The micro benchmarks of coroutines and futures in one place, run by
+// `make bench_json` to track them across commits:
+//
+//     suite_bench --json=bench.json
+//     suite_bench --filter=futures/then --repetitions=10
+//
+// The *_bench programs next to it measure the variants and the comparisons.
+
+volatile long g_sink = 0;
+
+void ContextSwitch(int64_t n)
+{
+    CoroutinePtr co = Coroutine::CreateCoroutine([] {
+        while (true)
+        {
+            Coroutine::Yield();
+        }
+    });
+    Coroutine::Send(co);
+    for (int64_t i = 0; i < n; ++i)
+    {
+        Coroutine::Send(co);
+    }
+}
+
+void CreateDestroy(int64_t n)
+{
+    for (int64_t i = 0; i < n; ++i)
+    {
+        CoroutinePtr co = Coroutine::CreateCoroutine([] { g_sink = 1; });
+        Coroutine::Send(co);
+    }
+}
+
+void CreateDestroyShared(int64_t n)
+{
+    auto shared_stack = std::make_shared<SharedStack>();
+    for (int64_t i = 0; i < n; ++i)
+    {
+        CoroutinePtr co = Coroutine::CreateCoroutineOnSharedStack(shared_stack, [] { g_sink = 1; });
+        Coroutine::Send(co);
+    }
+}
+
+void SetValue(int64_t n)
+{
+    for (int64_t i = 0; i < n; ++i)
+    {
+        Promise<long> pm;
+        Future<long> fut = pm.GetFuture();
+        pm.SetValue(i);
+    }
+}
+
+void SetValueThen(int64_t n)
+{
+    for (int64_t i = 0; i < n; ++i)
+    {
+        Promise<long> pm;
+        pm.GetFuture().Then([](long v) { g_sink = v; });
+        pm.SetValue(i);
+    }
+}
+
+// a chain of depth Thens made on a pending future, then completed
+void ThenChain(int64_t n, int depth)
+{
+    for (int64_t i = 0; i < n; ++i)
+    {
+        Promise<long> pm;
+        Future<long> fut = pm.GetFuture();
+        for (int d = 0; d < depth; ++d)
+        {
+            fut = fut.Then([](long v) { return v + 1; });
+        }
+        pm.SetValue(i);
+        g_sink = fut.Wait().Value();
+    }
+}
+
+void WaitReady(int64_t n)
+{
+    for (int64_t i = 0; i < n; ++i)
+    {
+        g_sink = MakeReadyFuture(i).Wait().Value();
+    }
+}
+
+// round trip: the value is set by another thread which takes the promise
+void WaitCrossThread(int64_t n)
+{
+    std::atomic<Promise<long>*> slot(nullptr);
+    std::atomic<bool> stop(false);
+    std::thread setter([&slot, &stop] {
+        while (!stop.load(std::memory_order_relaxed))
+        {
+            Promise<long>* taken = slot.exchange(nullptr, std::memory_order_acquire);
+            if (!taken)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            Promise<long> pm(std::move(*taken));
+            pm.SetValue(1L);
+        }
+    });
+    for (int64_t i = 0; i < n; ++i)
+    {
+        Promise<long> pm;
+        Future<long> fut = pm.GetFuture();
+        slot.store(&pm, std::memory_order_release);
+        g_sink = fut.Wait().Value();
+    }
+    stop = true;
+    setter.join();
+}
+
+// fan-in of width pending futures
+void FanIn(int64_t n, size_t width, bool all)
+{
+    std::vector<Promise<long>> promises;
+    std::vector<Future<long>> futures;
+    for (int64_t i = 0; i < n; ++i)
+    {
+        promises.resize(width);
+        for (auto& pm : promises)
+        {
+            futures.push_back(pm.GetFuture());
+        }
+        if (all)
+        {
+            auto collected = WhenAll(futures.begin(), futures.end());
+            for (auto& pm : promises)
+            {
+                pm.SetValue(i);
+            }
+            g_sink = static_cast<long>(collected.Wait().Value().size());
+        }
+        else
+        {
+            auto any = WhenAny(futures.begin(), futures.end());
+            for (auto& pm : promises)
+            {
+                pm.SetValue(i);
+            }
+            g_sink = static_cast<long>(any.Wait().Value().first);
+        }
+        promises.clear();
+        futures.clear();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Suite::Options options;
+    try
+    {
+        options = Suite::ParseOptions(argc, argv);
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 2;
+    }
+    Suite suite(options);
+
+    suite.Add("coroutine/context_switch", ContextSwitch);
+    suite.Add("coroutine/create_destroy", CreateDestroy);
+    suite.Add("coroutine/create_destroy_shared_stack", CreateDestroyShared);
+
+    suite.Add("futures/promise_set_value", SetValue);
+    suite.Add("futures/promise_set_value_then", SetValueThen);
+    for (int depth : {1, 10, 100, 1000})
+    {
+        suite.Add("futures/then_chain/" + std::to_string(depth), [depth](int64_t n) { ThenChain(n, depth); });
+    }
+    suite.Add("futures/wait_ready", WaitReady);
+    suite.Add("futures/wait_cross_thread", WaitCrossThread);
+    for (size_t width : {10, 1000})
+    {
+        suite.Add("futures/when_all/" + std::to_string(width), [width](int64_t n) { FanIn(n, width, true); });
+        suite.Add("futures/when_any/" + std::to_string(width), [width](int64_t n) { FanIn(n, width, false); });
+    }
+    return suite.Run();
+}
@@ -0,0 +1,364 @@
+//
+// Created by xi on 19-4-4.
+//
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <asuka/bench/bench_suite/Harness.h>
+
+#ifndef ASUKA_BENCH_REVISION
+#define ASUKA_BENCH_REVISION "unknown"
+#endif
+
+namespace asuka
+{
+
+namespace bench
+{
+
+namespace
+{
+
+// calibration stops growing n here, whatever the time
+const int64_t kMaxIterations = int64_t{1} << 32;
+
+int OpenCounter(uint32_t type, uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    // the group is enabled through its leader
+    if (group < 0)
+    {
+        attr.disabled = 1;
+    }
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+}
+
+double Seconds(const Body& body, int64_t n)
+{
+    auto start = std::chrono::steady_clock::now();
+    body(n);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void WriteString(FILE* out, const std::string& s)
+{
+    fputc('"', out);
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            fputc('\\', out);
+            fputc(c, out);
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            fprintf(out, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+bool TakeFlag(const char* arg, const char* flag, std::string* value)
+{
+    size_t len = strlen(flag);
+    if (strncmp(arg, flag, len) != 0 || arg[len] != '=')
+    {
+        return false;
+    }
+    *value = arg + len + 1;
+    return true;
+}
+
+} // namespace
+
+PerfCounters::PerfCounters()
+{
+    const uint64_t configs[kCounters] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+    };
+    std::fill(fds_, fds_ + kCounters, -1);
+    for (int i = 0; i < kCounters; ++i)
+    {
+        fds_[i] = OpenCounter(PERF_TYPE_HARDWARE, configs[i], i == 0 ? -1 : fds_[0]);
+        if (fds_[i] < 0)
+        {
+            // all or nothing
+            for (int j = 0; j < i; ++j)
+            {
+                close(fds_[j]);
+                fds_[j] = -1;
+            }
+            return;
+        }
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int fd : fds_)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+}
+
+void PerfCounters::Start()
+{
+    if (!Available())
+    {
+        return;
+    }
+    ioctl(fds_[kCycles], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds_[kCycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounters::Stop(uint64_t* values)
+{
+    if (!Available())
+    {
+        return;
+    }
+    ioctl(fds_[kCycles], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    // PERF_FORMAT_GROUP: the number of counters then their values
+    uint64_t buffer[1 + kCounters];
+    if (read(fds_[kCycles], buffer, sizeof(buffer)) != static_cast<ssize_t>(sizeof(buffer)))
+    {
+        return;
+    }
+    for (int i = 0; i < kCounters; ++i)
+    {
+        values[i] += buffer[1 + i];
+    }
+}
+
+const char* PerfCounters::Name(int counter)
+{
+    static const char* const kNames[kCounters] = {"cycles", "instructions", "cache_misses"};
+    return kNames[counter];
+}
+
+Suite::Options Suite::ParseOptions(int argc, char* argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string value;
+        if (TakeFlag(argv[i], "--min_time", &value))
+        {
+            options.min_time = std::stod(value);
+        }
+        else if (TakeFlag(argv[i], "--repetitions", &value))
+        {
+            options.repetitions = std::max(1, std::stoi(value));
+        }
+        else if (TakeFlag(argv[i], "--filter", &options.filter) ||
+                 TakeFlag(argv[i], "--json", &options.json))
+        {
+        }
+        else if (strcmp(argv[i], "--list") == 0)
+        {
+            options.list = true;
+        }
+        else
+        {
+            throw std::runtime_error(std::string("unknown option ") + argv[i] +
+                                     ", expected --min_time= --repetitions= --filter= --json= --list");
+        }
+    }
+    return options;
+}
+
+Suite::Suite(const Options& options) :
+    options_(options)
+{
+}
+
+void Suite::Add(std::string name, Body body)
+{
+    entries_.push_back(Entry{std::move(name), std::move(body)});
+}
+
+int Suite::Run()
+{
+    bool table = options_.json != "-";
+    if (table && !options_.list)
+    {
+        printf("%-40s %12s %10s %10s %10s %10s %10s %10s\n", "benchmark", "iterations", "ns/op", "min",
+               "max", "cycles", "instrs", "misses");
+    }
+    for (const Entry& entry : entries_)
+    {
+        if (entry.name.find(options_.filter) == std::string::npos)
+        {
+            continue;
+        }
+        if (options_.list)
+        {
+            printf("%s\n", entry.name.c_str());
+            continue;
+        }
+        results_.push_back(Measure(entry));
+        if (table)
+        {
+            PrintRow(stdout, results_.back());
+            fflush(stdout);
+        }
+    }
+    if (options_.list || options_.json.empty())
+    {
+        return 0;
+    }
+    FILE* out = options_.json == "-" ? stdout : fopen(options_.json.c_str(), "w");
+    if (!out)
+    {
+        fprintf(stderr, "cannot write %s: %s\n", options_.json.c_str(), strerror(errno));
+        return 1;
+    }
+    WriteJson(out);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}
+
+Result Suite::Measure(const Entry& entry)
+{
+    // grows n until one run takes min_time, the first runs warm up
+    int64_t n = 1;
+    while (n < kMaxIterations)
+    {
+        double seconds = Seconds(entry.body, n);
+        if (seconds >= options_.min_time)
+        {
+            break;
+        }
+        double scale = seconds > 0 ? options_.min_time * 1.2 / seconds : 100;
+        n = static_cast<int64_t>(static_cast<double>(n) * std::min(std::max(scale, 2.0), 100.0));
+    }
+    n = std::min(n, kMaxIterations);
+
+    Result result;
+    result.name = entry.name;
+    result.iterations = n;
+    result.repetitions = options_.repetitions;
+    result.has_counters = counters_.Available();
+    uint64_t counts[PerfCounters::kCounters] = {};
+    std::vector<double> ns;
+    for (int i = 0; i < options_.repetitions; ++i)
+    {
+        counters_.Start();
+        double seconds = Seconds(entry.body, n);
+        counters_.Stop(counts);
+        ns.push_back(seconds * 1e9 / static_cast<double>(n));
+    }
+    std::sort(ns.begin(), ns.end());
+    result.ns_median = ns[ns.size() / 2];
+    result.ns_min = ns.front();
+    result.ns_max = ns.back();
+    double ops = static_cast<double>(n) * options_.repetitions;
+    for (int i = 0; i < PerfCounters::kCounters; ++i)
+    {
+        result.counters[i] = static_cast<double>(counts[i]) / ops;
+    }
+    return result;
+}
+
+void Suite::PrintRow(FILE* out, const Result& result) const
+{
+    fprintf(out, "%-40s %12" PRId64 " %10.1f %10.1f %10.1f", result.name.c_str(), result.iterations,
+            result.ns_median, result.ns_min, result.ns_max);
+    for (int i = 0; i < PerfCounters::kCounters; ++i)
+    {
+        if (result.has_counters)
+        {
+            fprintf(out, " %10.1f", result.counters[i]);
+        }
+        else
+        {
+            fprintf(out, " %10s", "-");
+        }
+    }
+    fprintf(out, "\n");
+}
+
+void Suite::WriteJson(FILE* out) const
+{
+    char date[32];
+    time_t now = time(nullptr);
+    struct tm tm;
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&now, &tm));
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+
+    fprintf(out, "{\n  \"context\": {\n");
+    fprintf(out, "    \"date\": \"%s\",\n", date);
+    fprintf(out, "    \"host\": ");
+    WriteString(out, host);
+    fprintf(out, ",\n    \"cpus\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(out, "    \"revision\": ");
+    WriteString(out, ASUKA_BENCH_REVISION);
+    fprintf(out, ",\n    \"compiler\": ");
+    WriteString(out, __VERSION__);
+#ifdef __OPTIMIZE__
+    fprintf(out, ",\n    \"optimized\": true,\n");
+#else
+    fprintf(out, ",\n    \"optimized\": false,\n");
+#endif
+    fprintf(out, "    \"perf_counters\": %s,\n", counters_.Available() ? "true" : "false");
+    fprintf(out, "    \"min_time\": %g,\n    \"repetitions\": %d\n  },\n", options_.min_time,
+            options_.repetitions);
+    fprintf(out, "  \"benchmarks\": [");
+    for (size_t i = 0; i < results_.size(); ++i)
+    {
+        const Result& r = results_[i];
+        fprintf(out, "%s\n    {\"name\": ", i == 0 ? "" : ",");
+        WriteString(out, r.name);
+        fprintf(out, ", \"iterations\": %" PRId64 ", \"repetitions\": %d, "
+                     "\"ns_per_op\": %.3f, \"ns_per_op_min\": %.3f, \"ns_per_op_max\": %.3f",
+                r.iterations, r.repetitions, r.ns_median, r.ns_min, r.ns_max);
+        for (int c = 0; c < PerfCounters::kCounters; ++c)
+        {
+            if (r.has_counters)
+            {
+                fprintf(out, ", \"%s_per_op\": %.3f", PerfCounters::Name(c), r.counters[c]);
+            }
+            else
+            {
+                fprintf(out, ", \"%s_per_op\": null", PerfCounters::Name(c));
+            }
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+} // namespace bench
+
+} // namespace asuka
@@ -0,0 +1,162 @@
+//
+// Created by xi on 19-4-4.
+//
+
+#ifndef ASUKA_HARNESS_H
+#define ASUKA_HARNESS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace asuka
+{
+
+namespace bench
+{
+
+// Hardware counters of the calling thread through perf_event_open, user space
+// only. Not available when the kernel or the container refuses them
+// (perf_event_paranoid, seccomp, no PMU in the VM), the results then have
+// times only.
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        kCycles,
+        kInstructions,
+        kCacheMisses,
+        kCounters,
+    };
+
+    PerfCounters();
+
+    ~PerfCounters();
+
+    // non-copyable
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool Available() const
+    {
+        return fds_[kCycles] >= 0;
+    }
+
+    // resets and enables them
+    void Start();
+
+    // disables them, adds the counts to values[kCounters]
+    void Stop(uint64_t* values);
+
+    static const char* Name(int counter);
+
+private:
+    int fds_[kCounters];
+};
+
+// what one benchmark measured, per operation
+struct Result
+{
+    std::string name;
+
+    // operations per repetition
+    int64_t iterations;
+
+    int repetitions;
+
+    // over the repetitions
+    double ns_median;
+    double ns_min;
+    double ns_max;
+
+    bool has_counters;
+
+    // over all repetitions
+    double counters[PerfCounters::kCounters];
+};
+
+// Runs n operations, the time of the call divided by n is the time of one.
+// Setup done in it counts too, so keep it small against n.
+using Body = std::function<void (int64_t n)>;
+
+// A set of named benchmarks:
+//
+//     Suite suite(Suite::ParseOptions(argc, argv));
+//     suite.Add("futures/wait_ready", [](int64_t n) { ... });
+//     return suite.Run();
+//
+// Each one is calibrated until n operations take min_time, then run
+// repetitions times. The results go to stdout as a table, and to a JSON
+// file with the build and the machine for tracking them across commits.
+class Suite
+{
+public:
+    struct Options
+    {
+        Options() :
+            min_time(0.1),
+            repetitions(5),
+            list(false)
+        {}
+
+        // seconds per repetition
+        double min_time;
+
+        int repetitions;
+
+        // substring of the names to run, all if empty
+        std::string filter;
+
+        // JSON output, "-" is stdout instead of the table
+        std::string json;
+
+        bool list;
+    };
+
+    // --min_time=SECONDS --repetitions=N --filter=SUBSTRING --json=FILE --list,
+    // throws std::runtime_error on anything else
+    static Options ParseOptions(int argc, char* argv[]);
+
+    explicit Suite(const Options& options);
+
+    void Add(std::string name, Body body);
+
+    // 0 on success, as the exit code of main
+    int Run();
+
+    const std::vector<Result>& results() const
+    {
+        return results_;
+    }
+
+private:
+    struct Entry
+    {
+        std::string name;
+        Body body;
+    };
+
+    Result Measure(const Entry& entry);
+
+    void PrintRow(FILE* out, const Result& result) const;
+
+    void WriteJson(FILE* out) const;
+
+private:
+    Options options_;
+
+    PerfCounters counters_;
+
+    std::vector<Entry> entries_;
+
+    std::vector<Result> results_;
+};
+
+} // namespace bench
+
+} // namespace asuka
+
+#endif //ASUKA_HARNESS_H
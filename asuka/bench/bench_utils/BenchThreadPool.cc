@@ -0,0 +1,179 @@
+//
+// Created by xi on 19-3-30.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <asuka/utils/ThreadPoolScheduler.h>
+
+using namespace asuka;
+
+// ThreadPoolScheduler against one queue under a mutex and a condition
+// variable shared by all workers, at 1 to 64 threads:
+// 1. tasks submitted from outside, 2. tasks spawning tasks,
+// 3. latency from Schedule to the task starting on an idle pool
+
+using Clock = std::chrono::steady_clock;
+
+double Seconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+class MutexQueueScheduler : public Scheduler
+{
+public:
+    explicit MutexQueueScheduler(size_t threads) :
+        stopping_(false)
+    {
+        for (size_t i = 0; i < threads; ++i)
+        {
+            threads_.emplace_back([this] { Run(); });
+        }
+    }
+
+    ~MutexQueueScheduler() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cond_.notify_all();
+        for (auto& t : threads_)
+        {
+            t.join();
+        }
+    }
+
+    void Schedule(std::function<void ()> func) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(func));
+        }
+        cond_.notify_one();
+    }
+
+    void SchedulerLater(std::chrono::milliseconds, std::function<void ()>) override
+    {
+    }
+
+private:
+    void Run()
+    {
+        while (true)
+        {
+            std::function<void ()> func;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (stopping_)
+                {
+                    return;
+                }
+                func = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            func();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<std::function<void ()>> tasks_;
+    bool stopping_;
+    std::vector<std::thread> threads_;
+};
+
+void WaitFor(const std::atomic<long>& counter, long target)
+{
+    while (counter.load(std::memory_order_acquire) < target)
+    {
+        std::this_thread::yield();
+    }
+}
+
+double External(Scheduler* sched, long tasks)
+{
+    std::atomic<long> done(0);
+    auto start = Clock::now();
+    for (long i = 0; i < tasks; ++i)
+    {
+        sched->Schedule([&done] { done.fetch_add(1, std::memory_order_release); });
+    }
+    WaitFor(done, tasks);
+    return Seconds(start) * 1e9 / static_cast<double>(tasks);
+}
+
+void Spawn(Scheduler* sched, int depth, std::atomic<long>* done)
+{
+    done->fetch_add(1, std::memory_order_release);
+    if (depth == 0)
+    {
+        return;
+    }
+    sched->Schedule([sched, depth, done] { Spawn(sched, depth - 1, done); });
+    sched->Schedule([sched, depth, done] { Spawn(sched, depth - 1, done); });
+}
+
+double ForkJoin(Scheduler* sched, int depth)
+{
+    std::atomic<long> done(0);
+    long tasks = (1L << (depth + 1)) - 1;
+    auto start = Clock::now();
+    sched->Schedule([sched, depth, &done] { Spawn(sched, depth, &done); });
+    WaitFor(done, tasks);
+    return Seconds(start) * 1e9 / static_cast<double>(tasks);
+}
+
+// p50 and p99 in ns
+std::pair<double, double> WakeLatency(Scheduler* sched, int rounds)
+{
+    std::vector<double> latencies;
+    std::atomic<long> done(0);
+    for (int i = 0; i < rounds; ++i)
+    {
+        // let the workers go to sleep
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        auto start = Clock::now();
+        sched->Schedule([&latencies, &done, start] {
+            latencies.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+            done.fetch_add(1, std::memory_order_release);
+        });
+        WaitFor(done, i + 1);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return {latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100]};
+}
+
+template <typename Sched>
+void Bench(const char* name, size_t threads)
+{
+    Sched sched(threads);
+    double external = External(&sched, 200 * 1000);
+    double fork_join = ForkJoin(&sched, 16);
+    auto latency = WakeLatency(&sched, 2000);
+    printf("%-12s %2zu threads: external %7.1f ns/task, fork-join %7.1f ns/task, "
+           "wake-up p50 %7.0f ns p99 %7.0f ns\n",
+           name, threads, external, fork_join, latency.first, latency.second);
+}
+
+int main()
+{
+    for (size_t threads : {1, 2, 4, 8, 16, 32, 64})
+    {
+        Bench<ThreadPoolScheduler>("pool", threads);
+        Bench<MutexQueueScheduler>("mutex queue", threads);
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+//
+// Created by xi on 19-3-22.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <asuka/utils/EventLoopScheduler.h>
+#include <asuka/utils/TimerWheel.h>
+
+using namespace asuka;
+
+// 1M outstanding timers: TimerWheel against a multimap under a mutex,
+// then end to end through EventLoopScheduler
+
+using Clock = std::chrono::steady_clock;
+
+double Seconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void Report(const char* name, double sec, long n)
+{
+    printf("%-36s %8.1f ns per timer\n", name, sec * 1e9 / static_cast<double>(n));
+}
+
+// what a hand-written scheduler usually does
+class MapTimers
+{
+public:
+    using Id = std::multimap<uint64_t, std::function<void ()>>::iterator;
+
+    Id Add(uint64_t expire, std::function<void ()> func)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return timers_.emplace(expire, std::move(func));
+    }
+
+    void Cancel(Id id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        timers_.erase(id);
+    }
+
+    size_t Advance(uint64_t now)
+    {
+        size_t fired = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!timers_.empty() && timers_.begin()->first <= now)
+        {
+            std::function<void ()> func(std::move(timers_.begin()->second));
+            timers_.erase(timers_.begin());
+            lock.unlock();
+            func();
+            ++fired;
+            lock.lock();
+        }
+        return fired;
+    }
+
+private:
+    std::mutex mutex_;
+    std::multimap<uint64_t, std::function<void ()>> timers_;
+};
+
+template <typename Timers, typename Id>
+void BenchTimers(const char* name, const std::vector<uint64_t>& expires, uint64_t horizon)
+{
+    long n = static_cast<long>(expires.size());
+    long counter = 0;
+    char label[64];
+    {
+        Timers timers;
+        std::vector<Id> ids;
+        ids.reserve(expires.size());
+        auto start = Clock::now();
+        for (uint64_t expire : expires)
+        {
+            ids.push_back(timers.Add(expire, [&counter] { ++counter; }));
+        }
+        snprintf(label, sizeof(label), "%s insert", name);
+        Report(label, Seconds(start), n);
+
+        start = Clock::now();
+        for (auto& id : ids)
+        {
+            timers.Cancel(id);
+        }
+        snprintf(label, sizeof(label), "%s cancel", name);
+        Report(label, Seconds(start), n);
+    }
+    {
+        Timers timers;
+        for (uint64_t expire : expires)
+        {
+            timers.Add(expire, [&counter] { ++counter; });
+        }
+        auto start = Clock::now();
+        size_t fired = 0;
+        for (uint64_t tick = 0; tick <= horizon; ++tick)
+        {
+            fired += timers.Advance(tick);
+        }
+        snprintf(label, sizeof(label), "%s fire (%zu)", name, fired);
+        Report(label, Seconds(start), n);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const long kTimers = argc > 1 ? atol(argv[1]) : 1000 * 1000;
+    // like request timeouts: 1 ms to 30 s
+    const uint64_t kHorizon = 30 * 1000;
+
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> expires;
+    for (long i = 0; i < kTimers; ++i)
+    {
+        expires.push_back(1 + rng() % kHorizon);
+    }
+
+    printf("%ld timers, 1 ms ticks over %.0f s\n", kTimers, static_cast<double>(kHorizon) / 1000);
+    BenchTimers<TimerWheel, TimerId>("TimerWheel", expires, kHorizon);
+    BenchTimers<MapTimers, MapTimers::Id>("multimap + mutex", expires, kHorizon);
+
+    // end to end: timers of 0.5 to 1.5 s armed from the loop, so none is due while
+    // the loop is still busy arming, lateness against when each is armed
+    EventLoopScheduler sched;
+    std::thread loop([&sched] { sched.Loop(); });
+    std::atomic<long> fired(0);
+    std::vector<int64_t> lateness(static_cast<size_t>(kTimers));
+    Clock::time_point start;
+    sched.Schedule([&] {
+        start = Clock::now();
+        for (long i = 0; i < kTimers; ++i)
+        {
+            long delay = 500 + static_cast<long>(expires[static_cast<size_t>(i)] % 1000);
+            Clock::time_point armed = Clock::now();
+            sched.SchedulerLater(std::chrono::milliseconds(delay), [&, i, delay, armed] {
+                auto late = Clock::now() - armed - std::chrono::milliseconds(delay);
+                lateness[static_cast<size_t>(i)] = std::chrono::duration_cast<std::chrono::microseconds>(late).count();
+                ++fired;
+            });
+        }
+        Report("EventLoopScheduler SchedulerLater", Seconds(start), kTimers);
+    });
+    while (fired < kTimers)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    sched.Stop();
+    loop.join();
+    int64_t max_late = 0;
+    double sum_late = 0;
+    for (int64_t late : lateness)
+    {
+        max_late = std::max(max_late, late);
+        sum_late += static_cast<double>(late);
+    }
+    printf("EventLoopScheduler lateness: mean %.0f us, max %ld us\n",
+           sum_late / static_cast<double>(kTimers), static_cast<long>(max_late));
+    return 0;
+}
@@ -0,0 +1,210 @@
+//
+// Created by xi on 19-3-2.
+//
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <asuka/utils/Types.h>
+#include <asuka/coroutine/Context.h>
+
+#ifdef ASUKA_CONTEXT_ASM
+
+extern "C"
+{
+// first frame of every context: call entry(arg) which are saved in callee-saved registers
+void asuka_context_trampoline();
+}
+
+#if defined(__x86_64__)
+
+// System V AMD64: rbx, rbp, r12 - r15 are callee-saved,
+// also keep MXCSR and x87 control word as the ABI requires.
+asm(R"(
+    .text
+    .globl asuka_jump_context
+    .type asuka_jump_context, @function
+    .align 16
+asuka_jump_context:
+    pushq %rbp
+    pushq %rbx
+    pushq %r15
+    pushq %r14
+    pushq %r13
+    pushq %r12
+    leaq -8(%rsp), %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    leaq 8(%rsp), %rsp
+    popq %r12
+    popq %r13
+    popq %r14
+    popq %r15
+    popq %rbx
+    popq %rbp
+    ret
+    .size asuka_jump_context, .-asuka_jump_context
+
+    .globl asuka_context_trampoline
+    .type asuka_context_trampoline, @function
+    .align 16
+asuka_context_trampoline:
+    .cfi_startproc
+    .cfi_undefined rip
+    movq %r12, %rdi
+    callq *%r13
+    ud2
+    .cfi_endproc
+    .size asuka_context_trampoline, .-asuka_context_trampoline
+
+    .section .note.GNU-stack, "", %progbits
+    .text
+)");
+
+#elif defined(__aarch64__)
+
+// AAPCS64: x19 - x28, fp, lr and d8 - d15 are callee-saved
+asm(R"(
+    .text
+    .globl asuka_jump_context
+    .type asuka_jump_context, %function
+    .align 4
+asuka_jump_context:
+    sub sp, sp, #0xa0
+    stp d8, d9, [sp, #0x00]
+    stp d10, d11, [sp, #0x10]
+    stp d12, d13, [sp, #0x20]
+    stp d14, d15, [sp, #0x30]
+    stp x19, x20, [sp, #0x40]
+    stp x21, x22, [sp, #0x50]
+    stp x23, x24, [sp, #0x60]
+    stp x25, x26, [sp, #0x70]
+    stp x27, x28, [sp, #0x80]
+    stp x29, x30, [sp, #0x90]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp d8, d9, [sp, #0x00]
+    ldp d10, d11, [sp, #0x10]
+    ldp d12, d13, [sp, #0x20]
+    ldp d14, d15, [sp, #0x30]
+    ldp x19, x20, [sp, #0x40]
+    ldp x21, x22, [sp, #0x50]
+    ldp x23, x24, [sp, #0x60]
+    ldp x25, x26, [sp, #0x70]
+    ldp x27, x28, [sp, #0x80]
+    ldp x29, x30, [sp, #0x90]
+    add sp, sp, #0xa0
+    ret
+    .size asuka_jump_context, .-asuka_jump_context
+
+    .globl asuka_context_trampoline
+    .type asuka_context_trampoline, %function
+    .align 4
+asuka_context_trampoline:
+    .cfi_startproc
+    .cfi_undefined x30
+    mov x0, x19
+    blr x20
+    brk #0
+    .cfi_endproc
+    .size asuka_context_trampoline, .-asuka_context_trampoline
+
+    .section .note.GNU-stack, "", %progbits
+    .text
+)");
+
+#endif
+
+#endif // ASUKA_CONTEXT_ASM
+
+namespace asuka
+{
+
+namespace detail
+{
+
+#ifdef ASUKA_CONTEXT_ASM
+
+void Context::Make(char* stack, size_t stack_size, EntryFunc entry, void* arg)
+{
+    assert(stack != nullptr);
+    uintptr_t top = reinterpret_cast<uintptr_t>(stack + stack_size) & ~static_cast<uintptr_t>(15);
+#if defined(__x86_64__)
+    // layout matches the pops of asuka_jump_context:
+    // [fpu control words] r12 r13 r14 r15 rbx rbp [return address]
+    // return address sits at 8 mod 16, so the trampoline calls entry with an aligned stack
+    const size_t kFrameSize = 80;
+    void** frame = reinterpret_cast<void**>(top - kFrameSize);
+    memset(frame, 0, kFrameSize);
+    uint32_t mxcsr = 0x1F80; // default: all exceptions masked, round to nearest
+    uint16_t fpucw = 0x037F;
+    memcpy(frame, &mxcsr, sizeof(mxcsr));
+    memcpy(reinterpret_cast<char*>(frame) + 4, &fpucw, sizeof(fpucw));
+    frame[1] = arg;                                                 // r12
+    frame[2] = reinterpret_cast<void*>(entry);                      // r13
+    frame[7] = reinterpret_cast<void*>(&asuka_context_trampoline);  // return address
+#elif defined(__aarch64__)
+    // layout matches the loads of asuka_jump_context:
+    // d8 - d15, x19 - x28, x29 (fp), x30 (lr)
+    const size_t kFrameSize = 0xa0;
+    void** frame = reinterpret_cast<void**>(top - kFrameSize);
+    memset(frame, 0, kFrameSize);
+    frame[8] = arg;                                                 // x19
+    frame[9] = reinterpret_cast<void*>(entry);                      // x20
+    frame[19] = reinterpret_cast<void*>(&asuka_context_trampoline); // x30
+#endif
+    sp_ = frame;
+}
+
+void* Context::StackPointer() const
+{
+    return sp_;
+}
+
+#else
+
+void Context::Make(char* stack, size_t stack_size, EntryFunc entry, void* arg)
+{
+    int ret = ::getcontext(&uctx_);
+    // FIXME: check ret
+    assert(ret == 0);
+    UnusedVariable(ret);
+    uctx_.uc_stack.ss_sp = stack;
+    uctx_.uc_stack.ss_size = stack_size;
+    uctx_.uc_link = nullptr;
+    ::makecontext(&uctx_, reinterpret_cast<void(*)()>(entry), 1, arg);
+}
+
+void* Context::StackPointer() const
+{
+#if defined(__x86_64__)
+    return reinterpret_cast<void*>(uctx_.uc_mcontext.gregs[REG_RSP]);
+#elif defined(__aarch64__)
+    return reinterpret_cast<void*>(uctx_.uc_mcontext.sp);
+#else
+    return nullptr;
+#endif
+}
+
+void Context::SwapContext(Context& to)
+{
+    int ret = ::swapcontext(&uctx_, &to.uctx_);
+    if (ret != 0)
+    {
+        perror("FATAL ERROR: ::swapcontext");
+        throw std::runtime_error("FATAL ERROR: swapcontext failed");
+    }
+}
+
+#endif // ASUKA_CONTEXT_ASM
+
+} // namespace detail
+
+} // namespace asuka
@@ -0,0 +1,87 @@
+//
+// Created by xi on 19-3-2.
+//
+
+#ifndef ASUKA_CONTEXT_H
+#define ASUKA_CONTEXT_H
+
+#include <stddef.h>
+
+// Context switch backend is chosen at build time:
+// hand-written assembly on x86-64 and aarch64, ucontext everywhere else
+// or when ASUKA_USE_UCONTEXT is defined.
+#if !defined(ASUKA_USE_UCONTEXT) && (defined(__x86_64__) || defined(__aarch64__))
+#define ASUKA_CONTEXT_ASM 1
+#else
+#include <ucontext.h> // NOTE: Linux only
+#endif
+
+#ifdef ASUKA_CONTEXT_ASM
+extern "C"
+{
+// push callee-saved registers, store sp to *from_sp, switch to to_sp, pop and return
+void asuka_jump_context(void** from_sp, void* to_sp);
+}
+#endif
+
+namespace asuka
+{
+
+namespace detail
+{
+
+// Execution context of a coroutine, only callee-saved registers
+// are saved when switching, signal mask is NOT saved.
+class Context
+{
+public:
+    using EntryFunc = void (*)(void*);
+
+    Context() = default;
+
+    // non copyable
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+
+    // prepare a context which calls entry(arg) on the given stack when first switched to,
+    // entry shall never return
+    void Make(char* stack, size_t stack_size, EntryFunc entry, void* arg);
+
+    // save current execution context to this, and resume to
+    void SwitchTo(Context& to)
+    {
+#ifdef ASUKA_CONTEXT_ASM
+        ::asuka_jump_context(&sp_, to.sp_);
+#else
+        SwapContext(to);
+#endif
+    }
+
+    // stack pointer saved by the last switch out of this context,
+    // nullptr if unknown on this platform
+    void* StackPointer() const;
+
+    static const char* Backend()
+    {
+#ifdef ASUKA_CONTEXT_ASM
+        return "asm";
+#else
+        return "ucontext";
+#endif
+    }
+
+private:
+#ifdef ASUKA_CONTEXT_ASM
+    void* sp_ = nullptr;
+#else
+    void SwapContext(Context& to);
+
+    ucontext_t uctx_;
+#endif
+};
+
+} // namespace detail
+
+} // namespace asuka
+
+#endif //ASUKA_CONTEXT_H
@@ -3,41 +3,134 @@
 //
 
 #include <assert.h>
+#include <string.h>
 #include <string>
+#include <atomic>
 #include <stdexcept>
 #include <asuka/utils/Types.h>
 #include <asuka/coroutine/Coroutine.h>
+#include <asuka/coroutine/Runtime.h>
 
 namespace asuka
 {
 
+namespace
+{
+
+const unsigned int kIdBlockSize = 1024;
+
+std::atomic<unsigned int> g_next_id_block(0);
+
+std::atomic<size_t> g_next_local_index(0);
+
+thread_local unsigned int t_next_id = 0;
+thread_local unsigned int t_id_limit = 0;
+
+} // namespace
+
 const size_t Coroutine::kDefaultStackSize = 8 * 1024; // 8 KB
-Coroutine Coroutine::main_;
-Coroutine* Coroutine::current_ = nullptr;
-unsigned int Coroutine::s_id_ = 0;
+const size_t SharedStack::kDefaultSharedStackSize = 128 * 1024; // 128 KB
+thread_local Coroutine Coroutine::main_{Coroutine::MainTag()};
+
+unsigned int Coroutine::NextId()
+{
+    if (t_next_id == t_id_limit)
+    {
+        // wraps around at a multiple of kIdBlockSize
+        t_next_id = g_next_id_block.fetch_add(kIdBlockSize, std::memory_order_relaxed);
+        t_id_limit = t_next_id + kIdBlockSize;
+    }
+    unsigned int id = t_next_id++;
+    if (id == 0)
+    {
+        id = t_next_id++; // 0 is main
+    }
+    return id;
+}
+
+SharedStack::SharedStack(size_t stack_size) :
+    allocator_(StackAllocator::Default()),
+    stack_(allocator_->Allocate(stack_size)),
+    owner_(nullptr)
+{}
+
+SharedStack::~SharedStack()
+{
+    // every coroutine on it holds a SharedStackPtr, so no owner now
+    assert(owner_ == nullptr);
+    allocator_->Deallocate(stack_);
+}
+
+Coroutine::Coroutine(MainTag) :
+    id_(0),
+    state_(State::kRunning),
+    caller_(nullptr),
+    from_(nullptr),
+    run_state_(0),
+    allocator_(nullptr),
+    save_capacity_(0),
+    saved_size_(0),
+    max_saved_size_(0)
+{}
 
 Coroutine::Coroutine(size_t stack_size) :
-    id_(++s_id_),
+    id_(NextId()),
+    state_(State::kNotInit),
+    caller_(nullptr),
+    from_(nullptr),
+    run_state_(0),
+    allocator_(nullptr),
+    save_capacity_(0),
+    saved_size_(0),
+    max_saved_size_(0)
+{
+    allocator_ = StackAllocator::Default();
+    stack_ = allocator_->Allocate(std::max(stack_size, kDefaultStackSize));
+#ifdef ASUKA_COROUTINE_STATS
+    detail::CoroutineRegistry::Paint(stack_.base, stack_.size);
+#endif
+    context_.Make(stack_.base, stack_.size, &Coroutine::Run, this);
+#ifdef ASUKA_COROUTINE_STATS
+    detail::CoroutineRegistry::Add(this);
+#endif
+}
+
+Coroutine::Coroutine(const SharedStackPtr& shared_stack) :
+    id_(NextId()),
     state_(State::kNotInit),
-    stack_(std::max(stack_size, kDefaultStackSize))
+    caller_(nullptr),
+    from_(nullptr),
+    run_state_(0),
+    allocator_(nullptr),
+    shared_stack_(shared_stack),
+    save_capacity_(0),
+    saved_size_(0),
+    max_saved_size_(0)
 {
-    if (this == &main_)
+    assert(shared_stack_);
+    // context is made when it first owns the shared stack
+#ifdef ASUKA_COROUTINE_STATS
+    detail::CoroutineRegistry::Add(this);
+#endif
+}
+
+Coroutine::~Coroutine()
+{
+    DestroyLocals();
+#ifdef ASUKA_COROUTINE_STATS
+    if (id_ != 0)
     {
-        std::vector<char>().swap(stack_);
-        return;
+        detail::CoroutineRegistry::Remove(this);
     }
-    if (id_ == main_.id_)
+#endif
+    if (allocator_)
     {
-        id_ = ++s_id_; // when s_id_ overflow
+        allocator_->Deallocate(stack_);
+    }
+    if (shared_stack_ && shared_stack_->owner_ == this)
+    {
+        shared_stack_->owner_ = nullptr;
     }
-    int ret = ::getcontext(&uctx_);
-    // FIXME: check ret
-    assert(ret == 0);
-    UnusedVariable(ret);
-    uctx_.uc_stack.ss_sp = stack_.data();
-    uctx_.uc_stack.ss_size = stack_.size();
-    uctx_.uc_link = nullptr;
-    ::makecontext(&uctx_, reinterpret_cast<void(*)()>(&Coroutine::Run), 1, this);
 }
 
 VoidPtr Coroutine::Send(const CoroutinePtr& co, VoidPtr args)
@@ -50,7 +143,18 @@ VoidPtr Coroutine::Send(const CoroutinePtr& co, VoidPtr args)
     {
         Coroutine::current_ = &Coroutine::main_;
     }
-    return Coroutine::current_->SendImpl(get_pointer(co), std::move(args));
+    // like Python generator, Yield returns to whom sends
+    Coroutine* caller = co->caller_;
+    co->caller_ = Coroutine::current_;
+    try
+    {
+        return Coroutine::current_->SendImpl(get_pointer(co), std::move(args));
+    }
+    catch (...)
+    {
+        co->caller_ = caller;
+        throw;
+    }
 }
 
 VoidPtr Coroutine::Yield(const VoidPtr& args)
@@ -63,12 +167,73 @@ VoidPtr Coroutine::Next(const CoroutinePtr& co)
     return Send(co);
 }
 
-VoidPtr Coroutine::SendImpl(Coroutine* co_ptr, VoidPtr args)
+Coroutine::Awaiter::Awaiter(CoroutinePtr&& coroutine, Scheduler* scheduler) :
+    co(std::move(coroutine)),
+    runtime(Runtime::Current()),
+    sched(scheduler),
+    arrived(false),
+    resumed(false)
+{
+}
+
+void Coroutine::Awaiter::Suspend()
+{
+    if (arrived.exchange(true, std::memory_order_acq_rel))
+    {
+        // the value came while attaching the callback
+        return;
+    }
+    // loop: someone else may Send to us or Ready us meanwhile
+    while (!resumed.load(std::memory_order_acquire))
+    {
+        if (runtime)
+        {
+            Runtime::Park();
+        }
+        else
+        {
+            Coroutine::Yield();
+        }
+    }
+}
+
+void Coroutine::Awaiter::Resume()
+{
+    if (!arrived.exchange(true, std::memory_order_acq_rel))
+    {
+        // the coroutine has not suspended and will not
+        return;
+    }
+    // take what we need first, the coroutine returns as soon as it sees resumed
+    CoroutinePtr coroutine(std::move(co));
+    Runtime* rt = runtime;
+    Scheduler* scheduler = sched;
+    resumed.store(true, std::memory_order_release);
+    if (rt)
+    {
+        rt->Ready(coroutine);
+    }
+    else if (scheduler)
+    {
+        scheduler->Schedule([coroutine] { Coroutine::Send(coroutine); });
+    }
+    else
+    {
+        Coroutine::Send(coroutine);
+    }
+}
+
+VoidPtr Coroutine::SendImpl(Coroutine* co_ptr, VoidPtr args, bool yield)
 {
     assert(co_ptr);
     assert(this == current_);
     assert(this != co_ptr);
-    current_ = co_ptr;
+    // checked before any state is written, a rejected Send leaves none
+    if (co_ptr->shared_stack_ && co_ptr->shared_stack_ == shared_stack_)
+    {
+        // we are running on the stack to be overwritten
+        throw std::runtime_error("Can't send to a coroutine on the same shared stack");
+    }
     if (args)
     {
         // behave like Python generator
@@ -79,29 +244,180 @@ VoidPtr Coroutine::SendImpl(Coroutine* co_ptr, VoidPtr args)
         // set old coroutine's yield value
         this->yield_value_ = std::move(args);
     }
-    int ret = ::swapcontext(&uctx_, &co_ptr->uctx_);
-    if (ret != 0)
+    if (co_ptr->shared_stack_)
     {
-        perror("FATAL ERROR: ::swapcontext");
-        throw std::runtime_error("FATAL ERROR: swapcontext failed");
+        SwitchSharedStack(co_ptr);
     }
-    return co_ptr->yield_value_;
+#ifdef ASUKA_COROUTINE_STATS
+    Account(co_ptr, yield);
+#endif
+    current_ = co_ptr;
+    co_ptr->from_ = this;
+    context_.SwitchTo(co_ptr->context_);
+    // NOTE: may be resumed on another thread, do not touch thread local data below
+    return from_->yield_value_;
 }
 
 VoidPtr Coroutine::YieldImpl(VoidPtr args)
 {
-    return SendImpl(&main_, std::move(args));
+    return SendImpl(caller_ ? caller_ : &main_, std::move(args), true);
+}
+
+size_t Coroutine::NextLocalIndex()
+{
+    return g_next_local_index.fetch_add(1, std::memory_order_relaxed);
+}
+
+Coroutine::LocalSlot& Coroutine::MoreLocal(size_t index)
+{
+    size_t i = index - kInlineLocals;
+    if (i >= more_locals_.size())
+    {
+        more_locals_.resize(i + 1);
+    }
+    return more_locals_[i];
+}
+
+void Coroutine::DestroyLocals()
+{
+    bool destroyed = true;
+    while (destroyed)
+    {
+        destroyed = false;
+        auto destroy = [&destroyed](LocalSlot& slot) {
+            if (slot.value)
+            {
+                void* value = slot.value;
+                void (*destroy_value)(void*) = slot.destroy;
+                slot.value = nullptr;
+                destroy_value(value);
+                destroyed = true;
+            }
+        };
+        for (auto& slot : locals_)
+        {
+            destroy(slot);
+        }
+        // by index, a destructor may grow it
+        for (size_t i = 0; i < more_locals_.size(); ++i)
+        {
+            destroy(more_locals_[i]);
+        }
+    }
+}
+
+CoroutineStats Coroutine::stats() const
+{
+    CoroutineStats stats;
+    stats.id = id_;
+    stats.stack_size = shared_stack_ ? shared_stack_->stack_.size : stack_.size;
+#ifdef ASUKA_COROUTINE_STATS
+    stats.sends = counters_.sends.load(std::memory_order_relaxed);
+    stats.yields = counters_.yields.load(std::memory_order_relaxed);
+    uint64_t ticks = counters_.run_ticks.load(std::memory_order_relaxed);
+    if (current_ == this)
+    {
+        // asked by itself, count the time since it was switched to
+        ticks += detail::StatsNow() - counters_.resumed_at;
+    }
+    stats.run_ns = static_cast<uint64_t>(static_cast<double>(ticks) * detail::NanosPerTick());
+    stats.stack_high_water = shared_stack_ ? max_saved_size_
+                                           : detail::CoroutineRegistry::Used(stack_.base, stack_.size);
+#endif
+    return stats;
+}
+
+#ifdef ASUKA_COROUTINE_STATS
+
+void Coroutine::Account(Coroutine* co_ptr, bool yield)
+{
+    using Counters = detail::CoroutineCounters;
+    uint64_t now = detail::StatsNow();
+    if (id_ != 0)
+    {
+        Counters::Bump(counters_.run_ticks, now - counters_.resumed_at);
+        if (yield && state_ != State::kFinished)
+        {
+            Counters::Bump(counters_.yields, 1);
+        }
+    }
+    if (co_ptr->id_ != 0)
+    {
+        co_ptr->counters_.resumed_at = now;
+        if (!yield)
+        {
+            Counters::Bump(co_ptr->counters_.sends, 1);
+        }
+    }
+}
+
+#endif
+
+void Coroutine::SwitchSharedStack(Coroutine* co_ptr)
+{
+    SharedStack* shared_stack = get_pointer(co_ptr->shared_stack_);
+    Coroutine* owner = shared_stack->owner_;
+    if (owner == co_ptr)
+    {
+        return;
+    }
+    assert(shared_stack_.get() != shared_stack);
+    if (owner && owner->state_ != State::kFinished)
+    {
+        owner->SaveStack();
+    }
+    if (co_ptr->state_ == State::kNotInit)
+    {
+        co_ptr->context_.Make(shared_stack->stack_.base, shared_stack->stack_.size, &Coroutine::Run, co_ptr);
+    }
+    else
+    {
+        co_ptr->RestoreStack();
+    }
+    shared_stack->owner_ = co_ptr;
+}
+
+void Coroutine::SaveStack()
+{
+    const Stack& stack = shared_stack_->stack_;
+    char* sp = static_cast<char*>(context_.StackPointer());
+    if (sp == nullptr)
+    {
+        throw std::runtime_error("Shared stack is not supported on this platform");
+    }
+    char* top = stack.base + stack.size;
+    assert(stack.base <= sp && sp <= top);
+    size_t size = static_cast<size_t>(top - sp);
+    // right-sized: grow on demand, shrink when far too large
+    if (size > save_capacity_ || size < save_capacity_ / 4)
+    {
+        save_buffer_.reset(new char[size]);
+        save_capacity_ = size;
+    }
+    memcpy(save_buffer_.get(), sp, size);
+    saved_size_ = size;
+    max_saved_size_ = std::max(max_saved_size_, size);
+}
+
+void Coroutine::RestoreStack()
+{
+    const Stack& stack = shared_stack_->stack_;
+    memcpy(stack.base + stack.size - saved_size_, save_buffer_.get(), saved_size_);
 }
 
-void Coroutine::Run(Coroutine* co_ptr)
+void Coroutine::Run(void* arg)
 {
+    Coroutine* co_ptr = static_cast<Coroutine*>(arg);
     assert(&Coroutine::main_ != co_ptr);
     assert(Coroutine::current_ == co_ptr);
     co_ptr->state_ = State::kRunning;
     if (co_ptr->func_)
     {
         co_ptr->func_();
+        // release what func_ holds now, the Coroutine object may live much longer
+        co_ptr->func_.Reset();
     }
+    co_ptr->DestroyLocals();
     co_ptr->state_ = State::kFinished;
     co_ptr->Yield(co_ptr->result_);
 }
@@ -5,13 +5,21 @@
 #ifndef ASUKA_COROUTINE_H
 #define ASUKA_COROUTINE_H
 
-#include <ucontext.h> // NOTE: Linux only
-
 #include <vector>
 #include <map>
+#include <atomic>
 #include <memory>
+#include <tuple>
+#include <optional>
 #include <functional>
 
+#include <asuka/utils/InlineFunction.h>
+#include <asuka/utils/PoolAllocator.h>
+#include <asuka/futures/Future.h>
+#include <asuka/coroutine/Context.h>
+#include <asuka/coroutine/CoroutineStats.h>
+#include <asuka/coroutine/StackAllocator.h>
+
 // a Python like Coroutine class
 
 namespace asuka
@@ -22,7 +30,38 @@ using VoidPtr = std::shared_ptr<void>;
 class Coroutine;
 using CoroutinePtr = std::shared_ptr<Coroutine>;
 
-class Coroutine
+class Runtime;
+
+template <typename T>
+class CoroutineLocal;
+
+// One large run stack shared by a group of coroutines of the same thread,
+// only the coroutine owning it has its frames on it.
+class SharedStack
+{
+public:
+    explicit SharedStack(size_t stack_size = kDefaultSharedStackSize);
+    ~SharedStack();
+
+    // non copyable
+    SharedStack(const SharedStack&) = delete;
+    SharedStack& operator=(const SharedStack&) = delete;
+
+    static const size_t kDefaultSharedStackSize;
+
+private:
+    friend class Coroutine;
+
+    StackAllocator* allocator_;
+
+    Stack stack_;
+
+    Coroutine* owner_;
+};
+
+using SharedStackPtr = std::shared_ptr<SharedStack>;
+
+class Coroutine : public std::enable_shared_from_this<Coroutine>
 {
 public:
 
@@ -34,10 +73,23 @@ public:
     };
 
     // works like python decorator: warp the func_ to a Coroutine
+    // the Coroutine and its control block come from a per-thread pool of
+    // recycled blocks and its stack from the stack cache, a small func_ is stored
+    // in place, so creating a short-lived Coroutine allocates nothing when warm
     template <typename F, typename... Args>
     static CoroutinePtr CreateCoroutine(F&& f, Args&&... args)
     {
-        return std::make_shared<Coroutine>(std::forward<F>(f), std::forward<Args>(args)...);
+        return std::allocate_shared<Coroutine>(PoolAllocator<Coroutine>(),
+                                               std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    // the Coroutine runs on shared_stack, its live stack is copied out when
+    // another coroutine of the same SharedStack runs, and copied back on Send
+    template <typename F, typename... Args>
+    static CoroutinePtr CreateCoroutineOnSharedStack(const SharedStackPtr& shared_stack, F&& f, Args&&... args)
+    {
+        return std::allocate_shared<Coroutine>(PoolAllocator<Coroutine>(),
+                                               shared_stack, std::forward<F>(f), std::forward<Args>(args)...);
     }
 
     // schedule coroutine
@@ -47,45 +99,107 @@ public:
     static VoidPtr Yield(const VoidPtr& args = VoidPtr(nullptr));
     static VoidPtr Next(const CoroutinePtr& co);
 
+    // Result of future, the calling coroutine gives up the thread until it is ready
+    // instead of blocking it, other coroutines keep running meanwhile:
+    // a coroutine run by Runtime parks and is made ready again,
+    // any other one Yields an empty value and is Sent back by the thread completing
+    // the future, or by a task of sched if given, Yield returns to it afterwards.
+    // Outside of any coroutine it is future.Wait().
+    // NOTE: without Runtime the coroutine shall be resumed in the thread driving it:
+    // complete the future there or pass a sched running there.
+    // A future which times out never resumes the coroutine.
+    template <typename T>
+    static typename Future<T>::ValueType Await(Future<T> future, Scheduler* sched = nullptr)
+    {
+        if (future.IsReady())
+        {
+            return future.Wait();
+        }
+        CoroutinePtr co(Current());
+        if (!co)
+        {
+            return future.Wait();
+        }
+        // a frame on a SharedStack is copied out while suspended, the callback
+        // can not write to it
+        std::optional<AwaitState<T>> on_stack;
+        std::unique_ptr<AwaitState<T>> on_heap;
+        AwaitState<T>* state;
+        if (co->shared_stack_)
+        {
+            on_heap = std::make_unique<AwaitState<T>>(std::move(co), sched);
+            state = on_heap.get();
+        }
+        else
+        {
+            state = &on_stack.emplace(std::move(co), sched);
+        }
+        detail::AttachCallback(future, [state](typename Future<T>::ValueType&& t) {
+            state->value = std::move(t);
+            state->Resume();
+        });
+        state->Suspend();
+        return std::move(state->value);
+    }
+
     // NOTE: user shall use CreateCoroutine, not constructor
     // the Constructor should be private
     // but Compiler does NOT allow private template constructor
 
     explicit Coroutine(size_t stack_size = 0);
 
-    // if F return void
+    explicit Coroutine(const SharedStackPtr& shared_stack);
+
     template <typename F, typename... Args,
-              typename = typename std::enable_if_t<std::is_void_v<std::result_of_t<F(Args...)>>, void>,
-              typename Dummy = void>
+              typename = std::result_of_t<F(Args...)>>
     Coroutine(F&& f, Args&&... args) : Coroutine(kDefaultStackSize)
     {
-        func_ = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+        SetFunc(std::forward<F>(f), std::forward<Args>(args)...);
     }
 
-    // if F return non-void
-    template <typename F, typename... Args,
-              typename = typename std::enable_if_t<!std::is_void_v<std::result_of_t<F(Args...)>>, void>>
-    Coroutine(F&& f, Args&&... args) : Coroutine(kDefaultStackSize)
+    template <typename F, typename... Args>
+    Coroutine(const SharedStackPtr& shared_stack, F&& f, Args&&... args) : Coroutine(shared_stack)
     {
-        using ResultType = std::result_of_t<F(Args...)>;
-        auto temp = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-        func_ = [temp, this] () mutable {
-            this->result_ = std::make_shared<ResultType>(temp());
-        };
+        SetFunc(std::forward<F>(f), std::forward<Args>(args)...);
     }
 
-    ~Coroutine() = default;
+    ~Coroutine();
 
     unsigned int id() const
     {
         return id_;
     }
 
+    State state() const
+    {
+        return state_;
+    }
+
     static unsigned int GetCurrentId()
     {
         return current_->id_;
     }
 
+    // the running coroutine, empty in main coroutine
+    static CoroutinePtr Current()
+    {
+        return current_ ? current_->weak_from_this().lock() : CoroutinePtr();
+    }
+
+    // bytes of live stack copied out at the last switch, 0 if not on a SharedStack
+    size_t saved_size() const
+    {
+        return saved_size_;
+    }
+
+    size_t max_saved_size() const
+    {
+        return max_saved_size_;
+    }
+
+    // counted with ASUKA_COROUTINE_STATS only, see CoroutineStats
+    CoroutineStats stats() const;
+
     // non copyable
     Coroutine(const Coroutine&) = delete;
     Coroutine& operator=(const Coroutine&) = delete;
@@ -94,31 +208,175 @@ public:
     Coroutine& operator=(Coroutine&&) = delete;
 
 private:
-    VoidPtr SendImpl(Coroutine* co_ptr, VoidPtr args = VoidPtr(nullptr)); // pass by value and move
+    friend class Runtime;
+    friend class detail::CoroutineRegistry;
+
+    template <typename T>
+    friend class CoroutineLocal;
+
+    struct MainTag {};
+
+    // with the value, on the stack of a coroutine in Await, the callback of the future and
+    // the coroutine both arrive, the second one decides whether to suspend
+    struct Awaiter
+    {
+        Awaiter(CoroutinePtr&& co, Scheduler* sched);
+
+        // in the coroutine, after the callback is attached
+        void Suspend();
+
+        // in the callback, after the value is stored,
+        // NOTE: the awaiter may be gone once it returns
+        void Resume();
+
+        CoroutinePtr co;
+        Runtime* runtime;
+        Scheduler* sched;
+        std::atomic<bool> arrived;
+        std::atomic<bool> resumed;
+    };
+
+    template <typename T>
+    struct AwaitState : Awaiter
+    {
+        using Awaiter::Awaiter;
+
+        typename Future<T>::ValueType value;
+    };
+
+    // main coroutine of a thread, runs on the thread's own stack
+    explicit Coroutine(MainTag);
+
+    // the value of a CoroutineLocal in a coroutine, made at its first use
+    struct LocalSlot
+    {
+        void* value = nullptr;
+        void (*destroy)(void*) = nullptr;
+    };
+
+    // the first keys have their slots in the Coroutine itself
+    static constexpr size_t kInlineLocals = 4;
+
+    // keys are never given back, like thread_local variables they are
+    // meant to last
+    static size_t NextLocalIndex();
+
+    // of the running coroutine, of the thread's main coroutine outside of any
+    static LocalSlot& CurrentLocal(size_t index)
+    {
+        Coroutine* co = current_;
+        if (!co)
+        {
+            co = &main_;
+        }
+        if (index < kInlineLocals)
+        {
+            return co->locals_[index];
+        }
+        return co->MoreLocal(index);
+    }
+
+    LocalSlot& MoreLocal(size_t index);
+
+    // also the values made by the destructors of others
+    void DestroyLocals();
+
+    template <typename F, typename... Args>
+    void SetFunc(F&& f, Args&&... args)
+    {
+        // like std::bind: f and args are decay-copied, args are passed as lvalues
+        auto call = [f = std::forward<F>(f), args = std::make_tuple(std::forward<Args>(args)...)] () mutable {
+            return std::apply(f, args);
+        };
+        using ResultType = decltype(call());
+        if constexpr (std::is_void_v<ResultType>)
+        {
+            func_.Emplace(std::move(call));
+        }
+        else
+        {
+            func_.Emplace([call = std::move(call), this] () mutable {
+                this->result_ = std::make_shared<ResultType>(call());
+            });
+        }
+    }
+
+    // ids are handed out in blocks to each thread, 0 is never returned
+    static unsigned int NextId();
+
+    // pass by value and move, yield: co_ptr is the one we return to
+    VoidPtr SendImpl(Coroutine* co_ptr, VoidPtr args = VoidPtr(nullptr), bool yield = false);
 
     VoidPtr YieldImpl(VoidPtr args = VoidPtr(nullptr));
 
-    static void Run(Coroutine* co_ptr);
+#ifdef ASUKA_COROUTINE_STATS
+    // charge the time since we were switched to, before switching to co_ptr
+    void Account(Coroutine* co_ptr, bool yield);
+#endif
+
+    static void Run(void* arg);
+
+    // make co_ptr the owner of its SharedStack before switching to it
+    void SwitchSharedStack(Coroutine* co_ptr);
+
+    void SaveStack();
+
+    void RestoreStack();
 
 private:
-    unsigned int id_; // 1: main
+    unsigned int id_; // 0: main
 
     State state_;
 
-    std::vector<char> stack_;
+    // the coroutine which sends to this one last, Yield returns to it
+    Coroutine* caller_;
+
+    // the coroutine which switches to this one last, its yield_value_ is what we receive
+    Coroutine* from_;
+
+    // used by Runtime only, see Runtime::Ready
+    std::atomic<int> run_state_;
 
-    ucontext_t uctx_;
+    StackAllocator* allocator_;
 
-    std::function<void ()> func_;
+    Stack stack_;
+
+    detail::Context context_;
+
+    // callables up to kInlineFuncSize bytes are stored in the Coroutine itself
+    static constexpr size_t kInlineFuncSize = 48;
+
+    InlineFunction<kInlineFuncSize> func_;
 
     VoidPtr result_;
 
     VoidPtr yield_value_;
 
+    // copy-stack mode only
+    SharedStackPtr shared_stack_;
+
+    std::unique_ptr<char[]> save_buffer_;
+
+    size_t save_capacity_;
+
+    size_t saved_size_;
+
+    size_t max_saved_size_;
+
+    LocalSlot locals_[kInlineLocals];
+
+    std::vector<LocalSlot> more_locals_;
+
+#ifdef ASUKA_COROUTINE_STATS
+    detail::CoroutineCounters counters_;
+#endif
+
     static const size_t kDefaultStackSize;
-    static Coroutine main_;
-    static Coroutine* current_;
-    static unsigned int s_id_;
+    // every thread has its own main coroutine and current coroutine,
+    // so coroutines on different threads switch independently
+    static thread_local Coroutine main_;
+    // defined here, constant initialized: read without a TLS init call
+    static inline thread_local Coroutine* current_ = nullptr;
 };
 }
 
@@ -0,0 +1,103 @@
+//
+// Created by xi on 19-4-9.
+//
+
+#ifndef ASUKA_COROUTINELOCAL_H
+#define ASUKA_COROUTINELOCAL_H
+
+#include <stddef.h>
+
+#include <asuka/coroutine/Coroutine.h>
+
+namespace asuka
+{
+
+// thread_local for coroutines: every coroutine has its own value of a key,
+// made by T() at its first use in it, destroyed when the coroutine finishes
+// or, never finished, is destroyed. Outside of any coroutine the thread's
+// main coroutine has one, destroyed when the thread exits.
+// A value follows its coroutine across the workers of a Runtime.
+//
+//     CoroutineLocal<RequestContext> g_context;
+//     ... in a coroutine
+//     g_context->trace_id = id;
+//
+// Each key takes a slot index for good, the first 4 keys have their slots in
+// the Coroutine, so Get is a load of the current coroutine and of its slot.
+// NOTE: like thread_local variables, keys are meant to last: a value of a
+// key destroyed stays until its coroutine finishes.
+template <typename T>
+class CoroutineLocal
+{
+public:
+    CoroutineLocal() :
+        index_(Coroutine::NextLocalIndex())
+    {}
+
+    // non-copyable
+    CoroutineLocal(const CoroutineLocal&) = delete;
+    CoroutineLocal& operator=(const CoroutineLocal&) = delete;
+
+    T& Get() const
+    {
+        void* value = Coroutine::CurrentLocal(index_).value;
+        if (!value)
+        {
+            value = Make(index_);
+        }
+        return *static_cast<T*>(value);
+    }
+
+    T& operator*() const
+    {
+        return Get();
+    }
+
+    T* operator->() const
+    {
+        return &Get();
+    }
+
+    // nullptr if the current coroutine has not used it
+    T* Find() const
+    {
+        return static_cast<T*>(Coroutine::CurrentLocal(index_).value);
+    }
+
+    // destroy the value of the current coroutine now, the next Get makes another
+    void Reset() const
+    {
+        Coroutine::LocalSlot& slot = Coroutine::CurrentLocal(index_);
+        T* value = static_cast<T*>(slot.value);
+        slot.value = nullptr;
+        delete value;
+    }
+
+    size_t index() const
+    {
+        return index_;
+    }
+
+private:
+    static void Destroy(void* value)
+    {
+        delete static_cast<T*>(value);
+    }
+
+    static void* Make(size_t index)
+    {
+        T* value = new T();
+        // looked up after T(), which may use other keys and move the slots
+        Coroutine::LocalSlot& slot = Coroutine::CurrentLocal(index);
+        slot.value = value;
+        slot.destroy = &CoroutineLocal::Destroy;
+        return value;
+    }
+
+private:
+    size_t index_;
+};
+
+} // namespace asuka
+
+#endif //ASUKA_COROUTINELOCAL_H
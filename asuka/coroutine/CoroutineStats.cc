@@ -0,0 +1,137 @@
+//
+// Created by xi on 19-4-7.
+//
+
+#include <string.h>
+#include <mutex>
+#include <unordered_map>
+
+#include <asuka/coroutine/Coroutine.h>
+#include <asuka/coroutine/CoroutineStats.h>
+
+namespace asuka
+{
+
+namespace
+{
+
+struct Registry
+{
+    std::mutex mutex;
+
+    std::unordered_map<unsigned int, Coroutine*> live;
+
+    CoroutineStats::Totals retired;
+};
+
+// never destroyed, coroutines may be destroyed after main returns
+Registry& TheRegistry()
+{
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+void AddTo(CoroutineStats::Totals& totals, const CoroutineStats& stats)
+{
+    ++totals.coroutines;
+    totals.sends += stats.sends;
+    totals.yields += stats.yields;
+    totals.run_ns += stats.run_ns;
+}
+
+} // namespace
+
+std::optional<CoroutineStats> CoroutineStats::Find(unsigned int id)
+{
+    Registry& registry = TheRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto it = registry.live.find(id);
+    if (it == registry.live.end())
+    {
+        return std::nullopt;
+    }
+    return it->second->stats();
+}
+
+std::vector<CoroutineStats> CoroutineStats::Live()
+{
+    Registry& registry = TheRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::vector<CoroutineStats> live;
+    live.reserve(registry.live.size());
+    for (const auto& entry : registry.live)
+    {
+        live.push_back(entry.second->stats());
+    }
+    return live;
+}
+
+CoroutineStats::Totals CoroutineStats::Total()
+{
+    Registry& registry = TheRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    Totals totals(registry.retired);
+    for (const auto& entry : registry.live)
+    {
+        AddTo(totals, entry.second->stats());
+    }
+    return totals;
+}
+
+namespace detail
+{
+
+void CoroutineRegistry::Add(Coroutine* co)
+{
+    Registry& registry = TheRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.live[co->id_] = co;
+}
+
+void CoroutineRegistry::Remove(Coroutine* co)
+{
+    CoroutineStats stats(co->stats());
+    Registry& registry = TheRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto it = registry.live.find(co->id_);
+    // ids wrap around, a newer coroutine may have taken the entry
+    if (it != registry.live.end() && it->second == co)
+    {
+        registry.live.erase(it);
+    }
+    AddTo(registry.retired, stats);
+    if (!co->shared_stack_)
+    {
+        registry.retired.stack_high_water.Record(stats.stack_high_water);
+    }
+}
+
+void CoroutineRegistry::Paint(char* base, size_t size)
+{
+    memset(base, kPaint, size);
+}
+
+size_t CoroutineRegistry::Used(const char* base, size_t size)
+{
+    // the stack grows down: the untouched paint is at the bottom
+    const uint64_t kPaintWord = 0x0101010101010101ULL * kPaint;
+    size_t untouched = 0;
+    for (; untouched + sizeof(uint64_t) <= size; untouched += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, base + untouched, sizeof(word));
+        if (word != kPaintWord)
+        {
+            break;
+        }
+    }
+    while (untouched < size && static_cast<unsigned char>(base[untouched]) == kPaint)
+    {
+        ++untouched;
+    }
+    return size - untouched;
+}
+
+} // namespace detail
+
+} // namespace asuka
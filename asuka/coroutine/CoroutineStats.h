@@ -0,0 +1,126 @@
+//
+// Created by xi on 19-4-7.
+//
+
+#ifndef ASUKA_COROUTINESTATS_H
+#define ASUKA_COROUTINESTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <optional>
+#include <vector>
+
+#include <asuka/futures/Stats.h>
+
+namespace asuka
+{
+
+class Coroutine;
+
+// What a coroutine has done so far. Counted only when the coroutine library
+// is built with ASUKA_COROUTINE_STATS (cmake -DASUKA_COROUTINE_STATS=ON, or
+// link coroutine_stats instead of coroutine), which paints every stack at
+// creation and stamps every switch; otherwise no coroutine is registered and
+// Coroutine::stats() has only id and stack_size.
+//
+//     for (const CoroutineStats& stats : CoroutineStats::Live())
+//         ... stats.run_ns, stats.stack_high_water ...
+//     CoroutineStats::Totals totals = CoroutineStats::Total();
+//     totals.stack_high_water.Percentile(99); // a stack size for the workload
+struct CoroutineStats
+{
+#ifdef ASUKA_COROUTINE_STATS
+    static constexpr bool kEnabled = true;
+#else
+    static constexpr bool kEnabled = false;
+#endif
+
+    unsigned int id = 0;
+
+    // times it was resumed by Send or Next
+    uint64_t sends = 0;
+
+    // times it gave up the thread by Yield, returning at the end is not one
+    uint64_t yields = 0;
+
+    // ns it ran, from each switch to it to the next switch away
+    uint64_t run_ns = 0;
+
+    size_t stack_size = 0;
+
+    // the most bytes of its stack ever used, measured by the paint left
+    // untouched below them. On a SharedStack: the most copied out at a switch
+    size_t stack_high_water = 0;
+
+    // of every coroutine made since the start, live or destroyed
+    struct Totals
+    {
+        uint64_t coroutines = 0;
+
+        uint64_t sends = 0;
+
+        uint64_t yields = 0;
+
+        uint64_t run_ns = 0;
+
+        // bytes, one value per destroyed coroutine on its own stack
+        LatencyHistogram stack_high_water;
+    };
+
+    // by Coroutine::id(), empty if no live coroutine has it
+    // NOTE: the stack of a coroutine running on another thread is scanned
+    // while it changes, its high water may be a little behind
+    static std::optional<CoroutineStats> Find(unsigned int id);
+
+    // every live coroutine but the main ones
+    static std::vector<CoroutineStats> Live();
+
+    static Totals Total();
+};
+
+namespace detail
+{
+
+// the counters kept in a Coroutine, written by the thread running it or
+// switching to it, read by any
+struct CoroutineCounters
+{
+    std::atomic<uint64_t> sends{0};
+
+    std::atomic<uint64_t> yields{0};
+
+    // StatsNow ticks
+    std::atomic<uint64_t> run_ticks{0};
+
+    // when it was switched to last
+    uint64_t resumed_at = 0;
+
+    static void Bump(std::atomic<uint64_t>& counter, uint64_t delta)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+};
+
+// the live coroutines by id, and the totals of the destroyed ones
+class CoroutineRegistry
+{
+public:
+    static void Add(Coroutine* co);
+
+    static void Remove(Coroutine* co);
+
+    // the byte a new stack is filled with
+    static const unsigned char kPaint = 0xa5;
+
+    static void Paint(char* base, size_t size);
+
+    // bytes below base + size no longer painted
+    static size_t Used(const char* base, size_t size);
+};
+
+} // namespace detail
+
+} // namespace asuka
+
+#endif //ASUKA_COROUTINESTATS_H
@@ -0,0 +1,289 @@
+//
+// Created by xi on 19-3-10.
+//
+
+#ifndef ASUKA_GENERATOR_H
+#define ASUKA_GENERATOR_H
+
+#include <assert.h>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+
+#include <asuka/coroutine/Coroutine.h>
+
+// Type-safe wrappers of Coroutine.
+// Values are NOT wrapped by VoidPtr, they are handed across the switch through
+// a slot in the wrapper object which points to the value on the yielding side,
+// so there is no allocation and no copy per message.
+
+namespace asuka
+{
+
+// like Python generator:
+//     void Count(int n) { for (int i = 0; i < n; ++i) Generator<int>::Yield(i); }
+//     for (int i : Generator<int>(Count, 10)) { ... }
+template <typename T>
+class Generator
+{
+public:
+    class Iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T*;
+        using reference = T&;
+
+        Iterator() : generator_(nullptr) {}
+
+        explicit Iterator(Generator* generator) : generator_(generator) {}
+
+        T& operator*() const
+        {
+            return generator_->Value();
+        }
+
+        T* operator->() const
+        {
+            return &generator_->Value();
+        }
+
+        Iterator& operator++()
+        {
+            if (!generator_->Next())
+            {
+                generator_ = nullptr;
+            }
+            return *this;
+        }
+
+        void operator++(int)
+        {
+            ++*this;
+        }
+
+        bool operator==(const Iterator& rhs) const
+        {
+            return generator_ == rhs.generator_;
+        }
+
+        bool operator!=(const Iterator& rhs) const
+        {
+            return generator_ != rhs.generator_;
+        }
+
+    private:
+        Generator* generator_;
+    };
+
+    // f(args...) shall return void and produce values by Generator<T>::Yield
+    template <typename F, typename... Args>
+    explicit Generator(F&& f, Args&&... args) :
+        co_(Coroutine::CreateCoroutine(std::forward<F>(f), std::forward<Args>(args)...)),
+        value_(nullptr),
+        done_(false)
+    {
+        static_assert(std::is_void_v<std::result_of_t<F(Args...)>>, "Generator function shall return void");
+    }
+
+    Generator(Generator&&) = default;
+    Generator& operator=(Generator&&) = default;
+
+    // resume the generator, return false if it finished without yielding a value
+    bool Next()
+    {
+        if (done_)
+        {
+            return false;
+        }
+        value_ = nullptr;
+        Generator* prev = current_;
+        current_ = this;
+        Coroutine::Send(co_);
+        current_ = prev;
+        done_ = (value_ == nullptr);
+        return !done_;
+    }
+
+    // the value last yielded, valid until next resume
+    T& Value() const
+    {
+        if (value_ == nullptr)
+        {
+            throw std::runtime_error("Generator has no value");
+        }
+        return *value_;
+    }
+
+    bool done() const
+    {
+        return done_;
+    }
+
+    Iterator begin()
+    {
+        return Next() ? Iterator(this) : Iterator();
+    }
+
+    Iterator end()
+    {
+        return Iterator();
+    }
+
+    // call in the generator function only, value lives on the generator stack until resumed
+    static void Yield(T&& value)
+    {
+        YieldImpl(&value);
+    }
+
+    static void Yield(const T& value)
+    {
+        // yield a copy so the consumer can never modify value
+        T copy(value);
+        YieldImpl(&copy);
+    }
+
+private:
+    static void YieldImpl(T* value)
+    {
+        assert(current_ != nullptr);
+        current_->value_ = value;
+        Coroutine::Yield();
+    }
+
+private:
+    CoroutinePtr co_;
+
+    T* value_;
+
+    bool done_;
+
+    // the generator being resumed by this thread
+    static thread_local Generator* current_;
+};
+
+template <typename T>
+thread_local Generator<T>* Generator<T>::current_ = nullptr;
+
+// bidirectional typed coroutine:
+//     int Sum(int n) { int s = 0; for (int i = 0; i < n; ++i) s += TypedCoroutine<int, int>::Yield(s); return s; }
+//     TypedCoroutine<int, int> co(Sum, 3);
+//     co.Start();  // 0
+//     co.Send(1);  // 1
+//     co.Send(2);  // 3
+//     co.Send(3);  // 6, the return value, co is finished
+// f(args...) shall return Out
+template <typename In, typename Out>
+class TypedCoroutine
+{
+public:
+    template <typename F, typename... Args>
+    explicit TypedCoroutine(F&& f, Args&&... args) :
+        in_(nullptr),
+        out_(nullptr)
+    {
+        static_assert(std::is_convertible_v<std::result_of_t<F(Args...)>, Out>,
+                      "TypedCoroutine function shall return Out");
+        auto func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+        co_ = Coroutine::CreateCoroutine([func]() mutable {
+            TypedCoroutine* self = current_;
+            self->result_.emplace(func());
+            self->out_ = &*self->result_;
+        });
+    }
+
+    TypedCoroutine(TypedCoroutine&&) = default;
+    TypedCoroutine& operator=(TypedCoroutine&&) = default;
+
+    // run until first Yield, like Python send(None)
+    Out Start()
+    {
+        return Resume(nullptr);
+    }
+
+    Out Send(In&& in)
+    {
+        return Resume(&in);
+    }
+
+    Out Send(const In& in)
+    {
+        In copy(in);
+        return Resume(&copy);
+    }
+
+    bool done() const
+    {
+        return result_.has_value() && out_ == nullptr;
+    }
+
+    // call in the coroutine function only, return the value passed by next Send
+    static In Yield(Out&& out)
+    {
+        return YieldImpl(&out);
+    }
+
+    static In Yield(const Out& out)
+    {
+        Out copy(out);
+        return YieldImpl(&copy);
+    }
+
+private:
+    Out Resume(In* in)
+    {
+        if (done())
+        {
+            throw std::runtime_error("Send value to finished coroutine");
+        }
+        // checked here: thrown in the coroutine, nothing would catch it
+        if (in == nullptr && co_->state() != Coroutine::State::kNotInit)
+        {
+            throw std::runtime_error("Resume a started TypedCoroutine without value");
+        }
+        in_ = in;
+        out_ = nullptr;
+        TypedCoroutine* prev = current_;
+        current_ = this;
+        Coroutine::Send(co_);
+        current_ = prev;
+        assert(out_ != nullptr);
+        Out out(std::move(*out_));
+        out_ = nullptr;
+        return out;
+    }
+
+    static In YieldImpl(Out* out)
+    {
+        TypedCoroutine* self = current_;
+        assert(self != nullptr);
+        self->out_ = out;
+        Coroutine::Yield();
+        // resumed by Send, current_ is set to the resumer's object
+        self = current_;
+        // Resume passes a value to a started one
+        assert(self->in_ != nullptr);
+        return std::move(*self->in_);
+    }
+
+private:
+    CoroutinePtr co_;
+
+    In* in_;
+
+    Out* out_;
+
+    std::optional<Out> result_;
+
+    static thread_local TypedCoroutine* current_;
+};
+
+template <typename In, typename Out>
+thread_local TypedCoroutine<In, Out>* TypedCoroutine<In, Out>::current_ = nullptr;
+
+} // namespace asuka
+
+#endif //ASUKA_GENERATOR_H
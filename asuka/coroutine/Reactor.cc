@@ -0,0 +1,284 @@
+//
+// Created by xi on 19-3-15.
+//
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdexcept>
+#include <asuka/utils/Types.h>
+#include <asuka/coroutine/Reactor.h>
+
+namespace asuka
+{
+
+namespace
+{
+
+const int kMaxEvents = 256;
+
+void CloseIfOpen(int fd)
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+}
+
+} // namespace
+
+thread_local Reactor* Reactor::current_ = nullptr;
+
+Reactor::Reactor() :
+    epoll_fd_(::epoll_create1(EPOLL_CLOEXEC)),
+    wakeup_fd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    stopping_(false)
+{
+    // the destructor does not run when we throw
+    if (epoll_fd_ < 0 || wakeup_fd_ < 0)
+    {
+        CloseIfOpen(wakeup_fd_);
+        CloseIfOpen(epoll_fd_);
+        throw std::runtime_error("Reactor: epoll_create1 or eventfd failed");
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = wakeup_fd_;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event) != 0)
+    {
+        CloseIfOpen(wakeup_fd_);
+        CloseIfOpen(epoll_fd_);
+        throw std::runtime_error("Reactor: epoll_ctl failed");
+    }
+}
+
+Reactor::~Reactor()
+{
+    ::close(wakeup_fd_);
+    ::close(epoll_fd_);
+}
+
+Reactor* Reactor::Current()
+{
+    return current_;
+}
+
+void Reactor::Stop()
+{
+    stopping_ = true;
+    uint64_t one = 1;
+    ssize_t n = ::write(wakeup_fd_, &one, sizeof(one));
+    UnusedVariable(n);
+}
+
+void Reactor::Loop()
+{
+    assert(current_ == nullptr);
+    current_ = this;
+    while (!stopping_.load(std::memory_order_acquire))
+    {
+        // coroutines made ready while running are handled in next round
+        size_t count = ready_.size();
+        for (size_t i = 0; i < count; ++i)
+        {
+            CoroutinePtr co(std::move(ready_.front()));
+            ready_.pop_front();
+            Coroutine::Send(co);
+        }
+        Dispatch(ready_.empty() ? -1 : 0);
+    }
+    current_ = nullptr;
+}
+
+void Reactor::Dispatch(int timeout_ms)
+{
+    struct epoll_event events[kMaxEvents];
+    int n = ::epoll_wait(epoll_fd_, events, kMaxEvents, timeout_ms);
+    if (n < 0)
+    {
+        if (errno == EINTR)
+        {
+            return;
+        }
+        throw std::runtime_error("Reactor: epoll_wait failed");
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        int fd = events[i].data.fd;
+        uint32_t what = events[i].events;
+        if (fd == wakeup_fd_)
+        {
+            uint64_t value;
+            ssize_t ret = ::read(wakeup_fd_, &value, sizeof(value));
+            UnusedVariable(ret);
+            continue;
+        }
+        FdState& state = GetFdState(fd);
+        if ((what & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && state.reader)
+        {
+            ready_.push_back(std::move(state.reader));
+        }
+        if ((what & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && state.writer)
+        {
+            ready_.push_back(std::move(state.writer));
+        }
+    }
+}
+
+Reactor::FdState& Reactor::GetFdState(int fd)
+{
+    assert(fd >= 0);
+    size_t index = static_cast<size_t>(fd);
+    if (index >= fds_.size())
+    {
+        fds_.resize(std::max(index + 1, fds_.size() * 2));
+    }
+    return fds_[index];
+}
+
+bool Reactor::WaitFor(int fd, bool readable)
+{
+    CoroutinePtr co(Coroutine::Current());
+    if (!co)
+    {
+        throw std::runtime_error("Reactor: I/O must be called in a coroutine");
+    }
+    FdState& state = GetFdState(fd);
+    if (!state.registered)
+    {
+        // edge-triggered, both directions registered once until Close
+        struct epoll_event event = {};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = fd;
+        if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            throw std::runtime_error("Reactor: epoll_ctl failed");
+        }
+        state.registered = true;
+    }
+    CoroutinePtr& waiter = readable ? state.reader : state.writer;
+    if (waiter)
+    {
+        throw std::runtime_error("Reactor: another coroutine is waiting on the fd");
+    }
+    waiter = std::move(co);
+    unsigned int closes = state.closes;
+    Coroutine::Yield();
+    // fds_ may have grown meanwhile
+    return GetFdState(fd).closes == closes;
+}
+
+ssize_t Reactor::Read(int fd, void* buf, size_t len)
+{
+    while (true)
+    {
+        ssize_t n = ::read(fd, buf, len);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            return n;
+        }
+        if (errno != EINTR && !WaitFor(fd, true))
+        {
+            errno = EBADF;
+            return -1;
+        }
+    }
+}
+
+ssize_t Reactor::Write(int fd, const void* buf, size_t len)
+{
+    const char* data = static_cast<const char*>(buf);
+    size_t written = 0;
+    while (written < len)
+    {
+        ssize_t n = ::write(fd, data + written, len - written);
+        if (n >= 0)
+        {
+            written += static_cast<size_t>(n);
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            if (!WaitFor(fd, false))
+            {
+                errno = EBADF;
+                return -1;
+            }
+        }
+        else if (errno != EINTR)
+        {
+            return -1;
+        }
+    }
+    return static_cast<ssize_t>(written);
+}
+
+int Reactor::Accept(int listen_fd, struct sockaddr* addr, socklen_t* addrlen)
+{
+    while (true)
+    {
+        int fd = ::accept4(listen_fd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            return fd;
+        }
+        if (errno != EINTR && !WaitFor(listen_fd, true))
+        {
+            errno = EBADF;
+            return -1;
+        }
+    }
+}
+
+int Reactor::Connect(int fd, const struct sockaddr* addr, socklen_t addrlen)
+{
+    int ret = ::connect(fd, addr, addrlen);
+    if (ret == 0 || errno != EINPROGRESS)
+    {
+        return ret;
+    }
+    if (!WaitFor(fd, false))
+    {
+        errno = EBADF;
+        return -1;
+    }
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0)
+    {
+        return -1;
+    }
+    if (error != 0)
+    {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int Reactor::Close(int fd)
+{
+    // waiters are woken and detached, then fd deregistered, before the
+    // number can be reused by the ::close: they see the change of closes
+    // and return EBADF without touching fd
+    FdState& state = GetFdState(fd);
+    ++state.closes;
+    if (state.reader)
+    {
+        ready_.push_back(std::move(state.reader));
+    }
+    if (state.writer)
+    {
+        ready_.push_back(std::move(state.writer));
+    }
+    if (state.registered)
+    {
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        state.registered = false;
+    }
+    return ::close(fd);
+}
+
+} // namespace asuka
@@ -0,0 +1,107 @@
+//
+// Created by xi on 19-3-15.
+//
+
+#ifndef ASUKA_REACTOR_H
+#define ASUKA_REACTOR_H
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include <asuka/coroutine/Coroutine.h>
+
+namespace asuka
+{
+
+// Single-threaded I/O reactor built on edge-triggered epoll.
+// Coroutines spawned by the reactor call Read/Write/Accept/Connect on non-blocking fds,
+// when the fd is not ready the calling coroutine is parked and resumed once epoll
+// reports readiness, so thousands of connections run on one thread without blocking.
+//
+//     Reactor reactor;
+//     reactor.Spawn(Server, &reactor, listen_fd);
+//     reactor.Loop(); // until Stop
+//
+// NOTE: Read/Write/Accept/Connect/Close shall be called in coroutines of this reactor,
+// in the thread running Loop. Only Stop is thread safe.
+class Reactor
+{
+public:
+    Reactor();
+    ~Reactor();
+
+    // non-copyable
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    template <typename F, typename... Args>
+    CoroutinePtr Spawn(F&& f, Args&&... args)
+    {
+        CoroutinePtr co(Coroutine::CreateCoroutine(std::forward<F>(f), std::forward<Args>(args)...));
+        ready_.push_back(co);
+        return co;
+    }
+
+    // run coroutines and dispatch I/O events until Stop
+    void Loop();
+
+    void Stop();
+
+    // the reactor running Loop in this thread
+    static Reactor* Current();
+
+    // like ::read, but parks the calling coroutine until fd is readable
+    ssize_t Read(int fd, void* buf, size_t len);
+
+    // write all len bytes unless error, parks while fd is not writable
+    ssize_t Write(int fd, const void* buf, size_t len);
+
+    // like ::accept4(SOCK_NONBLOCK | SOCK_CLOEXEC), parks until a connection comes
+    int Accept(int listen_fd, struct sockaddr* addr, socklen_t* addrlen);
+
+    // non-blocking connect, parks until connected or failed
+    int Connect(int fd, const struct sockaddr* addr, socklen_t addrlen);
+
+    // deregister and close fd, its waiters return -1 with EBADF
+    // without touching fd again, the number may be reused meanwhile
+    int Close(int fd);
+
+private:
+    struct FdState
+    {
+        bool registered = false;
+        // counts the Closes, a waiter seeing it changed was woken by one
+        unsigned int closes = 0;
+        CoroutinePtr reader;
+        CoroutinePtr writer;
+    };
+
+    FdState& GetFdState(int fd);
+
+    // park the current coroutine until fd is readable (or writable),
+    // false if fd was closed meanwhile
+    bool WaitFor(int fd, bool readable);
+
+    void Dispatch(int timeout_ms);
+
+private:
+    int epoll_fd_;
+
+    int wakeup_fd_;
+
+    std::atomic<bool> stopping_;
+
+    std::deque<CoroutinePtr> ready_;
+
+    std::vector<FdState> fds_;
+
+    static thread_local Reactor* current_;
+};
+
+} // namespace asuka
+
+#endif //ASUKA_REACTOR_H
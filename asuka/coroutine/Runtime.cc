@@ -0,0 +1,346 @@
+//
+// Created by xi on 19-3-12.
+//
+
+#include <assert.h>
+#include <chrono>
+#include <stdexcept>
+#include <asuka/coroutine/Runtime.h>
+
+namespace asuka
+{
+
+namespace
+{
+
+// Coroutine::run_state_
+// kIdle -> kQueued: Ready
+// kQueued -> kRunning: a worker resumes it
+// kRunning -> kNotified: Ready while running, the worker requeues it after it gives up
+// kRunning -> kIdle: parked
+// kRunning -> kFinished: for good, Ready leaves it alone
+enum RunState
+{
+    kIdle,
+    kQueued,
+    kRunning,
+    kNotified,
+    kFinished
+};
+
+uint64_t NowNanos()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+} // namespace
+
+// every worker sits on its own cache lines, counters are written by the owner only
+struct alignas(64) Runtime::Worker
+{
+    Worker(Runtime* rt, size_t idx) :
+        runtime(rt),
+        index(idx),
+        yield_requested(false),
+        rand_state(idx * 2654435761u + 1),
+        start_ns(NowNanos()),
+        resumed(0),
+        steals(0),
+        stolen(0),
+        idle_ns(0)
+    {}
+
+    Runtime* runtime;
+    size_t index;
+    bool yield_requested;
+    uint64_t rand_state;
+    uint64_t start_ns;
+
+    std::mutex mutex;
+    std::deque<CoroutinePtr> queue;
+
+    std::atomic<uint64_t> resumed;
+    std::atomic<uint64_t> steals;
+    std::atomic<uint64_t> stolen;
+    std::atomic<uint64_t> idle_ns;
+
+    std::thread thread;
+};
+
+thread_local Runtime::Worker* Runtime::current_worker_ = nullptr;
+
+namespace
+{
+
+void Increase(std::atomic<uint64_t>& counter, uint64_t n = 1)
+{
+    // single writer
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+} // namespace
+
+Runtime::Runtime(size_t num_workers) :
+    pending_(0),
+    stopping_(false),
+    sleepers_(0)
+{
+    if (num_workers == 0)
+    {
+        num_workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < num_workers; ++i)
+    {
+        workers_.push_back(std::make_unique<Worker>(this, i));
+    }
+    for (auto& worker : workers_)
+    {
+        worker->thread = std::thread(&Runtime::WorkerLoop, this, worker.get());
+    }
+}
+
+Runtime::~Runtime()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    sleep_cond_.notify_all();
+    for (auto& worker : workers_)
+    {
+        worker->thread.join();
+    }
+}
+
+void Runtime::Ready(const CoroutinePtr& co)
+{
+    if (co->shared_stack_)
+    {
+        throw std::runtime_error("Coroutine on shared stack can't be run by Runtime");
+    }
+    int state = co->run_state_.load(std::memory_order_acquire);
+    while (true)
+    {
+        if (state == kIdle)
+        {
+            if (co->run_state_.compare_exchange_weak(state, kQueued, std::memory_order_acq_rel))
+            {
+                Worker* worker = current_worker_;
+                Push(worker && worker->runtime == this ? worker : nullptr, co);
+                return;
+            }
+        }
+        else if (state == kRunning)
+        {
+            if (co->run_state_.compare_exchange_weak(state, kNotified, std::memory_order_acq_rel))
+            {
+                return;
+            }
+        }
+        else
+        {
+            return; // already queued, notified or finished
+        }
+    }
+}
+
+void Runtime::Yield()
+{
+    Worker* worker = current_worker_;
+    assert(worker != nullptr);
+    worker->yield_requested = true;
+    Coroutine::Yield();
+}
+
+void Runtime::Park()
+{
+    assert(current_worker_ != nullptr);
+    Coroutine::Yield();
+}
+
+Runtime* Runtime::Current()
+{
+    return current_worker_ ? current_worker_->runtime : nullptr;
+}
+
+std::vector<Runtime::WorkerStats> Runtime::Stats() const
+{
+    std::vector<WorkerStats> stats;
+    uint64_t now = NowNanos();
+    for (auto& worker : workers_)
+    {
+        WorkerStats s;
+        s.resumed = worker->resumed.load(std::memory_order_relaxed);
+        s.steals = worker->steals.load(std::memory_order_relaxed);
+        s.stolen = worker->stolen.load(std::memory_order_relaxed);
+        uint64_t wall = now - worker->start_ns;
+        uint64_t idle = std::min(wall, worker->idle_ns.load(std::memory_order_relaxed));
+        s.utilization = wall ? 1.0 - static_cast<double>(idle) / static_cast<double>(wall) : 0.0;
+        stats.push_back(s);
+    }
+    return stats;
+}
+
+void Runtime::Push(Worker* worker, CoroutinePtr co)
+{
+    if (worker)
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->queue.push_back(std::move(co));
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(inject_mutex_);
+        inject_queue_.push_back(std::move(co));
+    }
+    pending_.fetch_add(1);
+    WakeUp();
+}
+
+void Runtime::WakeUp()
+{
+    // pairs with WorkerLoop: one of us sees the other's increment
+    if (sleepers_.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        sleep_cond_.notify_one();
+    }
+}
+
+CoroutinePtr Runtime::Pop(Worker* worker)
+{
+    CoroutinePtr co;
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (!worker->queue.empty())
+        {
+            co = std::move(worker->queue.front());
+            worker->queue.pop_front();
+        }
+    }
+    if (!co)
+    {
+        std::lock_guard<std::mutex> lock(inject_mutex_);
+        if (!inject_queue_.empty())
+        {
+            co = std::move(inject_queue_.front());
+            inject_queue_.pop_front();
+        }
+    }
+    if (!co)
+    {
+        co = Steal(worker);
+    }
+    if (co)
+    {
+        pending_.fetch_sub(1);
+    }
+    return co;
+}
+
+CoroutinePtr Runtime::Steal(Worker* worker)
+{
+    size_t n = workers_.size();
+    if (n <= 1)
+    {
+        return CoroutinePtr();
+    }
+    // xorshift, start from a random victim
+    worker->rand_state ^= worker->rand_state << 13;
+    worker->rand_state ^= worker->rand_state >> 7;
+    worker->rand_state ^= worker->rand_state << 17;
+    size_t start = static_cast<size_t>(worker->rand_state % n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        Worker* victim = workers_[(start + i) % n].get();
+        if (victim == worker)
+        {
+            continue;
+        }
+        std::vector<CoroutinePtr> batch;
+        {
+            std::lock_guard<std::mutex> lock(victim->mutex);
+            // take half from the back, the owner pops from the front
+            size_t count = (victim->queue.size() + 1) / 2;
+            for (size_t j = 0; j < count; ++j)
+            {
+                batch.push_back(std::move(victim->queue.back()));
+                victim->queue.pop_back();
+            }
+        }
+        if (batch.empty())
+        {
+            continue;
+        }
+        Increase(worker->steals);
+        Increase(worker->stolen, batch.size());
+        CoroutinePtr co(std::move(batch.back()));
+        batch.pop_back();
+        if (!batch.empty())
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            for (auto& stolen : batch)
+            {
+                worker->queue.push_back(std::move(stolen));
+            }
+        }
+        return co;
+    }
+    return CoroutinePtr();
+}
+
+void Runtime::Run(Worker* worker, CoroutinePtr co)
+{
+    co->run_state_.store(kRunning, std::memory_order_release);
+    worker->yield_requested = false;
+    Increase(worker->resumed);
+    Coroutine::Send(co);
+    if (co->state() == Coroutine::State::kFinished)
+    {
+        co->run_state_.store(kFinished, std::memory_order_release);
+        return;
+    }
+    if (worker->yield_requested)
+    {
+        co->run_state_.store(kQueued, std::memory_order_release);
+        Push(worker, std::move(co));
+        return;
+    }
+    int state = kRunning;
+    if (!co->run_state_.compare_exchange_strong(state, kIdle, std::memory_order_acq_rel))
+    {
+        // Ready is called before it gives up the worker
+        assert(state == kNotified);
+        co->run_state_.store(kQueued, std::memory_order_release);
+        Push(worker, std::move(co));
+    }
+}
+
+void Runtime::WorkerLoop(Worker* worker)
+{
+    current_worker_ = worker;
+    while (!stopping_.load(std::memory_order_acquire))
+    {
+        CoroutinePtr co(Pop(worker));
+        if (co)
+        {
+            Run(worker, std::move(co));
+            continue;
+        }
+        uint64_t idle_start = NowNanos();
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            sleepers_.fetch_add(1);
+            if (pending_.load() == 0 && !stopping_.load())
+            {
+                sleep_cond_.wait(lock);
+            }
+            sleepers_.fetch_sub(1);
+        }
+        Increase(worker->idle_ns, NowNanos() - idle_start);
+    }
+    current_worker_ = nullptr;
+}
+
+} // namespace asuka
@@ -0,0 +1,114 @@
+//
+// Created by xi on 19-3-12.
+//
+
+#ifndef ASUKA_RUNTIME_H
+#define ASUKA_RUNTIME_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <asuka/coroutine/Coroutine.h>
+
+namespace asuka
+{
+
+// M:N runtime: many coroutines are multiplexed onto a fixed pool of worker threads.
+// Every worker has a local run queue and steals from the others when it is empty,
+// so a ready coroutine may be resumed by any worker.
+//
+// In a coroutine run by the runtime:
+//     Runtime::Yield() gives up the worker and stays ready,
+//     Runtime::Park() gives up the worker until someone calls Ready on it.
+// NOTE: coroutines on a SharedStack can NOT be run by the runtime,
+// and thread_local data may change across Yield and Park.
+class Runtime
+{
+public:
+    struct WorkerStats
+    {
+        uint64_t resumed = 0;     // times of resuming a coroutine
+        uint64_t steals = 0;      // successful steal operations
+        uint64_t stolen = 0;      // coroutines taken by steal operations
+        double utilization = 0.0; // fraction of wall time not spent idle
+    };
+
+    // 0: std::thread::hardware_concurrency()
+    explicit Runtime(size_t num_workers = 0);
+
+    // stop workers, coroutines not finished are dropped
+    ~Runtime();
+
+    // non-copyable
+    Runtime(const Runtime&) = delete;
+    Runtime& operator=(const Runtime&) = delete;
+
+    template <typename F, typename... Args>
+    CoroutinePtr Spawn(F&& f, Args&&... args)
+    {
+        CoroutinePtr co(Coroutine::CreateCoroutine(std::forward<F>(f), std::forward<Args>(args)...));
+        Ready(co);
+        return co;
+    }
+
+    // make a new or parked coroutine runnable, thread safe,
+    // a coroutine made ready while still running is requeued once it gives up the worker
+    void Ready(const CoroutinePtr& co);
+
+    static void Yield();
+
+    static void Park();
+
+    // the runtime the calling thread works for, nullptr if not a worker
+    static Runtime* Current();
+
+    size_t num_workers() const
+    {
+        return workers_.size();
+    }
+
+    std::vector<WorkerStats> Stats() const;
+
+private:
+    struct Worker;
+
+    void WorkerLoop(Worker* worker);
+
+    CoroutinePtr Pop(Worker* worker);
+
+    CoroutinePtr Steal(Worker* worker);
+
+    void Push(Worker* worker, CoroutinePtr co);
+
+    void Run(Worker* worker, CoroutinePtr co);
+
+    void WakeUp();
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    // submission from non-worker threads
+    std::mutex inject_mutex_;
+    std::deque<CoroutinePtr> inject_queue_;
+
+    // coroutines in all queues
+    std::atomic<size_t> pending_;
+
+    std::atomic<bool> stopping_;
+
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cond_;
+    std::atomic<size_t> sleepers_;
+
+    static thread_local Worker* current_worker_;
+};
+
+} // namespace asuka
+
+#endif //ASUKA_RUNTIME_H
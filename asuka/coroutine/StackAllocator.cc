@@ -0,0 +1,183 @@
+//
+// Created by xi on 19-3-4.
+//
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
+#include <asuka/coroutine/StackAllocator.h>
+
+namespace asuka
+{
+
+namespace
+{
+
+PooledStackAllocator g_pooled_allocator;
+StackAllocator* g_default_allocator = &g_pooled_allocator;
+
+const size_t kNumSizeClasses = 32;
+
+// size class of a stack of pages pages, pages shall be power of two
+size_t SizeClass(size_t pages)
+{
+    assert(pages != 0 && (pages & (pages - 1)) == 0);
+    size_t index = 0;
+    while ((static_cast<size_t>(1) << index) < pages)
+    {
+        ++index;
+    }
+    return index;
+}
+
+size_t RoundUpPowerOfTwo(size_t n)
+{
+    size_t result = 1;
+    while (result < n)
+    {
+        result <<= 1;
+    }
+    return result;
+}
+
+// set when the calling thread's StackCache is destroyed,
+// coroutines destroyed after that (e.g. in static destructors) unmap directly
+thread_local bool t_cache_destroyed = false;
+
+} // namespace
+
+StackAllocator* StackAllocator::Default()
+{
+    return g_default_allocator;
+}
+
+void StackAllocator::SetDefault(StackAllocator* allocator)
+{
+    assert(allocator != nullptr);
+    g_default_allocator = allocator;
+}
+
+Stack HeapStackAllocator::Allocate(size_t size)
+{
+    Stack stack;
+    stack.base = new char[size]();
+    stack.size = size;
+    return stack;
+}
+
+void HeapStackAllocator::Deallocate(const Stack& stack)
+{
+    delete[] stack.base;
+}
+
+// per-thread free lists, one for each size class
+struct StackCache
+{
+    ~StackCache()
+    {
+        for (auto& free_list : free_lists)
+        {
+            for (const Stack& stack : free_list)
+            {
+                PooledStackAllocator::Unmap(stack);
+            }
+        }
+        t_cache_destroyed = true;
+    }
+
+    std::vector<Stack> free_lists[kNumSizeClasses];
+};
+
+namespace
+{
+
+thread_local StackCache t_stack_cache;
+
+} // namespace
+
+const size_t PooledStackAllocator::kDefaultMaxCachedStacks = 1024;
+
+PooledStackAllocator::PooledStackAllocator(size_t max_cached_stacks) :
+    max_cached_stacks_(max_cached_stacks)
+{}
+
+size_t PooledStackAllocator::PageSize()
+{
+    static const size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return page_size;
+}
+
+Stack PooledStackAllocator::Allocate(size_t size)
+{
+    size_t pages = RoundUpPowerOfTwo((std::max(size, PageSize()) + PageSize() - 1) / PageSize());
+    size_t index = SizeClass(pages);
+    assert(index < kNumSizeClasses);
+    if (!t_cache_destroyed)
+    {
+        std::vector<Stack>& free_list = t_stack_cache.free_lists[index];
+        if (!free_list.empty())
+        {
+            Stack stack = free_list.back();
+            free_list.pop_back();
+            return stack;
+        }
+    }
+    return Map(pages * PageSize());
+}
+
+void PooledStackAllocator::Deallocate(const Stack& stack)
+{
+    if (stack.base == nullptr)
+    {
+        return;
+    }
+    if (!t_cache_destroyed)
+    {
+        std::vector<Stack>& free_list = t_stack_cache.free_lists[SizeClass(stack.size / PageSize())];
+        if (free_list.size() < max_cached_stacks_)
+        {
+            free_list.push_back(stack);
+            return;
+        }
+    }
+    Unmap(stack);
+}
+
+Stack PooledStackAllocator::Map(size_t size)
+{
+    // [guard page][stack ... ], stack grows down towards the guard page
+    size_t guard = PageSize();
+    void* addr = ::mmap(nullptr, size + guard, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+    if (::mprotect(addr, guard, PROT_NONE) != 0)
+    {
+        ::munmap(addr, size + guard);
+        throw std::bad_alloc();
+    }
+    Stack stack;
+    stack.base = static_cast<char*>(addr) + guard;
+    stack.size = size;
+    return stack;
+}
+
+void PooledStackAllocator::Unmap(const Stack& stack)
+{
+    size_t guard = PageSize();
+    int ret = ::munmap(stack.base - guard, stack.size + guard);
+    if (ret != 0)
+    {
+        perror("::munmap");
+    }
+}
+
+} // namespace asuka
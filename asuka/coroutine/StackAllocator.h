@@ -0,0 +1,81 @@
+//
+// Created by xi on 19-3-4.
+//
+
+#ifndef ASUKA_STACKALLOCATOR_H
+#define ASUKA_STACKALLOCATOR_H
+
+#include <stddef.h>
+
+namespace asuka
+{
+
+// usable region of a coroutine stack, grows down from base + size
+struct Stack
+{
+    char* base = nullptr;
+    size_t size = 0;
+};
+
+class StackAllocator
+{
+public:
+    StackAllocator() = default;
+    virtual ~StackAllocator() = default;
+
+    // non-copyable
+    StackAllocator(const StackAllocator&) = delete;
+    StackAllocator& operator=(const StackAllocator&) = delete;
+    // non-movable
+    StackAllocator(StackAllocator&&) = delete;
+    StackAllocator& operator=(StackAllocator&&) = delete;
+
+    // the returned stack is at least size bytes
+    virtual Stack Allocate(size_t size) = 0;
+    // stack shall be returned to the allocator which allocated it
+    virtual void Deallocate(const Stack& stack) = 0;
+
+    // used by Coroutine::CreateCoroutine, PooledStackAllocator by default
+    static StackAllocator* Default();
+    // NOTE: not thread safe, set it before creating any coroutine
+    static void SetDefault(StackAllocator* allocator);
+};
+
+// Zero-filled heap memory, no guard page, no reuse
+class HeapStackAllocator : public StackAllocator
+{
+public:
+    Stack Allocate(size_t size) override;
+    void Deallocate(const Stack& stack) override;
+};
+
+// mmap-ed stacks, lazily committed by kernel, with a PROT_NONE guard page
+// below each stack so an overflow crashes instead of corrupting the heap.
+// Freed stacks are cached in a per-thread free list grouped by
+// power-of-two size class, and reused by following Allocate.
+class PooledStackAllocator : public StackAllocator
+{
+public:
+    // keep at most max_cached_stacks free stacks per size class per thread
+    explicit PooledStackAllocator(size_t max_cached_stacks = kDefaultMaxCachedStacks);
+
+    Stack Allocate(size_t size) override;
+    void Deallocate(const Stack& stack) override;
+
+    static size_t PageSize();
+
+    static const size_t kDefaultMaxCachedStacks;
+
+private:
+    static Stack Map(size_t size);
+    static void Unmap(const Stack& stack);
+
+    friend struct StackCache;
+
+private:
+    size_t max_cached_stacks_;
+};
+
+} // namespace asuka
+
+#endif //ASUKA_STACKALLOCATOR_H
@@ -0,0 +1,314 @@
+//
+// Created by xi on 19-3-20.
+//
+
+#include <assert.h>
+#include <stdexcept>
+#include <thread>
+#include <asuka/utils/Futex.h>
+#include <asuka/coroutine/Runtime.h>
+#include <asuka/coroutine/Sync.h>
+
+namespace asuka
+{
+
+namespace
+{
+
+const int kSpinsBeforeYield = 64;
+
+} // namespace
+
+namespace detail
+{
+
+void SpinLock::Lock()
+{
+    while (locked_.exchange(true, std::memory_order_acquire))
+    {
+        int spins = 0;
+        while (locked_.load(std::memory_order_relaxed))
+        {
+            if (++spins < kSpinsBeforeYield)
+            {
+                CpuRelax();
+            }
+            else
+            {
+                // the holder may be preempted
+                std::this_thread::yield();
+            }
+        }
+    }
+}
+
+Waiter::Waiter() :
+    co(Coroutine::Current()),
+    runtime(Runtime::Current()),
+    next(nullptr),
+    woken(0)
+{
+    if (co && !runtime)
+    {
+        throw std::runtime_error("Only coroutines run by Runtime can wait");
+    }
+}
+
+void Waiter::Wait()
+{
+    if (co)
+    {
+        // loop: someone else may call Ready on us
+        while (!woken.load(std::memory_order_acquire))
+        {
+            Runtime::Park();
+        }
+    }
+    else
+    {
+        while (!woken.load(std::memory_order_acquire))
+        {
+            FutexWait(&woken, 0, nullptr);
+        }
+    }
+}
+
+void Waiter::Wake(Waiter* waiter)
+{
+    // take what we need first, the waiter returns as soon as it sees woken
+    CoroutinePtr co(std::move(waiter->co));
+    Runtime* runtime = waiter->runtime;
+    waiter->woken.store(1, std::memory_order_release);
+    if (co)
+    {
+        runtime->Ready(co);
+    }
+    else
+    {
+        // a stale address only causes a spurious wake
+        FutexWake(&waiter->woken, 1);
+    }
+}
+
+void WaitQueue::Push(Waiter* waiter)
+{
+    waiter->next = nullptr;
+    if (tail_)
+    {
+        tail_->next = waiter;
+    }
+    else
+    {
+        head_ = waiter;
+    }
+    tail_ = waiter;
+}
+
+Waiter* WaitQueue::Pop()
+{
+    Waiter* waiter = head_;
+    if (waiter)
+    {
+        head_ = waiter->next;
+        if (head_ == nullptr)
+        {
+            tail_ = nullptr;
+        }
+    }
+    return waiter;
+}
+
+Waiter* WaitQueue::PopAll()
+{
+    Waiter* waiter = head_;
+    head_ = nullptr;
+    tail_ = nullptr;
+    return waiter;
+}
+
+} // namespace detail
+
+namespace
+{
+
+void WakeAll(detail::Waiter* waiter)
+{
+    while (waiter)
+    {
+        detail::Waiter* next = waiter->next;
+        detail::Waiter::Wake(waiter);
+        waiter = next;
+    }
+}
+
+} // namespace
+
+void CoMutex::Lock()
+{
+    if (TryLock())
+    {
+        return;
+    }
+    detail::Waiter waiter;
+    {
+        detail::SpinLockGuard guard(spin_);
+        if (!locked_)
+        {
+            locked_ = true;
+            return;
+        }
+        waiters_.Push(&waiter);
+    }
+    // Unlock hands the mutex over, it is ours once woken
+    waiter.Wait();
+}
+
+bool CoMutex::TryLock()
+{
+    detail::SpinLockGuard guard(spin_);
+    if (locked_)
+    {
+        return false;
+    }
+    locked_ = true;
+    return true;
+}
+
+void CoMutex::Unlock()
+{
+    detail::Waiter* next;
+    {
+        detail::SpinLockGuard guard(spin_);
+        assert(locked_);
+        next = waiters_.Pop();
+        if (next == nullptr)
+        {
+            locked_ = false;
+        }
+    }
+    if (next)
+    {
+        detail::Waiter::Wake(next);
+    }
+}
+
+void CoConditionVariable::Wait(CoMutex& mutex)
+{
+    detail::Waiter waiter;
+    {
+        detail::SpinLockGuard guard(spin_);
+        waiters_.Push(&waiter);
+    }
+    mutex.Unlock();
+    waiter.Wait();
+    mutex.Lock();
+}
+
+void CoConditionVariable::NotifyOne()
+{
+    detail::Waiter* waiter;
+    {
+        detail::SpinLockGuard guard(spin_);
+        waiter = waiters_.Pop();
+    }
+    if (waiter)
+    {
+        detail::Waiter::Wake(waiter);
+    }
+}
+
+void CoConditionVariable::NotifyAll()
+{
+    detail::Waiter* waiters;
+    {
+        detail::SpinLockGuard guard(spin_);
+        waiters = waiters_.PopAll();
+    }
+    WakeAll(waiters);
+}
+
+void CoSemaphore::Acquire()
+{
+    if (TryAcquire())
+    {
+        return;
+    }
+    detail::Waiter waiter;
+    {
+        detail::SpinLockGuard guard(spin_);
+        if (count_ > 0)
+        {
+            --count_;
+            return;
+        }
+        waiters_.Push(&waiter);
+    }
+    // Release hands a permit over
+    waiter.Wait();
+}
+
+bool CoSemaphore::TryAcquire()
+{
+    detail::SpinLockGuard guard(spin_);
+    if (count_ == 0)
+    {
+        return false;
+    }
+    --count_;
+    return true;
+}
+
+void CoSemaphore::Release(size_t n)
+{
+    detail::WaitQueue woken;
+    {
+        detail::SpinLockGuard guard(spin_);
+        for (; n > 0 && !waiters_.empty(); --n)
+        {
+            woken.Push(waiters_.Pop());
+        }
+        count_ += n;
+    }
+    WakeAll(woken.PopAll());
+}
+
+void WaitGroup::Add(long n)
+{
+    detail::Waiter* waiters = nullptr;
+    {
+        detail::SpinLockGuard guard(spin_);
+        if (count_ + n < 0)
+        {
+            throw std::runtime_error("WaitGroup: negative counter");
+        }
+        count_ += n;
+        if (count_ == 0)
+        {
+            waiters = waiters_.PopAll();
+        }
+    }
+    WakeAll(waiters);
+}
+
+void WaitGroup::Wait()
+{
+    {
+        detail::SpinLockGuard guard(spin_);
+        if (count_ == 0)
+        {
+            return;
+        }
+    }
+    detail::Waiter waiter;
+    {
+        detail::SpinLockGuard guard(spin_);
+        if (count_ == 0)
+        {
+            return;
+        }
+        waiters_.Push(&waiter);
+    }
+    waiter.Wait();
+}
+
+} // namespace asuka
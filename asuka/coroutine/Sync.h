@@ -0,0 +1,235 @@
+//
+// Created by xi on 19-3-20.
+//
+
+#ifndef ASUKA_SYNC_H
+#define ASUKA_SYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include <asuka/coroutine/Coroutine.h>
+
+namespace asuka
+{
+
+class Runtime;
+
+namespace detail
+{
+
+// test and test-and-set lock guarding the wait queues, held for a few instructions
+class SpinLock
+{
+public:
+    SpinLock() : locked_(false) {}
+
+    void Lock();
+
+    void Unlock()
+    {
+        locked_.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> locked_;
+};
+
+class SpinLockGuard
+{
+public:
+    explicit SpinLockGuard(SpinLock& lock) : lock_(lock)
+    {
+        lock_.Lock();
+    }
+
+    ~SpinLockGuard()
+    {
+        lock_.Unlock();
+    }
+
+    SpinLockGuard(const SpinLockGuard&) = delete;
+    SpinLockGuard& operator=(const SpinLockGuard&) = delete;
+
+private:
+    SpinLock& lock_;
+};
+
+// lives on the stack of the waiting coroutine (or thread) while it waits,
+// so waiting allocates nothing
+struct Waiter
+{
+    Waiter();
+
+    // park the caller until Wake, a coroutine run by Runtime gives up its worker,
+    // a plain thread blocks on futex
+    void Wait();
+
+    // NOTE: the waiter may be gone once woken, do not touch it after
+    static void Wake(Waiter* waiter);
+
+    CoroutinePtr co;  // empty: a plain thread
+    Runtime* runtime;
+    Waiter* next;
+    std::atomic<uint32_t> woken;
+};
+
+// intrusive FIFO of waiters
+class WaitQueue
+{
+public:
+    WaitQueue() : head_(nullptr), tail_(nullptr) {}
+
+    bool empty() const
+    {
+        return head_ == nullptr;
+    }
+
+    void Push(Waiter* waiter);
+
+    Waiter* Pop();
+
+    // detach all, the caller wakes them following Waiter::next
+    Waiter* PopAll();
+
+private:
+    Waiter* head_;
+    Waiter* tail_;
+};
+
+} // namespace detail
+
+// Synchronization for coroutines run by Runtime: a coroutine that has to wait
+// gives up its worker by Runtime::Park instead of blocking the thread,
+// so other coroutines keep running on it. Waiters are queued in FIFO order
+// and woken by Runtime::Ready.
+// Called outside of any coroutine the caller thread blocks instead.
+// NOTE: coroutines not run by Runtime can NOT wait on them.
+
+// Ownership is handed to the first waiter on Unlock, so no one barges in.
+class CoMutex
+{
+public:
+    CoMutex() : locked_(false) {}
+
+    // non-copyable
+    CoMutex(const CoMutex&) = delete;
+    CoMutex& operator=(const CoMutex&) = delete;
+
+    void Lock();
+
+    bool TryLock();
+
+    void Unlock();
+
+    // for std::lock_guard and std::unique_lock
+    void lock()
+    {
+        Lock();
+    }
+
+    bool try_lock()
+    {
+        return TryLock();
+    }
+
+    void unlock()
+    {
+        Unlock();
+    }
+
+private:
+    detail::SpinLock spin_;
+
+    bool locked_;
+
+    detail::WaitQueue waiters_;
+};
+
+class CoConditionVariable
+{
+public:
+    CoConditionVariable() = default;
+
+    // non-copyable
+    CoConditionVariable(const CoConditionVariable&) = delete;
+    CoConditionVariable& operator=(const CoConditionVariable&) = delete;
+
+    // mutex shall be locked by the caller, it is unlocked while waiting
+    void Wait(CoMutex& mutex);
+
+    template <typename Predicate>
+    void Wait(CoMutex& mutex, Predicate pred)
+    {
+        while (!pred())
+        {
+            Wait(mutex);
+        }
+    }
+
+    void NotifyOne();
+
+    void NotifyAll();
+
+private:
+    detail::SpinLock spin_;
+
+    detail::WaitQueue waiters_;
+};
+
+// A permit released while someone waits goes to the first waiter.
+class CoSemaphore
+{
+public:
+    explicit CoSemaphore(size_t count = 0) : count_(count) {}
+
+    // non-copyable
+    CoSemaphore(const CoSemaphore&) = delete;
+    CoSemaphore& operator=(const CoSemaphore&) = delete;
+
+    void Acquire();
+
+    bool TryAcquire();
+
+    void Release(size_t n = 1);
+
+private:
+    detail::SpinLock spin_;
+
+    size_t count_;
+
+    detail::WaitQueue waiters_;
+};
+
+// Like Go's sync.WaitGroup: Wait returns when as many Done as Add(n) are called.
+class WaitGroup
+{
+public:
+    WaitGroup() : count_(0) {}
+
+    // non-copyable
+    WaitGroup(const WaitGroup&) = delete;
+    WaitGroup& operator=(const WaitGroup&) = delete;
+
+    // throw if the counter goes negative
+    void Add(long n = 1);
+
+    void Done()
+    {
+        Add(-1);
+    }
+
+    void Wait();
+
+private:
+    detail::SpinLock spin_;
+
+    long count_;
+
+    detail::WaitQueue waiters_;
+};
+
+} // namespace asuka
+
+#endif //ASUKA_SYNC_H
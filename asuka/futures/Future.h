@@ -5,34 +5,86 @@
 #ifndef ASUKA_FUTURE_H
 #define ASUKA_FUTURE_H
 
-#include <mutex>
-#include <condition_variable>
+#include <stdint.h>
+#include <algorithm>
+#include <iterator>
 #include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
+#include <stdexcept>
+#include <thread>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <asuka/utils/Scheduler.h>
+#include <asuka/utils/Futex.h>
+#include <asuka/utils/InlineFunction.h>
+#include <asuka/utils/PoolAllocator.h>
 #include <asuka/futures/Helper.h>
+#include <asuka/futures/Stats.h>
 #include <asuka/futures/Try.h>
 
 namespace asuka
 {
 
+// the result of a cancelled future, see Future::Cancel
+class FutureCancelled : public std::runtime_error
+{
+public:
+    FutureCancelled() :
+        std::runtime_error("Future cancelled")
+    {}
+};
+
 namespace detail
 {
 
-enum class Progress
+// bits of State::progress_, the states are:
+//     kNone                             nothing yet
+//     kHasCallback                      Then is called, waiting for value
+//     kClaimed | kHasResult             value set, no one waits yet
+//     kHasCallback | kClaimed | kHasResult
+//                                       done, then_ is called by whom sets the last bit
+//     kClaimed | kTimeout               timed out, value and callback are ignored
+enum Progress : uint32_t
 {
-    kNone,
-    kTimeout,
-    kDone,
-    kRetrieved
+    kNone = 0,
+    kHasCallback = 1 << 0, // then_ is set by the future side
+    kClaimed = 1 << 1,     // a promise is setting value_, or timed out
+    kHasResult = 1 << 2,   // value_ is set
+    kTimeout = 1 << 3,
+    kRetrieved = 1 << 4,   // value_ is taken by Wait
+    kFutureRetrieved = 1 << 5,
+    kWaiting = 1 << 6      // Wait sleeps on progress_, SetResult wakes it
 };
 
+// pause iterations Wait spins before sleeping, adapted per thread:
+// doubled when the result comes while spinning, halved when it does not
+constexpr uint32_t kMinWaitSpins = 16;
+constexpr uint32_t kMaxWaitSpins = 8192;
+
+inline uint32_t& WaitSpins()
+{
+    static thread_local uint32_t spins = std::thread::hardware_concurrency() > 1 ? 256 : 0;
+    return spins;
+}
+
 using TimeoutCallback = std::function<void ()>;
 
+constexpr size_t kCacheLineSize = 64;
+
+// Shared by a promise and its future, no lock:
+// promise and future each write their own field then set their own bit by one atomic
+// fetch_or, the one who sees the other's bit already set calls then_.
+// Setting the value and attaching the callback never wait for each other.
+//
+// One block per promise/future pair, reference counted in place and recycled
+// through PoolAllocator. progress_, value_ and the invoker of then_ come first
+// to share the first cache line; the callback captures follow.
 template <typename T>
-struct State
+struct alignas(kCacheLineSize) State
 {
     static_assert(std::is_same_v<T, void> ||
                   std::is_copy_constructible_v<T> ||
@@ -41,237 +93,413 @@ struct State
 
     using ValueType = typename TryWrapper<T>::Type;
 
+    // fits what Then captures: scheduler, a small lambda and the next promise
+    static constexpr size_t kCallbackSize = 48;
+
     State() :
-        progress_(Progress::kNone),
-        retrieved_(false)
+        progress_(kNone),
+        refs_(1),
+        cancel_(nullptr)
+#ifdef ASUKA_FUTURE_STATS
+        , created_(StatsNow()),
+        depth_(0)
+#endif
     {}
 
-    Progress progress_;
-
-    std::atomic<bool> retrieved_;
-
-    ValueType value_;
-
-    std::mutex then_mutex_;
-
-    std::function<void (TimeoutCallback&& )> on_timeout_;
-
-    std::function<void (ValueType&& )> then_;
-
-};
-
-} // namespace detail
+    ~State()
+    {
+        if (CancelState* cancel = cancel_.load(std::memory_order_relaxed))
+        {
+            cancel->Release();
+        }
+    }
 
-template <typename T>
-class Future;
+    static State* Make()
+    {
+        void* p = PoolAllocator<State>().allocate(1);
+        return new (p) State();
+    }
 
-template <typename T>
-class Promise
-{
-public:
-    Promise() :
-        state_(std::make_shared<detail::State<T>>())
-    {}
+    void AddRef()
+    {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
 
-    // The lambda with movable capture can not be stored in
-    // std::function, just for compiler, do NOT copy Promise !!!!!!!!
-    Promise(const Promise&) = default;
-    Promise& operator=(const Promise&) = default;
+    void Release()
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            this->~State();
+            PoolAllocator<State>().deallocate(this, 1);
+        }
+    }
 
-    // Not always noexcept
-    Promise(Promise&& promise) = default;
-    Promise& operator=(Promise&& promise) = default;
+    // only the first setter wins, the value set later or after timeout is dropped
+    bool Claim()
+    {
+        return !(progress_.fetch_or(kClaimed, std::memory_order_acq_rel) & kClaimed);
+    }
 
-    void SetException(std::exception_ptr e)
+    // after Claim
+    void SetResult(ValueType&& value)
     {
+#ifdef ASUKA_FUTURE_STATS
+        FutureStats& stats = StatsRecorder::Local().stats;
+        stats.completion.Record(StatsNanosSince(created_));
+        stats.depth.Record(depth_);
+#endif
+        value_ = std::move(value);
+        uint32_t progress = progress_.fetch_or(kHasResult, std::memory_order_acq_rel);
+        if (progress & kWaiting)
         {
-            std::lock_guard<std::mutex> lock(state_->then_mutex_);
-            if (state_->progress_ != detail::Progress::kNone)
-            {
-                return;
-            }
-            state_->progress_ = detail::Progress::kDone;
-            state_->value_ = typename detail::State<T>::ValueType(std::move(e));
+            FutexWake(&progress_, 1);
         }
-        if (state_->then_)
+        if (progress & kHasCallback)
         {
-            state_->then_(std::move(state_->value_));
+            RunCallback();
         }
     }
 
-    template <typename U = T>
-    std::enable_if_t<!std::is_void_v<U>, void> SetValue(U&& u)
+    // blocks until value_ is set or OnTimeout fires, spinning a while first,
+    // false if timeout passes before
+    bool WaitResult(std::chrono::milliseconds timeout)
     {
-        // if ThenImpl is running, wait for the lock.
-        // After set then_, ThenImpl will release lock.
-        // and this func get lock, it will call then_.
+        uint32_t& spins = WaitSpins();
+        if (spins > 0)
         {
-            std::lock_guard<std::mutex> lock(state_->then_mutex_);
-            if (state_->progress_ != detail::Progress::kNone)
+            for (uint32_t i = 0; i < spins; ++i)
             {
-                return;
+                if (Has(kHasResult | kTimeout))
+                {
+                    spins = std::min(spins * 2, kMaxWaitSpins);
+                    return true;
+                }
+                CpuRelax();
             }
-            state_->progress_ = detail::Progress::kDone;
-            state_->value_ = std::forward<U>(u);
+            spins = std::max(spins / 2, kMinWaitSpins);
         }
-        // When reach here, state_ has been set, so mutex is useless
-        // if ThenImpl func runs, it'll see KDone state and
-        // call user callback there, not assign to then_
-        if (state_->then_)
+        uint32_t progress = progress_.fetch_or(kWaiting, std::memory_order_acq_rel) | kWaiting;
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!(progress & (kHasResult | kTimeout)))
         {
-            state_->then_(std::move(state_->value_));
+            auto left = deadline - std::chrono::steady_clock::now();
+            if (left <= std::chrono::steady_clock::duration::zero())
+            {
+                return false;
+            }
+            auto sec = std::chrono::duration_cast<std::chrono::seconds>(left);
+            struct timespec ts;
+            ts.tv_sec = static_cast<time_t>(sec.count());
+            ts.tv_nsec = static_cast<long>(std::chrono::duration_cast<std::chrono::nanoseconds>(left - sec).count());
+            FutexWait(&progress_, progress, &ts);
+            progress = progress_.load(std::memory_order_acquire);
         }
+        return true;
     }
 
-    template <typename U = T>
-    std::enable_if_t<!std::is_same_v<U, void>, void> SetValue(const U& u)
+    // func is called here if value has been set, otherwise by SetResult
+    template <typename F>
+    void SetCallback(F&& func)
     {
-        // if ThenImpl is running, wait for the lock.
-        // After set then_, ThenImpl will release lock.
-        // and this func get lock, it will call then_.
-        {
-            std::lock_guard<std::mutex> lock(state_->then_mutex_);
-            if (state_->progress_ != detail::Progress::kNone)
-            {
-                return;
-            }
-            state_->progress_ = detail::Progress::kDone;
-            state_->value_ = u;
-        }
-        // When reach here, state_ has been set, so mutex is useless
-        // if ThenImpl func runs, it'll see KDone state and
-        // call user callback there, not assign to then_
-        if (state_->then_)
+        then_.Emplace(std::forward<F>(func));
+        uint32_t progress = progress_.fetch_or(kHasCallback, std::memory_order_acq_rel);
+        if (progress & kHasResult)
         {
-            state_->then_(std::move(state_->value_));
+            RunCallback();
         }
     }
 
-    template <typename U = T>
-    std::enable_if_t<!std::is_same_v<U, void>, void> SetValue(Try<U>&& t)
+    // true if no value has been set
+    bool SetTimeout()
     {
-        // if ThenImpl is running, wait for the lock.
-        // After set then_, ThenImpl will release lock.
-        // and this func get lock, it will call then_.
+        uint32_t progress = progress_.load(std::memory_order_acquire);
+        while (!(progress & kClaimed))
         {
-            std::lock_guard<std::mutex> lock(state_->then_mutex_);
-            if (state_->progress_ != detail::Progress::kNone)
+            if (progress_.compare_exchange_weak(progress, progress | kClaimed | kTimeout,
+                                                std::memory_order_acq_rel))
             {
-                return;
+                if (progress & kWaiting)
+                {
+                    FutexWake(&progress_, 1);
+                }
+                return true;
             }
-            state_->progress_ = detail::Progress::kDone;
-            state_->value_ = std::forward<Try<U>>(t);
-        }
-        // When reach here, state_ has been set, so mutex is useless
-        // if ThenImpl func runs, it'll see KDone state and
-        // call user callback there, not assign to then_
-        if (state_->then_)
-        {
-            state_->then_(std::move(state_->value_));
         }
+        return false;
     }
 
-    template <typename U = T>
-    std::enable_if_t<!std::is_same_v<U, void>, void> SetValue(const Try<U>& t)
+    bool Has(uint32_t bits) const
     {
-        // if ThenImpl is running, wait for the lock.
-        // After set then_, ThenImpl will release lock.
-        // and this func get lock, it will call then_.
+        return progress_.load(std::memory_order_acquire) & bits;
+    }
+
+    // the CancelState of the chain, made by the first to ask,
+    // by the promise side or the future side
+    CancelState* Cancel()
+    {
+        CancelState* cancel = cancel_.load(std::memory_order_acquire);
+        if (cancel)
         {
-            std::lock_guard<std::mutex> lock(state_->then_mutex_);
-            if (state_->progress_ != detail::Progress::kNone)
-            {
-                return;
-            }
-            state_->progress_ = detail::Progress::kDone;
-            state_->value_ = t;
+            return cancel;
         }
-        // When reach here, state_ has been set, so mutex is useless
-        // if ThenImpl func runs, it'll see KDone state and
-        // call user callback there, not assign to then_
-        if (state_->then_)
+        CancelState* made = CancelState::Make();
+        if (cancel_.compare_exchange_strong(cancel, made, std::memory_order_acq_rel,
+                                            std::memory_order_acquire))
         {
-            state_->then_(std::move(state_->value_));
+            return made;
         }
+        made->Release();
+        return cancel;
     }
 
-    template <typename U = T>
-    std::enable_if_t<std::is_same_v<U, void>, void> SetValue(Try<void>&& )
+    // a new state of a Then joins the chain before anyone else sees it: its
+    // CancelState, none made on a ready state as nothing before is left to
+    // cancel, and its depth for FutureStats
+    template <typename U>
+    void LinkNext(State<U>* next)
     {
-        // if ThenImpl is running, wait for the lock.
-        // After set then_, ThenImpl will release lock.
-        // and this func get lock, it will call then_.
+        CancelState* cancel = Has(kHasResult) ? cancel_.load(std::memory_order_acquire) : Cancel();
+        if (cancel)
         {
-            std::lock_guard<std::mutex> lock(state_->then_mutex_);
-            if (state_->progress_ != detail::Progress::kNone)
-            {
-                return;
-            }
-            state_->progress_ = detail::Progress::kDone;
-            state_->value_ = Try<void>();
+            cancel->AddRef();
+            next->cancel_.store(cancel, std::memory_order_release);
         }
-        // When reach here, state_ has been set, so mutex is useless
-        // if ThenImpl func runs, it'll see KDone state and
-        // call user callback there, not assign to then_
-        if (state_->then_)
+#ifdef ASUKA_FUTURE_STATS
+        next->depth_ = depth_ + 1;
+#endif
+    }
+
+    bool IsCancelled() const
+    {
+        CancelState* cancel = cancel_.load(std::memory_order_acquire);
+        return cancel && cancel->IsCancelled();
+    }
+
+    // the captures, next promise included, are released as soon as it returns
+    void RunCallback()
+    {
+        then_(std::move(value_));
+        then_.Reset();
+    }
+
+    std::atomic<uint32_t> progress_;
+
+    std::atomic<uint32_t> refs_;
+
+    std::atomic<CancelState*> cancel_;
+
+    ValueType value_;
+
+    InlineFunction<kCallbackSize, void (ValueType&& )> then_;
+
+#ifdef ASUKA_FUTURE_STATS
+    // see FutureStats
+    uint64_t created_;
+
+    uint32_t depth_;
+#endif
+};
+
+// intrusive pointer to State, held by Promise, Future and callbacks
+template <typename T>
+class StatePtr
+{
+public:
+    StatePtr() :
+        state_(nullptr)
+    {}
+
+    // takes over the reference of a new state
+    explicit StatePtr(State<T>* state) :
+        state_(state)
+    {}
+
+    ~StatePtr()
+    {
+        if (state_)
         {
-            state_->then_(std::move(state_->value_));
+            state_->Release();
         }
     }
 
-    template <typename U = T>
-    std::enable_if_t<std::is_same_v<U, void>, void> SetValue(const Try<void>& )
+    StatePtr(const StatePtr& other) :
+        state_(other.state_)
     {
-        // if ThenImpl is running, wait for the lock.
-        // After set then_, ThenImpl will release lock.
-        // and this func get lock, it will call then_.
+        if (state_)
         {
-            std::lock_guard<std::mutex> lock(state_->then_mutex_);
-            if (state_->progress_ != detail::Progress::kNone)
-            {
-                return;
-            }
-            state_->progress_ = detail::Progress::kDone;
-            state_->value_ = Try<void>();
+            state_->AddRef();
         }
-        // When reach here, state_ has been set, so mutex is useless
-        // if ThenImpl func runs, it'll see KDone state and
-        // call user callback there, not assign to then_
-        if (state_->then_)
+    }
+
+    StatePtr& operator=(const StatePtr& other)
+    {
+        StatePtr(other).Swap(*this);
+        return *this;
+    }
+
+    StatePtr(StatePtr&& other) noexcept :
+        state_(other.state_)
+    {
+        other.state_ = nullptr;
+    }
+
+    StatePtr& operator=(StatePtr&& other) noexcept
+    {
+        StatePtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    void Swap(StatePtr& other) noexcept
+    {
+        std::swap(state_, other.state_);
+    }
+
+    State<T>* operator->() const
+    {
+        return state_;
+    }
+
+    State<T>* get() const
+    {
+        return state_;
+    }
+
+    explicit operator bool() const
+    {
+        return state_ != nullptr;
+    }
+
+private:
+    State<T>* state_;
+};
+
+// Then runs a continuation for a scheduler inline when the scheduler is
+// current, which nests on the stack of SetValue, so the nesting is bounded.
+constexpr int kMaxInlineDepth = 32;
+
+inline int& InlineDepth()
+{
+    static thread_local int depth = 0;
+    return depth;
+}
+
+inline bool CanRunInline(Scheduler* sched)
+{
+    return InlineDepth() < kMaxInlineDepth && sched->IsCurrent();
+}
+
+// an inline run for sched
+class InlineScope
+{
+public:
+    explicit InlineScope(Scheduler* sched)
+    {
+        sched->AddHopSaved();
+        ++InlineDepth();
+    }
+
+    ~InlineScope()
+    {
+        --InlineDepth();
+    }
+
+    // non-copyable
+    InlineScope(const InlineScope&) = delete;
+    InlineScope& operator=(const InlineScope&) = delete;
+};
+
+// Call f with the argument type Then resolves for it.
+// f not taking Try is not called for an exception, which is passed on.
+template <typename F, typename T>
+typename TryWrapper<ResultOf<F>>::Type
+InvokeThen(F& f, Try<T>&& t, ResultOfWrapper<F>)
+{
+    using ResultType = typename TryWrapper<ResultOf<F>>::Type;
+    if (t.HasException())
+    {
+        return ResultType(std::move(t).Exception());
+    }
+    return WrapWithTry(f);
+}
+
+template <typename F, typename T, typename Arg>
+typename TryWrapper<ResultOf<F, Arg>>::Type
+InvokeThen(F& f, Try<T>&& t, ResultOfWrapper<F, Arg>)
+{
+    using ResultType = typename TryWrapper<ResultOf<F, Arg>>::Type;
+    if constexpr (IsTry<std::decay_t<Arg>>::value)
+    {
+        return WrapWithTry(f, std::move(t));
+    }
+    else
+    {
+        if (t.HasException())
         {
-            state_->then_(std::move(state_->value_));
+            return ResultType(std::move(t).Exception());
         }
+        return WrapWithTry(f, std::forward<Arg>(t.Value()));
+    }
+}
+
+// A stage of a cancelled chain is dropped without running,
+// its output gets FutureCancelled, which is dropped too if it has been cancelled.
+template <typename P>
+bool DropIfCancelled(P& prom)
+{
+    if (!prom.IsCancelled())
+    {
+        return false;
+    }
+    prom.SetException(std::make_exception_ptr(FutureCancelled()));
+    return true;
+}
+
+} // namespace detail
+
+template <typename T>
+class Future;
+
+template <typename T>
+class Promise
+{
+public:
+    using ValueType = typename detail::State<T>::ValueType;
+
+    Promise() :
+        state_(detail::State<T>::Make())
+    {}
+
+    // The lambda with movable capture can not be stored in
+    // std::function, just for compiler, do NOT copy Promise !!!!!!!!
+    Promise(const Promise&) = default;
+    Promise& operator=(const Promise&) = default;
+
+    // Not always noexcept
+    Promise(Promise&& promise) = default;
+    Promise& operator=(Promise&& promise) = default;
+
+    void SetException(std::exception_ptr e)
+    {
+        SetTry(ValueType(std::move(e)));
+    }
+
+    // value of T, or Try<T>
+    template <typename U>
+    void SetValue(U&& value)
+    {
+        SetTry(ValueType(std::forward<U>(value)));
     }
 
     template <typename U = T>
-    std::enable_if_t<std::is_same_v<U, void>, void> SetValue()
+    std::enable_if_t<std::is_void_v<U>, void> SetValue()
     {
-        // if ThenImpl is running, wait for the lock.
-        // After set then_, ThenImpl will release lock.
-        // and this func get lock, it will call then_.
-        {
-            std::lock_guard<std::mutex> lock(state_->then_mutex_);
-            if (state_->progress_ != detail::Progress::kNone)
-            {
-                return;
-            }
-            state_->progress_ = detail::Progress::kDone;
-            state_->value_ = Try<void>();
-        }
-        // When reach here, state_ has been set, so mutex is useless
-        // if ThenImpl func runs, it'll see KDone state and
-        // call user callback there, not assign to then_
-        if (state_->then_)
-        {
-            state_->then_(std::move(state_->value_));
-        }
+        SetTry(ValueType());
     }
 
     Future<T> GetFuture()
     {
-        bool expect = false;
-        // FIXME: memory order relaxed ?
-        if (!state_->retrieved_.compare_exchange_strong(expect, true))
+        if (state_->progress_.fetch_or(detail::kFutureRetrieved, std::memory_order_acq_rel) &
+            detail::kFutureRetrieved)
         {
             throw std::runtime_error("Future already retrieved");
         }
@@ -280,11 +508,36 @@ public:
 
     bool IsReady() const
     {
-        return state_->progress_ != detail::Progress::kNone;
+        return state_->Has(detail::kHasResult);
+    }
+
+    // Cooperative cancellation, for the producer to stop early: handler runs
+    // once in the thread calling Future::Cancel on this promise's future or on
+    // any future of the Thens after it, right here if that has been done.
+    // Any number of handlers can be set.
+    void SetInterruptHandler(std::function<void ()> handler)
+    {
+        state_->Cancel()->AddHandler(std::move(handler));
+    }
+
+    // true once the chain is cancelled, for a producer to poll
+    bool IsCancelled() const
+    {
+        return state_->IsCancelled();
+    }
+
+private:
+    void SetTry(ValueType&& value)
+    {
+        // ignored if set already or timed out
+        if (state_->Claim())
+        {
+            state_->SetResult(std::move(value));
+        }
     }
 
 private:
-    std::shared_ptr<detail::State<T>> state_;
+    detail::StatePtr<T> state_;
 };
 
 template <typename T2>
@@ -297,8 +550,16 @@ public:
     template<typename U>
     friend class Future;
 
+    template <typename U, typename F>
+    friend void detail::AttachCallback(Future<U>& fut, F&& func);
+
+    template <typename U>
+    friend detail::CancelState* detail::CancelOf(Future<U>& fut);
+
     using InnerType = T;
 
+    using ValueType = typename detail::State<T>::ValueType;
+
     Future() = default;
 
     // non-copyable
@@ -311,59 +572,66 @@ public:
 
     Future& operator=(Future&& fut) = default;
 
-    explicit Future(std::shared_ptr<detail::State<T>> state) :
+    explicit Future(detail::StatePtr<T> state) :
         state_(std::move(state))
     {}
 
+    bool IsReady() const
+    {
+        return state_->Has(detail::kHasResult);
+    }
+
     // Attention: deadlock !!!
     // Wait thread shall NOT be same Promise thread !!!
-    typename detail::State<T>::ValueType
-    Wait(const std::chrono::milliseconds& timeout = std::chrono::milliseconds(24 * 3600 * 1000))
+    ValueType Wait(const std::chrono::milliseconds& timeout = std::chrono::milliseconds(24 * 3600 * 1000))
     {
+        uint32_t progress = state_->progress_.fetch_or(detail::kRetrieved, std::memory_order_acq_rel);
+        if (progress & detail::kRetrieved)
         {
-            std::lock_guard<std::mutex> lock(state_->then_mutex_);
-            switch (state_->progress_)
-            {
-                case detail::Progress::kNone:
-                    break;
-                case detail::Progress::kTimeout:
-                    throw std::runtime_error("Future timeout");
-                case detail::Progress::kDone:
-                    state_->progress_ = detail::Progress::kRetrieved;
-                    return std::move(state_->value_);
-                default:
-                    throw std::runtime_error("Future already retrieved");
-            }
+            throw std::runtime_error("Future already retrieved");
         }
-        // avoid invalid reference in Then lambda capture list
-        std::shared_ptr<std::condition_variable> cond(std::make_shared<std::condition_variable>());
-        std::shared_ptr<std::mutex> mutex(std::make_shared<std::mutex>());
-        bool ready = false;
-        typename detail::State<T>::ValueType value;
-        this->Then([&value, &ready,
-                       wcond = std::weak_ptr<std::condition_variable>(cond),
-                       wmutex = std::weak_ptr<std::mutex>(mutex)](typename detail::State<T>::ValueType&& v) {
-            std::shared_ptr<std::condition_variable> cond1 = wcond.lock();
-            std::shared_ptr<std::mutex> mutex1 = wmutex.lock();
-            if (!cond1 || !mutex1)
-            {
-                return;
-            }
-            std::lock_guard<std::mutex> lock(*mutex1);
-            value = std::move(v);
-            ready = true;
-            cond1->notify_one();
-        });
-        std::unique_lock<std::mutex> lock2(*mutex);
-        // no need for while the wait_for deal spurious awakenings
-        bool success = cond->wait_for(lock2, timeout, [&ready] { return ready; });
-        if (success)
+        if (progress & detail::kHasResult)
+        {
+            return std::move(state_->value_);
+        }
+        if (progress & detail::kTimeout)
         {
-            return std::move(value);
-        } else
+            throw std::runtime_error("Future timeout");
+        }
+        if (progress & detail::kHasCallback)
+        {
+            throw std::runtime_error("Future already has a callback");
+        }
+        if (!state_->WaitResult(timeout))
         {
             throw std::runtime_error("Future wait_for timeout");
         }
+        if (!state_->Has(detail::kHasResult))
+        {
+            throw std::runtime_error("Future timeout");
+        }
+        return std::move(state_->value_);
+    }
+
+    // Cancels the chain of Thens this future is in: the interrupt handlers of
+    // its promises run here, the callbacks of the chain not run yet are dropped
+    // with their captures when the values before them come, without running.
+    // The inner futures returned by callbacks
+    // are cancelled too. This future gets FutureCancelled unless it has a value,
+    // the futures after it get FutureCancelled.
+    // NOTE: a producer ignoring it still runs, but its result goes nowhere.
+    void Cancel()
+    {
+        state_->Cancel()->Cancel();
+        if (state_->Claim())
+        {
+            state_->SetResult(ValueType(std::make_exception_ptr(FutureCancelled())));
+        }
+    }
+
+    bool IsCancelled() const
+    {
+        return state_->IsCancelled();
     }
 
     // T is of type Future<InnerType>
@@ -372,44 +640,31 @@ public:
     {
         using Inner = typename detail::IsFuture<U>::Inner;
         static_assert(std::is_same_v<U, Future<Inner>>, "U is same Future<InnerType>");
-        Promise<Inner> promise;
-        Future<Inner> future = promise.GetFuture();
-
-        std::lock_guard<std::mutex> lock(state_->then_mutex_);
-        if (state_->progress_ == detail::Progress::kTimeout)
+        if (state_->Has(detail::kTimeout))
         {
             throw std::runtime_error("Wrong state: Timeout");
-        } else if (state_->progress_ == detail::Progress::kDone)
-        {
-            try
-            {
-                auto inner_future = std::move(state_->value_);
-                return std::move(inner_future.Value());
-            }
-            catch (const std::exception& e)
+        }
+        Promise<Inner> promise;
+        Future<Inner> future = promise.GetFuture();
+        state_->LinkNext(future.state_.get());
+        SetCallback([pm = std::move(promise)](typename TryWrapper<U>::Type&& outer) mutable {
+            if (outer.HasException())
             {
-                return MakeExceptionFuture<Inner>(std::current_exception());
+                pm.SetException(std::move(outer).Exception());
+                return;
             }
-        } else
-        {
-            SetCallback([pm = std::move(promise)](typename TryWrapper<U>::Type&& inner_fut) mutable {
-                try
-                {
-                    U fut = std::move(inner_fut);
-                    fut.SetCallback([pm = std::move(pm)](typename TryWrapper<Inner>::Type&& t) mutable {
-                        // No need scheduler here, think about following code
-                        // outer.Unwrap().Then(sched, func);
-                        // outer.Unwrap() is the inner future, the below line
-                        // will trigger func in sched thread
-                        pm.SetValue(std::move(t));
-                    });
-                }
-                catch (...)
-                {
-                    pm.SetException(std::current_exception());
-                }
+            U inner = std::move(outer).Value();
+            // cancelling the chain of the outer cancels the inner one
+            detail::CancelPtr inner_cancel(inner.state_->Cancel());
+            pm.SetInterruptHandler([inner_cancel] { inner_cancel->Cancel(); });
+            // No need scheduler here, think about following code
+            // outer.Unwrap().Then(sched, func);
+            // outer.Unwrap() is the inner future, the below line
+            // will trigger func in sched thread
+            inner.SetCallback([pm = std::move(pm)](typename TryWrapper<Inner>::Type&& t) mutable {
+                pm.SetValue(std::move(t));
             });
-        }
+        });
         return future;
     }
 
@@ -420,7 +675,7 @@ public:
         return ThenImpl<F, R>(nullptr, std::forward<F>(f), Arguments());
     }
 
-    // f will be called in sched
+    // f will be called in sched, right away if sched is current
     template<typename F, typename R = detail::CallableResult<F, T>>
     typename R::ReturnFutureType Then(Scheduler* sched, F&& f)
     {
@@ -435,63 +690,50 @@ public:
     {
         static_assert(sizeof...(Args) <= 1, "Then must take zero or one argument");
         using FReturnType = typename R::IsReturnFuture::Inner;
-        Promise<FReturnType> pm;
-        auto next_future = pm.GetFuture();
         using FuncType = std::decay_t<F>;
-        std::unique_lock<std::mutex> lock(state_->then_mutex_);
-        if (state_->progress_ == detail::Progress::kTimeout)
+        using Arguments = detail::ResultOfWrapper<FuncType, Args...>;
+        if (state_->Has(detail::kTimeout))
         {
             throw std::runtime_error("Wrong state: timeout");
-        } else if (state_->progress_ == detail::Progress::kDone)
-        {
-            typename TryWrapper<T>::Type t;
-            try
+        }
+        Promise<FReturnType> pm;
+        auto next_future = pm.GetFuture();
+        state_->LinkNext(next_future.state_.get());
+        // called at once if the value is ready, otherwise by SetValue
+        SetCallback([sched,
+                        func = FuncType(std::forward<F>(f)),
+                        prom = std::move(pm)](ValueType&& t) mutable {
+            if (detail::DropIfCancelled(prom))
             {
-                t = std::move(state_->value_);
+                return;
             }
-            catch (const std::exception& e)
+            if (sched == nullptr)
             {
-                t = static_cast<typename TryWrapper<T>::Type>(std::current_exception());
+                // run callback, T can be void, and set next future's result
+                prom.SetValue(detail::InvokeThen(func, std::move(t), Arguments()));
             }
-            lock.unlock();
-            if (sched)
-            {
-                sched->Schedule([t2 = std::move(t),
-                                    f2 = std::forward<FuncType>(f),
-                                    pm2 = std::move(pm)]() mutable {
-                    auto result = WrapWithTry(f2, std::move(t2));
-                    pm2.SetValue(std::move(result));
-                });
-            } else
+            else if (detail::CanRunInline(sched))
             {
-                auto result = WrapWithTry(f, std::move(t));
-                pm.SetValue(std::move(result));
+                // already in sched, no need to go through its queue
+                detail::InlineScope scope(sched);
+                prom.SetValue(detail::InvokeThen(func, std::move(t), Arguments()));
             }
-        } else
-        {
-            // set this futures's then callback
-            SetCallback([sched,
-                            func = std::forward<FuncType>(f),
-                            prom = std::move(pm)](typename TryWrapper<T>::Type&& t) mutable {
-                if (sched)
-                {
-                    sched->Schedule([func3 = std::move(func),
-                                        t3 = std::move(t),
-                                        prom3 = std::move(prom)]() mutable {
-                        // run callback, T can be void
-                        auto result = WrapWithTry(func, std::move(t3));
-                        prom3.SetValue(std::move(result));
-                    });
-                } else
-                {
+            else
+            {
+                sched->Schedule(detail::StampQueued([func3 = std::move(func),
+                                                     t3 = std::move(t),
+                                                     prom3 = std::move(prom)]() mutable {
+                    // may be cancelled while queued
+                    if (detail::DropIfCancelled(prom3))
+                    {
+                        return;
+                    }
                     // run callback, T can be void
-                    auto result = WrapWithTry(func, std::move(t));
-                    // set next future's result
-                    prom.SetValue(std::move(result));
-                }
-            });
-        }
-        return std::move(next_future);
+                    prom3.SetValue(detail::InvokeThen(func3, std::move(t3), Arguments()));
+                }));
+            }
+        });
+        return next_future;
     }
 
     // 2. F return another future type
@@ -501,139 +743,57 @@ public:
     {
         static_assert(sizeof...(Args) <= 1, "Then must take zero or one argument");
         using FReturnType = typename R::IsReturnFuture::Inner;
-        Promise<FReturnType> pm;
-        auto next_future = pm.GetFuture();
         using FuncType = std::decay_t<F>;
-        std::unique_lock<std::mutex> lock(state_->then_mutex_);
-        if (state_->progress_ == detail::Progress::kTimeout)
+        using Arguments = detail::ResultOfWrapper<FuncType, Args...>;
+        if (state_->Has(detail::kTimeout))
         {
             throw std::runtime_error("Wrong state: Timeout");
         }
-        else if (state_->progress_ == detail::Progress::kDone)
+        Promise<FReturnType> pm;
+        auto next_future = pm.GetFuture();
+        state_->LinkNext(next_future.state_.get());
+        SetCallback([sched, func = FuncType(std::forward<F>(f)), prom = std::move(pm)]
+            (ValueType&& t) mutable
         {
-            typename TryWrapper<T>::Type t;
-            try
+            auto cb = [func = std::move(func), t = std::move(t), prom = std::move(prom)] () mutable
             {
-                t = std::move(state_->value_);
-            }
-            catch (const std::exception& e)
+                if (detail::DropIfCancelled(prom))
+                {
+                    return;
+                }
+                // because func return another future: innerFuture,
+                // when innerFuture is done, next future can be done
+                auto inner = detail::InvokeThen(func, std::move(t), Arguments());
+                if (inner.HasException())
+                {
+                    prom.SetException(std::move(inner).Exception());
+                    return;
+                }
+                Future<FReturnType> inner_future = std::move(inner).Value();
+                // cancelling this chain cancels the inner one
+                detail::CancelPtr inner_cancel(inner_future.state_->Cancel());
+                prom.SetInterruptHandler([inner_cancel] { inner_cancel->Cancel(); });
+                inner_future.SetCallback([prom = std::move(prom)]
+                    (typename TryWrapper<FReturnType>::Type&& t3) mutable
+                {
+                    prom.SetValue(std::move(t3));
+                });
+            };
+            if (sched == nullptr)
             {
-                t = decltype(t)(std::current_exception());
+                cb();
             }
-            lock.unlock();
-            auto cb =
-                   [res = std::move(t),
-                   f2 = std::forward<FuncType>(f),
-                   prom = std::move(pm)]() mutable
-                   {
-                   // because func return another future: innerFuture,
-                   // when innerFuture is done, next future can be done
-                       decltype(f2(res.template Get<Args>()...)) inner_future;
-                       if (res.HasException())
-                       {
-                           // FIXME: Failed if Args... is void
-                           inner_future = f2(typename TryWrapper<std::decay_t<Args>...>::Type(res.Exception()));
-                       }
-                       else
-                       {
-                           inner_future = f2(res.template Get<Args>...);
-                       }
-                       std::unique_lock<std::mutex> lock2(inner_future.state_->then_mutex_);
-                       if (inner_future.state_->progress == detail::Progress::kTimeout)
-                       {
-                           throw std::runtime_error("Wrong state: Timeout");
-                       }
-                       else if (inner_future.state_->progress == detail::Progress::kDone)
-                       {
-                           typename TryWrapper<FReturnType>::Type t3;
-                           try
-                           {
-                               t3 = std::move(inner_future.state_->value_);
-                           }
-                           catch (const std::exception& e)
-                           {
-                               t3 = decltype(t)(std::current_exception());
-                           }
-                           lock2.unlock();
-                           prom.SetValue(std::move(t3));
-                       }
-                       else
-                       {
-                           inner_future.SetCallback([prom = std::move(prom)]
-                                        (typename TryWrapper<FReturnType>::Type&& t) mutable
-                                        {
-                                            prom.SetValue(std::move(t));
-                                        });
-                       }
-               };
-            if (sched)
+            else if (detail::CanRunInline(sched))
             {
-                sched->Schedule(std::move(cb));
+                detail::InlineScope scope(sched);
+                cb();
             }
             else
             {
-                cb();
+                sched->Schedule(detail::StampQueued(std::move(cb)));
             }
-        }
-        else
-        {
-            // set this future's then callback
-            SetCallback([sched = sched, func = std::forward<FuncType>(f), prom = std::move(pm)]
-             (typename TryWrapper<T>::Type&& t) mutable
-             {
-                 auto cb = [func = std::move(func), t = std::move(t), prom = std::move(prom)] () mutable
-                 {
-                     // because func return another future: innerFuture,
-                     // when innerFuture is done, next future can be done
-                     decltype(func(t.template Get<Args>()...)) inner_future;
-                     if (t.HasException())
-                     {
-                         // FIXME: Failed if Args... is void
-                         inner_future = func(typename TryWrapper<std::decay_t<Args>...>::Type(t.Exception()));
-                     }
-                     else
-                     {
-                         inner_future = func(t.template Get<Args>()...);
-                     }
-                     std::unique_lock<std::mutex> lock3(inner_future.state_->then_mutex_);
-                     if (inner_future.state_->progress == detail::Progress::kTimeout)
-                     {
-                         throw std::runtime_error("Wrong state: Timeout");
-                     }
-                     else if (inner_future.state_->progress == detail::Progress::kDone)
-                     {
-                         typename TryWrapper<FReturnType>::Type t3;
-                         try
-                         {
-                             t3 = std::move(inner_future.state_->value_);
-                         }
-                         catch (const std::exception& e)
-                         {
-                             t3 = decltype(t3)(std::current_exception());
-                         }
-                         lock3.unlock();
-                         prom.SetValue(std::move(t3));
-                     }
-                     else
-                     {
-                         inner_future.SetCallback([prom = std::move(prom)]
-                                      (typename TryWrapper<FReturnType>::Type&& t) mutable
-                                      {
-                                          prom.SetValue(std::move(t));
-                                      });
-                     }
-                 };
-                 if (sched)
-                 {
-                     sched->Schedule(std::move(cb));
-                 }
-                 else
-                 {
-                     cb();
-                 }
-             });
-        }
-        return std::move(next_future);
+        });
+        return next_future;
     }
 
     // When register callbacks and timeout for a future like this:
@@ -655,34 +815,27 @@ public:
 
     void OnTimeout(std::chrono::milliseconds duration, detail::TimeoutCallback f, Scheduler* sched)
     {
-        sched->SchedulerLater(duration, [state_ = state_, cb = std::move(f)]() mutable
+        sched->SchedulerLater(duration, [state = state_, cb = std::move(f)]() mutable
         {
-            std::unique_lock<std::mutex> lock(state_->then_mutex_);
-            if (state_->progress_ == detail::Progress::kNone)
+            // a value set before wins
+            if (state->SetTimeout())
             {
-                return;;
+                cb();
             }
-            state_->progress_ = detail::Progress::kTimeout;
-            lock.unlock();
-            cb();
         });
     }
 
 private:
 
-    void SetCallback(std::function<void (typename TryWrapper<T>::Type&& )>&& func)
-    {
-        state_->then_ = std::move(func);
-    }
-
-    void SetOnTimeout(std::function<void (detail::TimeoutCallback&& )>&& func)
+    template <typename F>
+    void SetCallback(F&& func)
     {
-        state_->on_timeout_ = std::move(func);
+        state_->SetCallback(std::forward<F>(func));
     }
 
 
 private:
-    std::shared_ptr<detail::State<T>> state_;
+    detail::StatePtr<T> state_;
 }; // class Future
 
 // Make ready future
@@ -720,19 +873,338 @@ inline Future<T2> MakeExceptionFuture(std::exception_ptr& eptr)
     return pm.GetFuture();
 }
 
-// TODO
+namespace detail
+{
 
-// WhenAll
+template <typename T, typename F>
+void AttachCallback(Future<T>& fut, F&& func)
+{
+    fut.SetCallback(std::forward<F>(func));
+}
 
-// WhenAny
+template <typename T>
+CancelState* CancelOf(Future<T>& fut)
+{
+    return fut.state_->Cancel();
+}
 
-// WhenN
+} // namespace detail
 
-// WhenIfAny
+// Collect all results, in the order of the futures.
+// The futures are moved from, the range is walked once.
+template <typename InputIterator,
+          typename T = typename std::iterator_traits<InputIterator>::value_type::InnerType>
+std::enable_if_t<!detail::IsFuture<InputIterator>::value,
+                 Future<std::vector<typename TryWrapper<T>::Type>>>
+WhenAll(InputIterator first, InputIterator last)
+{
+    using TryType = typename TryWrapper<T>::Type;
+    std::vector<Future<T>> futures;
+    for (; first != last; ++first)
+    {
+        futures.push_back(std::move(*first));
+    }
+    if (futures.empty())
+    {
+        return MakeReadyFuture(std::vector<TryType>());
+    }
+    auto ctx = std::make_shared<detail::CollectAllContext<T>>(futures.size());
+    auto future = ctx->pm.GetFuture();
+    for (size_t i = 0; i < futures.size(); ++i)
+    {
+        detail::AttachCallback(futures[i], [ctx, i](TryType&& t) {
+            ctx->SetResult(i, std::move(t));
+        });
+    }
+    return future;
+}
 
-// WhenIfN
+// Collect all results into a tuple of Try, an empty tuple at once for none
+template <typename... FT>
+std::enable_if_t<(detail::IsFuture<std::decay_t<FT>>::value && ...),
+                 typename detail::CollectAllVariadicContext<typename std::decay_t<FT>::InnerType...>::FutureType>
+WhenAll(FT&&... futures)
+{
+    if constexpr (sizeof...(FT) == 0)
+    {
+        // nothing would count remaining down
+        return MakeReadyFuture(std::tuple<>());
+    }
+    else
+    {
+        auto ctx = std::make_shared<detail::CollectAllVariadicContext<typename std::decay_t<FT>::InnerType...>>();
+        auto future = ctx->pm.GetFuture();
+        detail::CollectVariadicHelper<detail::CollectAllVariadicContext>(ctx, std::forward<FT>(futures)...);
+        return future;
+    }
+}
 
+// The first result and its index, the others are dropped.
+// An empty range gives an exception.
+template <typename InputIterator,
+          typename T = typename std::iterator_traits<InputIterator>::value_type::InnerType>
+std::enable_if_t<!detail::IsFuture<InputIterator>::value,
+                 Future<std::pair<size_t, typename TryWrapper<T>::Type>>>
+WhenAny(InputIterator first, InputIterator last)
+{
+    using TryType = typename TryWrapper<T>::Type;
+    if (first == last)
+    {
+        return MakeExceptionFuture<std::pair<size_t, TryType>>(std::runtime_error("WhenAny: no future"));
+    }
+    auto ctx = std::make_shared<detail::CollectAnyContext<T>>();
+    auto future = ctx->pm.GetFuture();
+    std::vector<Future<T>> futures;
+    for (; first != last; ++first)
+    {
+        futures.push_back(std::move(*first));
+        ctx->inputs.emplace_back(detail::CancelOf(futures.back()));
+    }
+    // cancelling the result cancels all
+    ctx->pm.SetInterruptHandler([weak = std::weak_ptr<detail::CollectAnyContext<T>>(ctx)] {
+        if (auto c = weak.lock())
+        {
+            c->CancelOthers(SIZE_MAX);
+        }
+    });
+    for (size_t i = 0; i < futures.size(); ++i)
+    {
+        detail::AttachCallback(futures[i], [ctx, i](TryType&& t) {
+            ctx->SetResult(i, std::move(t));
+        });
+    }
+    return future;
+}
 
+// futures of the same type
+template <typename F, typename... FT>
+std::enable_if_t<detail::IsFuture<std::decay_t<F>>::value &&
+                 (std::is_same_v<std::decay_t<F>, std::decay_t<FT>> && ...),
+                 Future<std::pair<size_t, typename TryWrapper<typename std::decay_t<F>::InnerType>::Type>>>
+WhenAny(F&& future, FT&&... futures)
+{
+    using T = typename std::decay_t<F>::InnerType;
+    using TryType = typename TryWrapper<T>::Type;
+    auto ctx = std::make_shared<detail::CollectAnyContext<T>>();
+    auto result = ctx->pm.GetFuture();
+    ctx->inputs.emplace_back(detail::CancelOf(future));
+    (ctx->inputs.emplace_back(detail::CancelOf(futures)), ...);
+    ctx->pm.SetInterruptHandler([weak = std::weak_ptr<detail::CollectAnyContext<T>>(ctx)] {
+        if (auto c = weak.lock())
+        {
+            c->CancelOthers(SIZE_MAX);
+        }
+    });
+    size_t i = 0;
+    auto attach = [&ctx, &i](Future<T>& fut) {
+        detail::AttachCallback(fut, [ctx, index = i++](TryType&& t) {
+            ctx->SetResult(index, std::move(t));
+        });
+    };
+    attach(future);
+    (attach(futures), ...);
+    return result;
+}
+
+// The first n results with their indexes, in the order they complete.
+// n larger than the range is cut to its size. The range is walked once.
+template <typename InputIterator,
+          typename T = typename std::iterator_traits<InputIterator>::value_type::InnerType>
+Future<std::vector<std::pair<size_t, typename TryWrapper<T>::Type>>>
+WhenN(size_t n, InputIterator first, InputIterator last)
+{
+    using TryType = typename TryWrapper<T>::Type;
+    std::vector<Future<T>> futures;
+    for (; n > 0 && first != last; ++first)
+    {
+        futures.push_back(std::move(*first));
+    }
+    n = std::min(n, futures.size());
+    if (n == 0)
+    {
+        return MakeReadyFuture(std::vector<std::pair<size_t, TryType>>());
+    }
+    auto ctx = std::make_shared<detail::CollectNContext<T>>(n);
+    auto future = ctx->pm.GetFuture();
+    for (auto& fut : futures)
+    {
+        ctx->inputs.emplace_back(detail::CancelOf(fut));
+    }
+    ctx->pm.SetInterruptHandler([weak = std::weak_ptr<detail::CollectNContext<T>>(ctx)] {
+        if (auto c = weak.lock())
+        {
+            c->CancelUnless(std::vector<bool>());
+        }
+    });
+    for (size_t i = 0; i < futures.size(); ++i)
+    {
+        detail::AttachCallback(futures[i], [ctx, i](TryType&& t) {
+            ctx->SetResult(i, std::move(t));
+        });
+    }
+    return future;
+}
+
+// what the Hedges given it did, updated from any thread;
+// the first attempts won the others: requests - backup_won
+struct HedgeStats
+{
+    std::atomic<uint64_t> requests{0};
+
+    // backups made because the first attempt was late
+    std::atomic<uint64_t> hedged{0};
+
+    std::atomic<uint64_t> backup_won{0};
+};
+
+namespace detail
+{
+
+// the first attempt, and the backup made when the timer fires before the
+// first completes: the first result wins, the other attempt is cancelled
+template <typename T, typename F>
+struct HedgeContext
+{
+    using TryType = typename TryWrapper<T>::Type;
+
+    HedgeContext(F&& make, HedgeStats* hedge_stats) :
+        done(false),
+        launched(false),
+        make_backup(std::move(make)),
+        stats(hedge_stats)
+    {}
+
+    // non-copyable
+    HedgeContext(const HedgeContext&) = delete;
+    HedgeContext& operator=(const HedgeContext&) = delete;
+
+    Promise<T> pm;
+    // done and launched are seq_cst: the winner and the timer making the
+    // backup meanwhile each set one then read the other, one of them cancels it
+    std::atomic<bool> done;
+    std::atomic<bool> launched;
+    F make_backup;
+    HedgeStats* stats;
+    CancelPtr first;
+    // written before launched is set
+    CancelPtr backup;
+
+    // attempt 0 is the first, 1 the backup
+    void SetResult(size_t attempt, TryType&& t)
+    {
+        if (done.exchange(true))
+        {
+            return;
+        }
+        if (attempt == 1 && stats)
+        {
+            stats->backup_won.fetch_add(1, std::memory_order_relaxed);
+        }
+        // the loser first, cancelled by the time a waiter sees the result
+        if (attempt == 1)
+        {
+            first->Cancel();
+        }
+        else if (launched.load())
+        {
+            backup->Cancel();
+        }
+        pm.SetValue(std::move(t));
+    }
+
+    // no backup is made after it
+    void CancelAll()
+    {
+        done.store(true);
+        first->Cancel();
+        if (launched.load())
+        {
+            backup->Cancel();
+        }
+    }
+};
+
+} // namespace detail
+
+// Hedged request, to cut the tail latency of slow replicas: the result of
+// first, unless it is not done within delay, then make_backup() makes a
+// second attempt and whichever completes first, with a value or an
+// exception, is the result. The other attempt is cancelled, without
+// allocating or waiting for it. The delay is a sched->SchedulerLater and
+// make_backup runs in sched, Hedge is called where the requests to sched are
+// submitted.
+// A make_backup throwing leaves the first attempt alone.
+//
+//     Hedge(Query(replica_a), std::chrono::milliseconds(10),
+//           [] { return Query(replica_b); }, &loop, &hedge_stats);
+template <typename T, typename F>
+Future<T> Hedge(Future<T> first, std::chrono::milliseconds delay, F&& make_backup, Scheduler* sched,
+                HedgeStats* stats = nullptr)
+{
+    using Context = detail::HedgeContext<T, std::decay_t<F>>;
+    using TryType = typename Context::TryType;
+    static_assert(std::is_same_v<std::invoke_result_t<std::decay_t<F>&>, Future<T>>,
+                  "make_backup returns a Future of the same type");
+    if (stats)
+    {
+        stats->requests.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (first.IsReady())
+    {
+        return first;
+    }
+    auto ctx = std::make_shared<Context>(std::decay_t<F>(std::forward<F>(make_backup)), stats);
+    auto future = ctx->pm.GetFuture();
+    ctx->first = detail::CancelPtr(detail::CancelOf(first));
+    // cancelling the result cancels both
+    ctx->pm.SetInterruptHandler([weak = std::weak_ptr<Context>(ctx)] {
+        if (auto c = weak.lock())
+        {
+            c->CancelAll();
+        }
+    });
+    // the timer holds no reference, the context goes with the attempts
+    sched->SchedulerLater(delay, [weak = std::weak_ptr<Context>(ctx)] {
+        auto c = weak.lock();
+        if (!c || c->done.load())
+        {
+            return;
+        }
+        Future<T> backup;
+        try
+        {
+            backup = c->make_backup();
+        }
+        catch (...)
+        {
+            return;
+        }
+        if (c->stats)
+        {
+            c->stats->hedged.fetch_add(1, std::memory_order_relaxed);
+        }
+        c->backup = detail::CancelPtr(detail::CancelOf(backup));
+        c->launched.store(true);
+        if (c->done.load())
+        {
+            // the first won meanwhile
+            c->backup->Cancel();
+        }
+        detail::AttachCallback(backup, [c](TryType&& t) {
+            c->SetResult(1, std::move(t));
+        });
+    });
+    detail::AttachCallback(first, [ctx](TryType&& t) {
+        ctx->SetResult(0, std::move(t));
+    });
+    return future;
+}
+
+// TODO
+
+// WhenIfAny
+
+// WhenIfN
 
 } // namespace asuka
 
@@ -5,10 +5,18 @@
 #ifndef ASUKA_HELPER_H
 #define ASUKA_HELPER_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
 #include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <memory>
-#include <mutex>
+
+#include <asuka/utils/Futex.h>
+#include <asuka/utils/PoolAllocator.h>
 
 namespace asuka
 {
@@ -28,6 +36,174 @@ struct TryWrapper;
 namespace detail
 {
 
+// sets func as the future's callback without a Then link, for the combinators
+template <typename T, typename F>
+void AttachCallback(Future<T>& fut, F&& func);
+
+// Cancellation shared by the states of a chain of Thens, created by the first
+// Then on a pending state, interrupt handler or Cancel of the chain. It holds no state, so linking
+// states to it makes no reference cycle. Cancelled once, the handlers run
+// in the thread cancelling it.
+class CancelState
+{
+public:
+    CancelState() :
+        refs_(1),
+        locked_(false),
+        cancelled_(false)
+    {}
+
+    static CancelState* Make()
+    {
+        void* p = PoolAllocator<CancelState>().allocate(1);
+        return new (p) CancelState();
+    }
+
+    void AddRef()
+    {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Release()
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            this->~CancelState();
+            PoolAllocator<CancelState>().deallocate(this, 1);
+        }
+    }
+
+    bool IsCancelled() const
+    {
+        return cancelled_.load(std::memory_order_acquire);
+    }
+
+    // runs here at once if cancelled already
+    void AddHandler(std::function<void ()> handler)
+    {
+        Lock();
+        if (!cancelled_.load(std::memory_order_relaxed))
+        {
+            handlers_.push_back(std::move(handler));
+            Unlock();
+            return;
+        }
+        Unlock();
+        handler();
+    }
+
+    // false if cancelled before
+    bool Cancel()
+    {
+        Lock();
+        if (cancelled_.load(std::memory_order_relaxed))
+        {
+            Unlock();
+            return false;
+        }
+        cancelled_.store(true, std::memory_order_release);
+        std::vector<std::function<void ()>> handlers;
+        handlers.swap(handlers_);
+        Unlock();
+        for (auto& handler : handlers)
+        {
+            handler();
+        }
+        return true;
+    }
+
+private:
+    // held for a push or a swap
+    void Lock()
+    {
+        while (locked_.exchange(true, std::memory_order_acquire))
+        {
+            CpuRelax();
+        }
+    }
+
+    void Unlock()
+    {
+        locked_.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<uint32_t> refs_;
+
+    std::atomic<bool> locked_;
+
+    std::atomic<bool> cancelled_;
+
+    std::vector<std::function<void ()>> handlers_;
+};
+
+// holds a reference of a CancelState
+class CancelPtr
+{
+public:
+    CancelPtr() :
+        cancel_(nullptr)
+    {}
+
+    explicit CancelPtr(CancelState* cancel) :
+        cancel_(cancel)
+    {
+        cancel_->AddRef();
+    }
+
+    ~CancelPtr()
+    {
+        if (cancel_)
+        {
+            cancel_->Release();
+        }
+    }
+
+    CancelPtr(const CancelPtr& other) :
+        cancel_(other.cancel_)
+    {
+        if (cancel_)
+        {
+            cancel_->AddRef();
+        }
+    }
+
+    CancelPtr& operator=(const CancelPtr& other)
+    {
+        CancelPtr(other).Swap(*this);
+        return *this;
+    }
+
+    CancelPtr(CancelPtr&& other) noexcept :
+        cancel_(other.cancel_)
+    {
+        other.cancel_ = nullptr;
+    }
+
+    CancelPtr& operator=(CancelPtr&& other) noexcept
+    {
+        CancelPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    void Swap(CancelPtr& other) noexcept
+    {
+        std::swap(cancel_, other.cancel_);
+    }
+
+    CancelState* operator->() const
+    {
+        return cancel_;
+    }
+
+private:
+    CancelState* cancel_;
+};
+
+// the CancelState of the future's chain, for the combinators to cancel their inputs
+template <typename T>
+CancelState* CancelOf(Future<T>& fut);
+
 // FIXME: std::result_of ?
 // why it is needed ?
 
@@ -80,7 +256,8 @@ struct IsFuture<Future<T>> : std::true_type
 template <typename F, typename T>
 struct CallableResult
 {
-    // Test F call with arg type: void, T&&, T&, but do NOT choose Try (in Try.h) type a args
+    // Test F call with arg type: void, T&&, T&, Try<T>&&
+    // the value first: a generic lambda can take both, it gets the value
     using Arg = typename std::conditional_t
         <
         CanCallWith<F>::value, // if true, F can call with void,
@@ -89,7 +266,12 @@ struct CallableResult
             <
             CanCallWith<F, T&&>::value, // if true, F(T&&) is valid
             ResultOfWrapper<F, T&&>, // Yes, F(T&&) is OK
-            ResultOfWrapper<F, T&> // above all failed, resort to F(T&)
+            typename std::conditional_t
+                <
+                CanCallWith<F, T&>::value, // if true, F(T&) is valid
+                ResultOfWrapper<F, T&>,
+                ResultOfWrapper<F, Try<T>&&> // above all failed, resort to F(Try<T>&&)
+                >
             >
         >;
 
@@ -113,7 +295,7 @@ struct CallableResult<F, void>
         ResultOfWrapper<F>,
         typename std::conditional_t // No, F(void) is invalid
             <
-            CanCallWith<F, Try<void>&&>::type, // if true, F(Try<void>&&) is valid
+            CanCallWith<F, Try<void>&&>::value, // if true, F(Try<void>&&) is valid
             ResultOfWrapper<F, Try<void>&&>,  // Yes, F(Try<void>&&) is OK
             ResultOfWrapper<F, const Try<void>&> // above all failed, resort to F(const Try<void>&)
             >
@@ -130,10 +312,14 @@ struct CallableResult<F, void>
 
 // For when_all
 
+// Results are written in place by index, the last one to count down
+// remaining sets the promise, so no lock is taken per element.
 template <typename... ELEM>
 struct CollectAllVariadicContext
 {
-    CollectAllVariadicContext() {}
+    CollectAllVariadicContext() :
+        remaining(sizeof...(ELEM))
+    {}
 
     // different from folly: do nothing here
     ~CollectAllVariadicContext() {}
@@ -146,26 +332,149 @@ struct CollectAllVariadicContext
     // FIXME: do not use macro use using or typedef
 #define _TRYELEM_ typename TryWrapper<ELEM>::Type...
     Promise<std::tuple<_TRYELEM_>> pm;
-    std::mutex mutex;
     std::tuple<_TRYELEM_> results;
-    std::vector<size_t> collects;
+    std::atomic<size_t> remaining;
 
     using FutureType = Future<std::tuple<_TRYELEM_>>;
 #undef _TRYELEM_
 
     template <typename T, size_t I>
-    inline void SetPartialResult(typename TryWrapper<T>::Type&& t)
+    inline void SetPartialResult(T&& t)
     {
-        std::unique_lock<std::mutex> lock(mutex);
         std::get<I>(results) = std::move(t);
-        collects.push_back(I);
-        if (collects.size() == std::tuple_size_v<decltype(results)>)
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            pm.SetValue(std::move(results));
+        }
+    }
+
+};
+
+template <typename T>
+struct CollectAllContext
+{
+    using TryType = typename TryWrapper<T>::Type;
+
+    explicit CollectAllContext(size_t n) :
+        results(n),
+        remaining(n)
+    {}
+
+    // non-copyable
+    CollectAllContext(const CollectAllContext&) = delete;
+    CollectAllContext& operator=(const CollectAllContext&) = delete;
+
+    Promise<std::vector<TryType>> pm;
+    std::vector<TryType> results;
+    std::atomic<size_t> remaining;
+
+    void SetResult(size_t i, TryType&& t)
+    {
+        results[i] = std::move(t);
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            pm.SetValue(std::move(results));
+        }
+    }
+};
+
+// the first result wins, the others are dropped and their chains cancelled
+template <typename T>
+struct CollectAnyContext
+{
+    using TryType = typename TryWrapper<T>::Type;
+
+    CollectAnyContext() :
+        done(false)
+    {}
+
+    // non-copyable
+    CollectAnyContext(const CollectAnyContext&) = delete;
+    CollectAnyContext& operator=(const CollectAnyContext&) = delete;
+
+    Promise<std::pair<size_t, TryType>> pm;
+    std::atomic<bool> done;
+    // filled before any callback is attached
+    std::vector<CancelPtr> inputs;
+
+    void SetResult(size_t i, TryType&& t)
+    {
+        bool expect = false;
+        if (done.compare_exchange_strong(expect, true, std::memory_order_acq_rel))
+        {
+            pm.SetValue(std::make_pair(i, std::move(t)));
+            CancelOthers(i);
+        }
+    }
+
+    // all but winner, all of them for SIZE_MAX
+    void CancelOthers(size_t winner)
+    {
+        for (size_t j = 0; j < inputs.size(); ++j)
+        {
+            if (j != winner)
+            {
+                inputs[j]->Cancel();
+            }
+        }
+    }
+};
+
+// the first n results win, the chains of the others are cancelled then
+template <typename T>
+struct CollectNContext
+{
+    using TryType = typename TryWrapper<T>::Type;
+
+    explicit CollectNContext(size_t n) :
+        results(n),
+        taken(0),
+        remaining(n)
+    {}
+
+    // non-copyable
+    CollectNContext(const CollectNContext&) = delete;
+    CollectNContext& operator=(const CollectNContext&) = delete;
+
+    Promise<std::vector<std::pair<size_t, TryType>>> pm;
+    std::vector<std::pair<size_t, TryType>> results;
+    std::atomic<size_t> taken;
+    std::atomic<size_t> remaining;
+    // filled before any callback is attached
+    std::vector<CancelPtr> inputs;
+
+    void SetResult(size_t i, TryType&& t)
+    {
+        size_t slot = taken.fetch_add(1, std::memory_order_relaxed);
+        if (slot >= results.size())
+        {
+            return;
+        }
+        results[slot].first = i;
+        results[slot].second = std::move(t);
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
         {
-            lock.unlock(); // So the lock must be std::unique_lock, not lock_guard
+            std::vector<bool> won(inputs.size(), false);
+            for (auto& result : results)
+            {
+                won[result.first] = true;
+            }
             pm.SetValue(std::move(results));
+            CancelUnless(won);
         }
     }
 
+    // won empty: all of them
+    void CancelUnless(const std::vector<bool>& won)
+    {
+        for (size_t j = 0; j < inputs.size(); ++j)
+        {
+            if (won.empty() || !won[j])
+            {
+                inputs[j]->Cancel();
+            }
+        }
+    }
 };
 
 // base template
@@ -178,8 +487,8 @@ template <template <typename...> class CTX, typename... Ts,
 void CollectVariadicHelper(const std::shared_ptr<CTX<Ts...>>& ctx,
                            THead&& head, TTail&&... tail)
 {
-    using InnerTry = typename TryWrapper<typename THead::InnerType>::Type;
-    head.Then([ctx](InnerTry&& t) {
+    using InnerTry = typename TryWrapper<typename std::decay_t<THead>::InnerType>::Type;
+    AttachCallback(head, [ctx](InnerTry&& t) {
         ctx->template SetPartialResult<InnerTry,
                                        sizeof...(Ts) - sizeof...(TTail) - 1>(std::move(t));
     });
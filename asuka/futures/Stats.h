@@ -0,0 +1,393 @@
+//
+// Created by xi on 19-4-6.
+//
+
+#ifndef ASUKA_STATS_H
+#define ASUKA_STATS_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace asuka
+{
+
+// Log-linear histogram of uint64 values in the manner of HdrHistogram:
+// values below 8 have a bucket each, above that every power of two is split
+// in 8 buckets, so a bucket is within 12.5% of the values it holds.
+// One thread records, without a lock or a read-modify-write; any thread can
+// copy it meanwhile, the copy may miss the latest values.
+class LatencyHistogram
+{
+public:
+    static constexpr int kSubBits = 3;
+    static constexpr int kSubBuckets = 1 << kSubBits;
+    static constexpr int kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+    LatencyHistogram() :
+        count_(0),
+        sum_(0),
+        max_(0)
+    {
+        for (auto& c : counts_)
+        {
+            c.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    LatencyHistogram(const LatencyHistogram& other) :
+        LatencyHistogram()
+    {
+        Merge(other);
+    }
+
+    LatencyHistogram& operator=(const LatencyHistogram& other)
+    {
+        if (this != &other)
+        {
+            Clear();
+            Merge(other);
+        }
+        return *this;
+    }
+
+    static int BucketOf(uint64_t value)
+    {
+        if (value < kSubBuckets)
+        {
+            return static_cast<int>(value);
+        }
+        int exponent = 63 - __builtin_clzll(value);
+        int shift = exponent - kSubBits;
+        return (shift + 1) * kSubBuckets + static_cast<int>((value >> shift) - kSubBuckets);
+    }
+
+    // the smallest value of the bucket
+    static uint64_t LowerBound(int bucket)
+    {
+        if (bucket < kSubBuckets)
+        {
+            return static_cast<uint64_t>(bucket);
+        }
+        int shift = bucket / kSubBuckets - 1;
+        return static_cast<uint64_t>(kSubBuckets + bucket % kSubBuckets) << shift;
+    }
+
+    // by the owning thread only
+    void Record(uint64_t value)
+    {
+        Bump(counts_[BucketOf(value)], 1);
+        Bump(count_, 1);
+        Bump(sum_, value);
+        if (value > max_.load(std::memory_order_relaxed))
+        {
+            max_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    void Merge(const LatencyHistogram& other)
+    {
+        for (int i = 0; i < kBuckets; ++i)
+        {
+            Bump(counts_[i], other.counts_[i].load(std::memory_order_relaxed));
+        }
+        Bump(count_, other.count());
+        Bump(sum_, other.sum());
+        max_.store(std::max(max(), other.max()), std::memory_order_relaxed);
+    }
+
+    // what was recorded since other was copied from the same source,
+    // max stays the one of the whole
+    void Subtract(const LatencyHistogram& other)
+    {
+        for (int i = 0; i < kBuckets; ++i)
+        {
+            Bump(counts_[i], 0 - other.counts_[i].load(std::memory_order_relaxed));
+        }
+        Bump(count_, 0 - other.count());
+        Bump(sum_, 0 - other.sum());
+    }
+
+    void Clear()
+    {
+        for (auto& c : counts_)
+        {
+            c.store(0, std::memory_order_relaxed);
+        }
+        count_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const
+    {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t sum() const
+    {
+        return sum_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t max() const
+    {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    double Mean() const
+    {
+        uint64_t n = count();
+        return n == 0 ? 0 : static_cast<double>(sum()) / static_cast<double>(n);
+    }
+
+    // the value below which percentile % of them are, to the bucket: its
+    // lower bound, 0 if empty
+    uint64_t Percentile(double percentile) const
+    {
+        uint64_t n = count();
+        if (n == 0)
+        {
+            return 0;
+        }
+        auto rank = static_cast<uint64_t>(percentile / 100 * static_cast<double>(n));
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i)
+        {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen > rank)
+            {
+                return LowerBound(i);
+            }
+        }
+        return max();
+    }
+
+private:
+    static void Bump(std::atomic<uint64_t>& counter, uint64_t delta)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> counts_[kBuckets];
+
+    std::atomic<uint64_t> count_;
+
+    std::atomic<uint64_t> sum_;
+
+    std::atomic<uint64_t> max_;
+};
+
+// What the futures of the process have recorded. Empty unless built with
+// ASUKA_FUTURE_STATS (cmake -DASUKA_FUTURE_STATS=ON), which stamps every
+// detail::State; without it nothing is recorded, State has no more fields
+// and the hot paths no more instructions.
+//
+//     FutureStats before = FutureStats::Snapshot();
+//     ... run the pipeline ...
+//     FutureStats stats = FutureStats::Snapshot().Since(before);
+//     stats.completion.Percentile(99);
+struct FutureStats
+{
+#ifdef ASUKA_FUTURE_STATS
+    static constexpr bool kEnabled = true;
+#else
+    static constexpr bool kEnabled = false;
+#endif
+
+    // ns from the making of a promise and its future to its value or exception
+    LatencyHistogram completion;
+
+    // ns a Then continuation waited in Scheduler::Schedule before running
+    LatencyHistogram queueing;
+
+    // number of Thens before a future, when it completes: 0 for a promise's
+    LatencyHistogram depth;
+
+    // the sums over the threads alive and those gone
+    static FutureStats Snapshot();
+
+    FutureStats Since(const FutureStats& before) const
+    {
+        FutureStats stats(*this);
+        stats.completion.Subtract(before.completion);
+        stats.queueing.Subtract(before.queueing);
+        stats.depth.Subtract(before.depth);
+        return stats;
+    }
+
+    void Merge(const FutureStats& other)
+    {
+        completion.Merge(other.completion);
+        queueing.Merge(other.queueing);
+        depth.Merge(other.depth);
+    }
+};
+
+namespace detail
+{
+
+inline uint64_t SteadyNanos()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// the stamps are TSC ticks, cheaper to read than the clock,
+// converted when recorded with the rate measured once, see below
+inline uint64_t StatsNow()
+{
+    return __rdtsc();
+}
+
+inline double NanosPerTick()
+{
+    static const double rate = [] {
+        uint64_t ns = SteadyNanos();
+        uint64_t ticks = __rdtsc();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return static_cast<double>(SteadyNanos() - ns) / static_cast<double>(__rdtsc() - ticks);
+    }();
+    return rate;
+}
+
+#else
+
+inline uint64_t StatsNow()
+{
+    return SteadyNanos();
+}
+
+inline double NanosPerTick()
+{
+    return 1;
+}
+
+#endif
+
+#ifdef ASUKA_FUTURE_STATS
+// measured at startup: the first use would be in the SetResult of whatever
+// thread completes a future first, sleeping there for the measure
+inline const double g_nanos_per_tick = NanosPerTick();
+#endif
+
+// ns since a stamp of StatsNow
+inline uint64_t StatsNanosSince(uint64_t stamp)
+{
+    return static_cast<uint64_t>(static_cast<double>(StatsNow() - stamp) * NanosPerTick());
+}
+
+struct StatsRecorder;
+
+// the recorders of live threads, and the sums of the exited ones
+class StatsRegistry
+{
+public:
+    void Add(StatsRecorder* recorder)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        recorders_.push_back(recorder);
+    }
+
+    void Retire(StatsRecorder* recorder);
+
+    FutureStats Snapshot();
+
+    // never destroyed, threads may exit after main returns
+    static StatsRegistry& Instance()
+    {
+        static StatsRegistry* registry = new StatsRegistry();
+        return *registry;
+    }
+
+private:
+    std::mutex mutex_;
+
+    std::vector<StatsRecorder*> recorders_;
+
+    FutureStats retired_;
+};
+
+// one per thread, written by it only
+struct StatsRecorder
+{
+    StatsRecorder()
+    {
+        StatsRegistry::Instance().Add(this);
+    }
+
+    ~StatsRecorder()
+    {
+        StatsRegistry::Instance().Retire(this);
+    }
+
+    static StatsRecorder& Local()
+    {
+        thread_local StatsRecorder recorder;
+        return recorder;
+    }
+
+    FutureStats stats;
+};
+
+inline void StatsRegistry::Retire(StatsRecorder* recorder)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    retired_.Merge(recorder->stats);
+    recorders_.erase(std::find(recorders_.begin(), recorders_.end(), recorder));
+}
+
+inline FutureStats StatsRegistry::Snapshot()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    FutureStats stats(retired_);
+    for (StatsRecorder* recorder : recorders_)
+    {
+        stats.Merge(recorder->stats);
+    }
+    return stats;
+}
+
+#ifdef ASUKA_FUTURE_STATS
+
+// stamps a task given to Scheduler::Schedule, records its wait when it runs
+template <typename F>
+auto StampQueued(F&& func)
+{
+    return [func = std::forward<F>(func), queued = StatsNow()]() mutable {
+        StatsRecorder::Local().stats.queueing.Record(StatsNanosSince(queued));
+        func();
+    };
+}
+
+#else
+
+template <typename F>
+F&& StampQueued(F&& func)
+{
+    return std::forward<F>(func);
+}
+
+#endif
+
+} // namespace detail
+
+inline FutureStats FutureStats::Snapshot()
+{
+    return detail::StatsRegistry::Instance().Snapshot();
+}
+
+} // namespace asuka
+
+#endif //ASUKA_STATS_H
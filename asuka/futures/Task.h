@@ -0,0 +1,516 @@
+//
+// Created by xi on 19-4-1.
+//
+
+#ifndef ASUKA_TASK_H
+#define ASUKA_TASK_H
+
+#if !defined(__cpp_impl_coroutine)
+#error "Task.h needs C++20 coroutines, configure with -DASUKA_CXX20_COROUTINES=ON"
+#endif
+
+#include <stddef.h>
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <new>
+#include <utility>
+
+#include <asuka/utils/PoolAllocator.h>
+#include <asuka/futures/Future.h>
+
+namespace asuka
+{
+
+// Allocates the frames of Task coroutines, like StackAllocator does the stacks
+// of Coroutine, a frame is a few hundred bytes instead of a whole stack.
+class FrameAllocator
+{
+public:
+    FrameAllocator() = default;
+
+    virtual ~FrameAllocator() = default;
+
+    // non-copyable
+    FrameAllocator(const FrameAllocator&) = delete;
+    FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+    virtual void* Allocate(size_t size) = 0;
+
+    // size is the one passed to Allocate
+    virtual void Deallocate(void* p, size_t size) = 0;
+
+    // used by every Task, PooledFrameAllocator by default
+    static FrameAllocator* Default()
+    {
+        return DefaultSlot();
+    }
+
+    // NOTE: not thread safe, set it before creating any Task
+    static void SetDefault(FrameAllocator* allocator)
+    {
+        DefaultSlot() = allocator;
+    }
+
+private:
+    static FrameAllocator*& DefaultSlot();
+};
+
+// operator new and delete, no reuse
+class HeapFrameAllocator : public FrameAllocator
+{
+public:
+    void* Allocate(size_t size) override
+    {
+        return ::operator new(size);
+    }
+
+    void Deallocate(void* p, size_t size) override
+    {
+        ::operator delete(p, size);
+    }
+};
+
+namespace detail
+{
+
+// the free lists of size classes of kGranularity bytes
+template <size_t kGranularity, size_t... kIndex>
+constexpr std::array<void* (*)(), sizeof...(kIndex)> FrameAllocates(std::index_sequence<kIndex...>)
+{
+    return {&FreeList<(kIndex + 1) * kGranularity, __STDCPP_DEFAULT_NEW_ALIGNMENT__>::Allocate...};
+}
+
+template <size_t kGranularity, size_t... kIndex>
+constexpr std::array<void (*)(void*), sizeof...(kIndex)> FrameDeallocates(std::index_sequence<kIndex...>)
+{
+    return {&FreeList<(kIndex + 1) * kGranularity, __STDCPP_DEFAULT_NEW_ALIGNMENT__>::Deallocate...};
+}
+
+} // namespace detail
+
+// Frames are recycled through the per-thread free lists of PoolAllocator,
+// one per 16-byte size class up to 1 KB, larger ones come from the heap.
+class PooledFrameAllocator : public FrameAllocator
+{
+public:
+    void* Allocate(size_t size) override
+    {
+        size_t index = size == 0 ? 0 : (size - 1) / kGranularity;
+        if (index >= kClasses)
+        {
+            return ::operator new(size);
+        }
+        return kAllocates[index]();
+    }
+
+    void Deallocate(void* p, size_t size) override
+    {
+        size_t index = size == 0 ? 0 : (size - 1) / kGranularity;
+        if (index >= kClasses)
+        {
+            ::operator delete(p, size);
+            return;
+        }
+        kDeallocates[index](p);
+    }
+
+private:
+    static constexpr size_t kGranularity = 16;
+    static constexpr size_t kClasses = 64;
+
+    static constexpr std::array<void* (*)(), kClasses> kAllocates =
+        detail::FrameAllocates<kGranularity>(std::make_index_sequence<kClasses>());
+
+    static constexpr std::array<void (*)(void*), kClasses> kDeallocates =
+        detail::FrameDeallocates<kGranularity>(std::make_index_sequence<kClasses>());
+};
+
+inline FrameAllocator*& FrameAllocator::DefaultSlot()
+{
+    static PooledFrameAllocator pooled;
+    static FrameAllocator* allocator = &pooled;
+    return allocator;
+}
+
+template <typename T>
+class Task;
+
+namespace detail
+{
+
+class TaskPromiseBase
+{
+public:
+    static void* operator new(size_t size)
+    {
+        return FrameAllocator::Default()->Allocate(size);
+    }
+
+    static void operator delete(void* p, size_t size)
+    {
+        FrameAllocator::Default()->Deallocate(p, size);
+    }
+
+    // lazy: runs when awaited or started
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    // symmetric transfer to the awaiting coroutine, a chain of awaits
+    // of any depth returns through one frame of stack
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+        {
+            return h.promise().continuation_;
+        }
+
+        void await_resume() noexcept
+        {
+        }
+    };
+
+    FinalAwaiter final_suspend() noexcept
+    {
+        return {};
+    }
+
+    void SetContinuation(std::coroutine_handle<> continuation)
+    {
+        continuation_ = continuation;
+    }
+
+private:
+    std::coroutine_handle<> continuation_ = std::noop_coroutine();
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase
+{
+public:
+    Task<T> get_return_object();
+
+    template <typename U>
+    void return_value(U&& value)
+    {
+        result_ = Try<T>(std::forward<U>(value));
+    }
+
+    void unhandled_exception()
+    {
+        result_ = Try<T>(std::current_exception());
+    }
+
+    Try<T>& result()
+    {
+        return result_;
+    }
+
+private:
+    Try<T> result_;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase
+{
+public:
+    Task<void> get_return_object();
+
+    void return_void()
+    {
+    }
+
+    void unhandled_exception()
+    {
+        result_ = Try<void>(std::current_exception());
+    }
+
+    Try<void>& result()
+    {
+        return result_;
+    }
+
+private:
+    Try<void> result_;
+};
+
+// starts the awaited task, the awaiting coroutine goes on when it finishes
+template <typename T>
+class TaskAwaiter
+{
+public:
+    explicit TaskAwaiter(std::coroutine_handle<TaskPromise<T>> handle) :
+        handle_(handle)
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return !handle_ || handle_.done();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle_.promise().SetContinuation(awaiting);
+        return handle_;
+    }
+
+protected:
+    std::coroutine_handle<TaskPromise<T>> handle_;
+};
+
+// the result, rethrowing an exception
+template <typename T>
+class TaskValueAwaiter : public TaskAwaiter<T>
+{
+public:
+    using TaskAwaiter<T>::TaskAwaiter;
+
+    T await_resume()
+    {
+        if constexpr (std::is_void_v<T>)
+        {
+            this->handle_.promise().result().Check();
+        }
+        else
+        {
+            return std::move(this->handle_.promise().result()).Value();
+        }
+    }
+};
+
+// the result as a Try
+template <typename T>
+class TaskTryAwaiter : public TaskAwaiter<T>
+{
+public:
+    using TaskAwaiter<T>::TaskAwaiter;
+
+    Try<T> await_resume()
+    {
+        return std::move(this->handle_.promise().result());
+    }
+};
+
+// eager, destroys itself when done, for Task::Start
+struct DetachedTask
+{
+    struct promise_type
+    {
+        static void* operator new(size_t size)
+        {
+            return FrameAllocator::Default()->Allocate(size);
+        }
+
+        static void operator delete(void* p, size_t size)
+        {
+            FrameAllocator::Default()->Deallocate(p, size);
+        }
+
+        DetachedTask get_return_object() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void() noexcept
+        {
+        }
+
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+// resumes the awaiting coroutine in the thread completing the future,
+// the callback and the coroutine both arrive, the second one resumes it
+template <typename T>
+class FutureAwaiter
+{
+public:
+    using ValueType = typename Future<T>::ValueType;
+
+    explicit FutureAwaiter(Future<T>&& future) :
+        future_(std::move(future)),
+        attached_(false),
+        arrived_(false)
+    {}
+
+    bool await_ready() const
+    {
+        return future_.IsReady();
+    }
+
+    bool await_suspend(std::coroutine_handle<> awaiting)
+    {
+        attached_ = true;
+        AttachCallback(future_, [this, awaiting](ValueType&& t) {
+            value_ = std::move(t);
+            if (arrived_.exchange(true, std::memory_order_acq_rel))
+            {
+                awaiting.resume();
+            }
+        });
+        // false: the value came while attaching, go on without suspending
+        return !arrived_.exchange(true, std::memory_order_acq_rel);
+    }
+
+    ValueType await_resume()
+    {
+        if (!attached_)
+        {
+            // ready, does not block
+            return future_.Wait();
+        }
+        return std::move(value_);
+    }
+
+private:
+    Future<T> future_;
+
+    bool attached_;
+
+    std::atomic<bool> arrived_;
+
+    ValueType value_;
+};
+
+} // namespace detail
+
+// Lazily started stackless coroutine with a result of T:
+//
+//     Task<int> Add(Future<int> a, Task<int> b)
+//     {
+//         int x = (co_await std::move(a)).Value();
+//         co_return x + co_await std::move(b);
+//     }
+//
+// co_await a Task runs it and gives its result, an exception thrown in it is
+// rethrown. Finishing transfers straight to the awaiting coroutine, so
+// awaiting chains of any depth do not grow the stack. Start runs a Task from
+// plain code. Frames come from FrameAllocator::Default().
+template <typename T>
+class Task
+{
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task() = default;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) :
+        handle_(handle)
+    {}
+
+    ~Task()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+        }
+    }
+
+    // non-copyable
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    // movable
+    Task(Task&& task) noexcept :
+        handle_(std::exchange(task.handle_, nullptr))
+    {}
+
+    Task& operator=(Task&& task) noexcept
+    {
+        if (this != &task)
+        {
+            if (handle_)
+            {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(task.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    bool IsReady() const
+    {
+        return handle_ && handle_.done();
+    }
+
+    detail::TaskValueAwaiter<T> operator co_await() const noexcept
+    {
+        return detail::TaskValueAwaiter<T>(handle_);
+    }
+
+    // co_await task.AsTry() gives the result as Try<T> instead of throwing
+    detail::TaskTryAwaiter<T> AsTry() const noexcept
+    {
+        return detail::TaskTryAwaiter<T>(handle_);
+    }
+
+    // run it in this thread until its first suspension,
+    // the future is set when it finishes
+    Future<T> Start() &&
+    {
+        Promise<T> pm;
+        Future<T> future = pm.GetFuture();
+        Run(std::move(*this), std::move(pm));
+        return future;
+    }
+
+private:
+    static detail::DetachedTask Run(Task task, Promise<T> pm)
+    {
+        pm.SetValue(co_await task.AsTry());
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail
+{
+
+template <typename T>
+inline Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+} // namespace detail
+
+// co_await std::move(future) gives its Try<T> like Wait does, without blocking:
+// the awaiting coroutine is resumed in the thread completing the future
+// NOTE: a future which times out never resumes it
+template <typename T>
+detail::FutureAwaiter<T> operator co_await(Future<T>&& future)
+{
+    return detail::FutureAwaiter<T>(std::move(future));
+}
+
+} // namespace asuka
+
+#endif //ASUKA_TASK_H
@@ -6,17 +6,27 @@
 #define ASUKA_TRY_H
 
 #include <assert.h>
+#include <stdint.h>
+#include <new>
+#include <utility>
+#include <type_traits>
 #include <stdexcept>
 #include <exception>
 
 namespace asuka
 {
 
+// The value or the exception share the storage, the state tag follows it in
+// one byte: sizeof is max(sizeof(T), sizeof(std::exception_ptr)) + 1 rounded
+// up to the alignment.
+// NOTE: never trivially copyable, copying an exception_ptr takes a reference,
+// so a Try is not passed in registers whatever T is. For a trivially
+// destructible T the destructor only looks for an exception.
 template <typename T>
 class Try
 {
 public:
-    enum class State
+    enum class State : uint8_t
     {
         kNone,
         kException,
@@ -26,44 +36,29 @@ public:
     Try() : state_(State::kNone) {}
 
     explicit Try(const T& t) :
-        state_(State::kValue),
-        value_(t)
+        value_(t),
+        state_(State::kValue)
     {}
 
     explicit Try(T&& t) :
-        state_(State::kValue),
-        value_(std::move(t))
+        value_(std::move(t)),
+        state_(State::kValue)
     {}
 
     explicit Try(std::exception_ptr e) :
-        state_(State::kException),
-        exception_(std::move(e))
+        exception_(std::move(e)),
+        state_(State::kException)
     {}
 
     ~Try()
     {
-        if (state_ == State::kException)
-        {
-            exception_.~exception_ptr();
-        }
-        else if (state_ == State::kValue)
-        {
-            value_.~T();
-        }
+        Destroy();
     }
 
     // copy
-    Try(const Try<T>& t) :
-        state_(t.state_)
+    Try(const Try<T>& t)
     {
-        if (state_ == State::kValue)
-        {
-            new (&value_) T(t.value_);
-        }
-        else if (state_ == State::kException)
-        {
-            new (&exception_) std::exception_ptr(t.exception_);
-        }
+        CopyFrom(t);
     }
 
     Try<T>& operator=(const Try<T>& t)
@@ -72,31 +67,15 @@ public:
         {
             return *this;
         }
-        this->~Try();
-        state_ = t.state_;
-        if (state_ == State::kValue)
-        {
-            new (&state_) T(t.value_);
-        }
-        else if (state_ == State::kException)
-        {
-            new (&exception_) std::exception_ptr(t.exception_);
-        }
+        Destroy();
+        CopyFrom(t);
         return *this;
     }
 
     // move
-    Try(Try<T>&& t) noexcept:
-        state_(t.state_)
+    Try(Try<T>&& t) noexcept
     {
-        if (state_ == State::kValue)
-        {
-            new (&value_) T(std::move(t.value_));
-        }
-        else if (state_ == State::kException)
-        {
-            new (&exception_) std::exception_ptr(std::move(t.exception_));
-        }
+        MoveFrom(std::move(t));
     }
 
     Try<T>& operator=(Try<T>&& t) noexcept
@@ -105,16 +84,8 @@ public:
         {
             return *this;
         }
-        this->~Try();
-        state_ = t.state_;
-        if (state_ == State::kValue)
-        {
-            new (&value_) T(std::move(t.value_));
-        }
-        else if (state_ == State::kException)
-        {
-            new (&exception_) std::exception_ptr(std::move(t.exception_));
-        }
+        Destroy();
+        MoveFrom(std::move(t));
         return *this;
     }
 
@@ -224,13 +195,56 @@ public:
     }
 
 private:
-    State state_;
+    void Destroy()
+    {
+        if (state_ == State::kException)
+        {
+            exception_.~exception_ptr();
+        }
+        else if constexpr (!std::is_trivially_destructible_v<T>)
+        {
+            if (state_ == State::kValue)
+            {
+                value_.~T();
+            }
+        }
+    }
+
+    void CopyFrom(const Try<T>& t)
+    {
+        state_ = t.state_;
+        if (state_ == State::kException)
+        {
+            new (&exception_) std::exception_ptr(t.exception_);
+        }
+        else if (state_ == State::kValue)
+        {
+            new (&value_) T(t.value_);
+        }
+    }
+
+    void MoveFrom(Try<T>&& t)
+    {
+        state_ = t.state_;
+        if (state_ == State::kException)
+        {
+            new (&exception_) std::exception_ptr(std::move(t.exception_));
+        }
+        else if (state_ == State::kValue)
+        {
+            new (&value_) T(std::move(t.value_));
+        }
+    }
+
+private:
     // if T is not a trivial class you need a destructor and constructor
     union
     {
         T value_;
         std::exception_ptr exception_;
     };
+
+    State state_;
 };
 
 
@@ -251,65 +265,14 @@ public:
         exception_(std::move(e))
     {}
 
-    ~Try()
-    {
-        if (state_ == State::kException)
-        {
-            exception_.~exception_ptr();
-        }
-    }
-
-    // copy
-
-    Try(const Try<void>& t) :
-        state_(t.state_)
-    {
-        if (state_ == State::kException)
-        {
-            new (&exception_) std::exception_ptr(t.exception_);
-        }
-    }
-
-    Try& operator=(const Try<void>& t)
-    {
-        if (this == &t)
-        {
-            return *this;
-        }
-        this->~Try();
-        state_ = t.state_;
-        if (state_ == State::kException)
-        {
-            new (&exception_) std::exception_ptr(t.exception_);
-        }
-        return *this;
-    }
-
-    // move
+    // exception_ is not in a union here, members are handled by default
+    ~Try() = default;
 
-    Try(Try<void>&& t) noexcept :
-        state_(t.state_)
-    {
-        if (state_ == State::kException)
-        {
-            new (&exception_) std::exception_ptr(std::move(t.exception_));
-        }
-    }
+    Try(const Try<void>& t) = default;
+    Try& operator=(const Try<void>& t) = default;
 
-    Try& operator=(Try<void>&& t) noexcept
-    {
-        if (this == &t)
-        {
-            return *this;
-        }
-        this->~Try();
-        state_ = t.state_;
-        if (state_ == State::kException)
-        {
-            new (&exception_) std::exception_ptr(std::move(t.exception_));
-        }
-        return *this;
-    }
+    Try(Try<void>&& t) noexcept = default;
+    Try& operator=(Try<void>&& t) noexcept = default;
 
     // get exception_
     const std::exception_ptr& Exception() const &
@@ -377,6 +340,12 @@ struct TryWrapper
     using Type = Try<T>;
 };
 
+template <typename T>
+struct IsTry : std::false_type {};
+
+template <typename T>
+struct IsTry<Try<T>> : std::true_type {};
+
 // SFINAE
 
 // Wrap function f(...) return by Try<T>
@@ -0,0 +1,220 @@
+//
+// Created by xi on 19-3-31.
+//
+
+#include <assert.h>
+#include <iostream>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <asuka/utils/Types.h>
+#include <asuka/utils/EventLoopScheduler.h>
+#include <asuka/coroutine/Coroutine.h>
+#include <asuka/coroutine/Runtime.h>
+#include <asuka/coroutine/Sync.h>
+
+using namespace asuka;
+
+template <typename Pred>
+void WaitFor(Pred pred)
+{
+    while (!pred())
+    {
+        std::this_thread::yield();
+    }
+}
+
+// outside of any coroutine Await is Wait
+void TestMainCoroutine()
+{
+    int ready = Coroutine::Await(MakeReadyFuture(1)).Value();
+    assert(ready == 1);
+
+    Promise<int> pm;
+    std::thread t([&pm] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        pm.SetValue(2);
+    });
+    int later = Coroutine::Await(pm.GetFuture()).Value();
+    assert(later == 2);
+    t.join();
+    UnusedVariable(ready);
+    UnusedVariable(later);
+    std::cout << "TestMainCoroutine OK" << std::endl;
+}
+
+// a plain coroutine yields to its caller and is sent back by the thread setting the value
+void TestPlainCoroutine()
+{
+    Promise<int> pm;
+    int result = 0;
+    auto co = Coroutine::CreateCoroutine([&pm, &result] {
+        // ready already, no switch
+        result = Coroutine::Await(MakeReadyFuture(1)).Value();
+        result += Coroutine::Await(pm.GetFuture()).Value();
+    });
+    VoidPtr yielded = Coroutine::Send(co);
+    assert(!yielded);
+    assert(result == 1);
+    assert(co->state() == Coroutine::State::kRunning);
+
+    pm.SetValue(41);
+    assert(result == 42);
+    assert(co->state() == Coroutine::State::kFinished);
+
+    // a stray Send does not resume it before the value comes
+    Promise<void> pm2;
+    bool thrown = false;
+    auto co2 = Coroutine::CreateCoroutine([&pm2, &thrown] {
+        auto t = Coroutine::Await(pm2.GetFuture());
+        thrown = t.HasException();
+    });
+    Coroutine::Send(co2);
+    Coroutine::Send(co2);
+    assert(co2->state() == Coroutine::State::kRunning);
+    pm2.SetException(std::make_exception_ptr(std::runtime_error("failed")));
+    assert(thrown);
+    assert(co2->state() == Coroutine::State::kFinished);
+    std::cout << "TestPlainCoroutine OK" << std::endl;
+}
+
+// many awaits in flight on one thread, completed in reverse order
+void TestManyAwaits()
+{
+    const int kCoroutines = 10000;
+    std::vector<Promise<int>> promises(kCoroutines);
+    std::vector<CoroutinePtr> coroutines;
+    long sum = 0;
+    for (int i = 0; i < kCoroutines; ++i)
+    {
+        coroutines.push_back(Coroutine::CreateCoroutine([&promises, &sum, i] {
+            sum += Coroutine::Await(promises[i].GetFuture()).Value();
+        }));
+        Coroutine::Send(coroutines.back());
+    }
+    assert(sum == 0);
+    for (int i = kCoroutines - 1; i >= 0; --i)
+    {
+        promises[i].SetValue(i);
+    }
+    assert(sum == static_cast<long>(kCoroutines) * (kCoroutines - 1) / 2);
+    for (auto& co : coroutines)
+    {
+        assert(co->state() == Coroutine::State::kFinished);
+        UnusedVariable(co);
+    }
+    std::cout << "TestManyAwaits OK" << std::endl;
+}
+
+// the frames are copied out while suspended, the value goes elsewhere
+void TestSharedStack()
+{
+    const int kCoroutines = 100;
+    auto shared_stack = std::make_shared<SharedStack>();
+    std::vector<Promise<int>> promises(kCoroutines);
+    std::vector<CoroutinePtr> coroutines;
+    long sum = 0;
+    for (int i = 0; i < kCoroutines; ++i)
+    {
+        coroutines.push_back(Coroutine::CreateCoroutineOnSharedStack(shared_stack, [&promises, &sum, i] {
+            int local = i;
+            int value = Coroutine::Await(promises[i].GetFuture()).Value();
+            assert(local == i);
+            sum += value * local;
+        }));
+        Coroutine::Send(coroutines.back());
+    }
+    for (int i = 0; i < kCoroutines; i += 2)
+    {
+        promises[i].SetValue(1);
+    }
+    for (int i = 1; i < kCoroutines; i += 2)
+    {
+        promises[i].SetValue(1);
+    }
+    assert(sum == kCoroutines * (kCoroutines - 1) / 2);
+    std::cout << "TestSharedStack OK" << std::endl;
+}
+
+// values set in another thread, the coroutines are sent back by tasks of their loop
+void TestScheduler()
+{
+    const int kCoroutines = 100;
+    EventLoopScheduler loop;
+    std::thread loop_thread([&loop] { loop.Loop(); });
+
+    std::vector<Promise<int>> promises(kCoroutines);
+    std::atomic<int> waiting(0);
+    std::atomic<long> sum(0);
+    std::atomic<bool> wrong_thread(false);
+    std::vector<CoroutinePtr> coroutines;
+    loop.Schedule([&] {
+        for (int i = 0; i < kCoroutines; ++i)
+        {
+            coroutines.push_back(Coroutine::CreateCoroutine([&, i] {
+                ++waiting;
+                int value = Coroutine::Await(promises[i].GetFuture(), &loop).Value();
+                if (!loop.IsInLoopThread())
+                {
+                    wrong_thread = true;
+                }
+                sum += value;
+            }));
+            Coroutine::Send(coroutines.back());
+        }
+    });
+    WaitFor([&waiting] { return waiting == kCoroutines; });
+    for (int i = 0; i < kCoroutines; ++i)
+    {
+        promises[i].SetValue(i);
+    }
+    WaitFor([&sum] { return sum == kCoroutines * (kCoroutines - 1) / 2; });
+    assert(!wrong_thread);
+
+    loop.Stop();
+    loop_thread.join();
+    std::cout << "TestScheduler OK" << std::endl;
+}
+
+// coroutines of Runtime park, the workers run others meanwhile
+void TestRuntime()
+{
+    const int kCoroutines = 1000;
+    std::vector<Promise<int>> promises(kCoroutines);
+    std::atomic<int> waiting(0);
+    std::atomic<long> sum(0);
+    WaitGroup wg;
+    wg.Add(kCoroutines);
+    {
+        Runtime runtime(2);
+        for (int i = 0; i < kCoroutines; ++i)
+        {
+            runtime.Spawn([&, i] {
+                ++waiting;
+                sum += Coroutine::Await(promises[i].GetFuture()).Value();
+                wg.Done();
+            });
+        }
+        WaitFor([&waiting] { return waiting == kCoroutines; });
+        for (int i = 0; i < kCoroutines; ++i)
+        {
+            promises[i].SetValue(i);
+        }
+        wg.Wait();
+    }
+    assert(sum == static_cast<long>(kCoroutines) * (kCoroutines - 1) / 2);
+    std::cout << "TestRuntime OK" << std::endl;
+}
+
+int main()
+{
+    TestMainCoroutine();
+    TestPlainCoroutine();
+    TestManyAwaits();
+    TestSharedStack();
+    TestScheduler();
+    TestRuntime();
+    return 0;
+}
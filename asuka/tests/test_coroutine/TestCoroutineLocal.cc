@@ -0,0 +1,180 @@
+//
+// Created by xi on 19-4-9.
+//
+
+#include <assert.h>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <asuka/utils/Types.h>
+#include <asuka/coroutine/Coroutine.h>
+#include <asuka/coroutine/CoroutineLocal.h>
+#include <asuka/coroutine/Runtime.h>
+
+using namespace asuka;
+
+struct Counted
+{
+    Counted()
+    {
+        ++alive;
+        ++made;
+    }
+
+    ~Counted()
+    {
+        --alive;
+    }
+
+    int value = 0;
+
+    static std::atomic<int> alive;
+    static std::atomic<int> made;
+};
+
+std::atomic<int> Counted::alive(0);
+std::atomic<int> Counted::made(0);
+
+CoroutineLocal<std::string> g_name;
+CoroutineLocal<Counted> g_counted;
+
+void TestSeparate()
+{
+    // interleaved coroutines see their own values, main its own
+    g_name.Get() = "main";
+    auto worker = [](const char* name) {
+        assert(g_name.Find() == nullptr);
+        g_name.Get() = name;
+        Coroutine::Yield();
+        assert(g_name.Get() == name);
+        *g_name += "!";
+        Coroutine::Yield();
+        assert(*g_name == std::string(name) + "!");
+    };
+    CoroutinePtr a = Coroutine::CreateCoroutine(worker, "a");
+    CoroutinePtr b = Coroutine::CreateCoroutine(worker, "b");
+    for (int i = 0; i < 3; ++i)
+    {
+        Coroutine::Send(a);
+        Coroutine::Send(b);
+        assert(*g_name.Find() == "main");
+    }
+    assert(a->state() == Coroutine::State::kFinished);
+    std::cout << "TestSeparate OK" << std::endl;
+}
+
+void TestLifetime()
+{
+    int made = Counted::made;
+    // made at its first use only
+    CoroutinePtr idle = Coroutine::CreateCoroutine([] { Coroutine::Yield(); });
+    Coroutine::Send(idle);
+    assert(Counted::made == made);
+
+    CoroutinePtr user = Coroutine::CreateCoroutine([] {
+        assert(g_counted.Find() == nullptr);
+        g_counted->value = 1;
+        assert(g_counted.Find() != nullptr);
+        Coroutine::Yield();
+        g_counted.Reset();
+        assert(g_counted.Find() == nullptr);
+        g_counted->value = 2;
+    });
+    Coroutine::Send(user);
+    assert(Counted::alive == 1);
+    // destroyed when it finishes, while the Coroutine is still held
+    Coroutine::Send(user);
+    assert(Counted::made == made + 2);
+    assert(Counted::alive == 0);
+
+    // or with the Coroutine, never finished
+    CoroutinePtr dropped = Coroutine::CreateCoroutine([] {
+        g_counted->value = 3;
+        Coroutine::Yield();
+    });
+    Coroutine::Send(dropped);
+    assert(Counted::alive == 1);
+    dropped.reset();
+    assert(Counted::alive == 0);
+    UnusedVariable(made);
+    std::cout << "TestLifetime OK" << std::endl;
+}
+
+// more keys than the slots in the Coroutine
+void TestManyKeys()
+{
+    std::vector<std::unique_ptr<CoroutineLocal<int>>> keys;
+    for (int i = 0; i < 20; ++i)
+    {
+        keys.push_back(std::make_unique<CoroutineLocal<int>>());
+    }
+    CoroutinePtr co = Coroutine::CreateCoroutine([&keys] {
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            keys[i]->Get() = static_cast<int>(i);
+        }
+        Coroutine::Yield();
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            assert(keys[i]->Get() == static_cast<int>(i));
+        }
+    });
+    Coroutine::Send(co);
+    // main's are new
+    for (auto& key : keys)
+    {
+        int value = key->Get();
+        assert(value == 0);
+        UnusedVariable(value);
+    }
+    Coroutine::Send(co);
+    assert(co->state() == Coroutine::State::kFinished);
+    std::cout << "TestManyKeys OK" << std::endl;
+}
+
+// the values move with the coroutines across the workers
+void TestRuntime()
+{
+    const int kCoroutines = 100;
+    const int kYields = 20;
+    std::atomic<int> finished(0);
+    std::atomic<int> wrong(0);
+    {
+        Runtime runtime(2);
+        for (int i = 0; i < kCoroutines; ++i)
+        {
+            runtime.Spawn([i, &finished, &wrong] {
+                g_counted->value = i;
+                for (int y = 0; y < kYields; ++y)
+                {
+                    Runtime::Yield();
+                    if (g_counted->value != i)
+                    {
+                        ++wrong;
+                    }
+                }
+                ++finished;
+            });
+        }
+        while (finished.load() != kCoroutines)
+        {
+            std::this_thread::yield();
+        }
+    }
+    assert(wrong == 0);
+    assert(Counted::alive == 0);
+    std::cout << "TestRuntime OK" << std::endl;
+}
+
+int main()
+{
+    TestSeparate();
+    TestLifetime();
+    TestManyKeys();
+    TestRuntime();
+    return 0;
+}
@@ -0,0 +1,78 @@
+//
+// Created by xi on 19-3-18.
+//
+
+#include <assert.h>
+#include <iostream>
+#include <memory>
+#include <array>
+#include <string>
+
+#include <asuka/utils/Types.h>
+#include <asuka/coroutine/Coroutine.h>
+
+using namespace asuka;
+
+// coroutines are recycled through the pool, func_ is stored in place or on heap
+
+int Add(int a, int b)
+{
+    return a + b;
+}
+
+void Increase(int& value)
+{
+    ++value;
+}
+
+int main()
+{
+    // a finished coroutine's block is reused by the next one
+    Coroutine* first = nullptr;
+    {
+        CoroutinePtr co(Coroutine::CreateCoroutine(Add, 1, 2));
+        first = co.get();
+        VoidPtr value = Coroutine::Send(co);
+        assert(*std::static_pointer_cast<int>(value) == 3);
+    }
+    CoroutinePtr reused(Coroutine::CreateCoroutine(Add, 3, 4));
+    assert(reused.get() == first);
+    assert(reused->state() == Coroutine::State::kNotInit);
+    VoidPtr result = Coroutine::Send(reused);
+    assert(*std::static_pointer_cast<int>(result) == 7);
+    assert(reused->state() == Coroutine::State::kFinished);
+    UnusedVariable(first);
+
+    // move-only callable, captures are released once it finishes
+    auto owned = std::make_shared<int>(5);
+    std::weak_ptr<int> watch(owned);
+    auto unique = std::make_unique<std::shared_ptr<int>>(std::move(owned));
+    CoroutinePtr move_only(Coroutine::CreateCoroutine([p = std::move(unique)] { return **p * 2; }));
+    result = Coroutine::Send(move_only);
+    assert(*std::static_pointer_cast<int>(result) == 10);
+    assert(watch.expired());
+    UnusedVariable(watch);
+
+    // callable too large to be stored in place
+    std::array<long, 16> big;
+    big.fill(1);
+    CoroutinePtr heap(Coroutine::CreateCoroutine([big] {
+        long sum = 0;
+        for (long x : big)
+        {
+            sum += x;
+        }
+        return sum;
+    }));
+    result = Coroutine::Send(heap);
+    assert(*std::static_pointer_cast<long>(result) == 16);
+
+    // arguments are bound by value, std::ref binds by reference
+    int value = 0;
+    CoroutinePtr by_ref(Coroutine::CreateCoroutine(Increase, std::ref(value)));
+    Coroutine::Send(by_ref);
+    assert(value == 1);
+
+    std::cout << "coroutine pool test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,163 @@
+//
+// Created by xi on 19-4-7.
+//
+
+#include <assert.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include <asuka/utils/Types.h>
+#include <asuka/coroutine/Coroutine.h>
+#include <asuka/coroutine/Runtime.h>
+
+using namespace asuka;
+
+// linked with coroutine_stats, counted whatever ASUKA_COROUTINE_STATS says
+static_assert(CoroutineStats::kEnabled, "built with ASUKA_COROUTINE_STATS");
+
+using Clock = std::chrono::steady_clock;
+
+// frames of at least 256 bytes each
+__attribute__((noinline)) int Deep(int depth)
+{
+    volatile char frame[256];
+    frame[0] = static_cast<char>(depth);
+    if (depth > 1)
+    {
+        return Deep(depth - 1) + frame[0];
+    }
+    return frame[0];
+}
+
+void Spin(std::chrono::milliseconds duration)
+{
+    auto until = Clock::now() + duration;
+    while (Clock::now() < until)
+    {
+    }
+}
+
+void TestCounts()
+{
+    CoroutineStats::Totals before = CoroutineStats::Total();
+    CoroutinePtr co = Coroutine::CreateCoroutine([] {
+        for (int i = 0; i < 3; ++i)
+        {
+            Spin(std::chrono::milliseconds(5));
+            Coroutine::Yield();
+        }
+    });
+    unsigned int id = co->id();
+    CoroutineStats stats = CoroutineStats::Find(id).value();
+    assert(stats.id == id && stats.sends == 0 && stats.yields == 0 && stats.run_ns == 0);
+    assert(stats.stack_size >= 8 * 1024);
+
+    // the time it is suspended is not its own
+    for (int i = 0; i < 4; ++i)
+    {
+        Coroutine::Send(co);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    stats = CoroutineStats::Find(id).value();
+    assert(stats.sends == 4);
+    assert(stats.yields == 3);
+    assert(stats.run_ns >= 15 * 1000 * 1000 && stats.run_ns < 60 * 1000 * 1000);
+    assert(stats.stack_high_water > 0 && stats.stack_high_water < stats.stack_size);
+
+    co.reset();
+    assert(!CoroutineStats::Find(id));
+    CoroutineStats::Totals after = CoroutineStats::Total();
+    assert(after.coroutines == before.coroutines + 1);
+    assert(after.sends == before.sends + 4);
+    assert(after.yields == before.yields + 3);
+    assert(after.stack_high_water.count() == before.stack_high_water.count() + 1);
+    UnusedVariable(stats);
+    UnusedVariable(before);
+    UnusedVariable(after);
+    std::cout << "TestCounts OK" << std::endl;
+}
+
+// asked by itself, the running coroutine sees its time so far
+void TestSelf()
+{
+    CoroutinePtr co = Coroutine::CreateCoroutine([] {
+        Spin(std::chrono::milliseconds(5));
+        CoroutineStats stats = CoroutineStats::Find(Coroutine::GetCurrentId()).value();
+        assert(stats.sends == 1 && stats.run_ns >= 5 * 1000 * 1000);
+        UnusedVariable(stats);
+    });
+    Coroutine::Send(co);
+    std::cout << "TestSelf OK" << std::endl;
+}
+
+void TestHighWater()
+{
+    CoroutinePtr shallow = Coroutine::CreateCoroutine(Deep, 2);
+    CoroutinePtr deep = Coroutine::CreateCoroutine(Deep, 20);
+    Coroutine::Send(shallow);
+    Coroutine::Send(deep);
+    size_t shallow_used = shallow->stats().stack_high_water;
+    size_t deep_used = deep->stats().stack_high_water;
+    assert(deep_used >= 20 * 256);
+    assert(deep_used >= shallow_used + 18 * 256);
+    UnusedVariable(shallow_used);
+    UnusedVariable(deep_used);
+
+    // on a shared stack: the most copied out at a switch
+    auto shared_stack = std::make_shared<SharedStack>();
+    CoroutinePtr first = Coroutine::CreateCoroutineOnSharedStack(shared_stack, [] {
+        Deep(1);
+        Coroutine::Yield();
+    });
+    CoroutinePtr second = Coroutine::CreateCoroutineOnSharedStack(shared_stack, [] { Deep(1); });
+    Coroutine::Send(first);
+    Coroutine::Send(second);
+    assert(first->stats().stack_high_water == first->max_saved_size());
+    assert(first->stats().stack_high_water > 0);
+    assert(first->stats().stack_size == SharedStack::kDefaultSharedStackSize);
+    std::cout << "TestHighWater OK" << std::endl;
+}
+
+// switched to by every worker, counted the same
+void TestRuntime()
+{
+    const int kCoroutines = 100;
+    const int kYields = 10;
+    CoroutineStats::Totals before = CoroutineStats::Total();
+    {
+        Runtime runtime(2);
+        std::atomic<int> finished(0);
+        for (int i = 0; i < kCoroutines; ++i)
+        {
+            runtime.Spawn([&finished] {
+                for (int y = 0; y < kYields; ++y)
+                {
+                    Runtime::Yield();
+                }
+                ++finished;
+            });
+        }
+        while (finished.load() != kCoroutines)
+        {
+            std::this_thread::yield();
+        }
+    }
+    CoroutineStats::Totals after = CoroutineStats::Total();
+    assert(after.coroutines == before.coroutines + kCoroutines);
+    assert(after.sends == before.sends + kCoroutines * (kYields + 1));
+    assert(after.yields == before.yields + kCoroutines * kYields);
+    UnusedVariable(before);
+    UnusedVariable(after);
+    std::cout << "TestRuntime OK" << std::endl;
+}
+
+int main()
+{
+    TestCounts();
+    TestSelf();
+    TestHighWater();
+    TestRuntime();
+    return 0;
+}
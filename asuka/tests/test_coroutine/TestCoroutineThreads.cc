@@ -0,0 +1,77 @@
+//
+// Created by xi on 19-3-6.
+//
+
+#include <assert.h>
+#include <iostream>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <asuka/utils/Types.h>
+#include <asuka/coroutine/Coroutine.h>
+
+using namespace asuka;
+
+// every thread drives its own coroutines, values and ids must never mix up
+
+const int kThreads = 8;
+const int kCoroutinesPerThread = 100;
+const int kRounds = 1000;
+
+std::mutex g_mutex;
+std::set<unsigned int> g_ids;
+
+int Counter(int base)
+{
+    unsigned int id = Coroutine::GetCurrentId();
+    UnusedVariable(id);
+    for (int i = 0; i < kRounds; ++i)
+    {
+        assert(Coroutine::GetCurrentId() == id);
+        Coroutine::Yield(std::make_shared<int>(base + i));
+    }
+    return base + kRounds;
+}
+
+void ThreadFunc(int index)
+{
+    std::vector<CoroutinePtr> coroutines;
+    for (int i = 0; i < kCoroutinesPerThread; ++i)
+    {
+        coroutines.push_back(Coroutine::CreateCoroutine(Counter, (index * kCoroutinesPerThread + i) * kRounds * 2));
+        std::lock_guard<std::mutex> lock(g_mutex);
+        bool inserted = g_ids.insert(coroutines.back()->id()).second;
+        assert(inserted);
+        UnusedVariable(inserted);
+    }
+    for (int round = 0; round <= kRounds; ++round)
+    {
+        for (int i = 0; i < kCoroutinesPerThread; ++i)
+        {
+            VoidPtr value = Coroutine::Send(coroutines[i]);
+            int expect = (index * kCoroutinesPerThread + i) * kRounds * 2 + round;
+            assert(*std::static_pointer_cast<int>(value) == expect);
+            UnusedVariable(expect);
+        }
+    }
+}
+
+int main()
+{
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; ++i)
+    {
+        threads.emplace_back(ThreadFunc, i);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    assert(g_ids.size() == kThreads * kCoroutinesPerThread);
+    assert(g_ids.count(0) == 0);
+    std::cout << kThreads << " threads switched " << kThreads * kCoroutinesPerThread * kRounds
+              << " times independently" << std::endl;
+    return 0;
+}
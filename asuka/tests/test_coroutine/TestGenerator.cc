@@ -0,0 +1,122 @@
+//
+// Created by xi on 19-3-10.
+//
+
+#include <assert.h>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <asuka/utils/Types.h>
+#include <asuka/coroutine/Generator.h>
+
+using namespace asuka;
+
+void Range(int begin, int end)
+{
+    for (int i = begin; i < end; ++i)
+    {
+        Generator<int>::Yield(i);
+    }
+}
+
+// nested generators of the same type
+void Squares(int n)
+{
+    for (int i : Generator<int>(Range, 0, n))
+    {
+        Generator<int>::Yield(i * i);
+    }
+}
+
+// move-only values are moved, never copied
+void Pointers(int n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        Generator<std::unique_ptr<int>>::Yield(std::make_unique<int>(i));
+    }
+}
+
+std::string Join(const std::string& sep)
+{
+    std::string result;
+    std::string word = TypedCoroutine<std::string, std::string>::Yield(result);
+    while (!word.empty())
+    {
+        result += result.empty() ? word : sep + word;
+        word = TypedCoroutine<std::string, std::string>::Yield(result);
+    }
+    return result;
+}
+
+int main()
+{
+    std::vector<int> values;
+    for (int i : Generator<int>(Range, 3, 7))
+    {
+        values.push_back(i);
+    }
+    assert((values == std::vector<int>{3, 4, 5, 6}));
+
+    values.clear();
+    for (int i : Generator<int>(Squares, 5))
+    {
+        values.push_back(i);
+    }
+    assert((values == std::vector<int>{0, 1, 4, 9, 16}));
+
+    int expect = 0;
+    Generator<std::unique_ptr<int>> pointers(Pointers, 3);
+    while (pointers.Next())
+    {
+        std::unique_ptr<int> p = std::move(pointers.Value());
+        assert(*p == expect);
+        ++expect;
+    }
+    assert(expect == 3 && pointers.done());
+    UnusedVariable(expect);
+
+    // empty generator
+    for (int i : Generator<int>(Range, 0, 0))
+    {
+        assert(false);
+        UnusedVariable(i);
+    }
+
+    TypedCoroutine<std::string, std::string> join(Join, ", ");
+    std::string joined = join.Start();
+    assert(joined.empty());
+    joined = join.Send("a");
+    assert(joined == "a");
+    joined = join.Send(std::string("b"));
+    assert(joined == "a, b");
+    joined = join.Send("c");
+    assert(joined == "a, b, c");
+    assert(!join.done());
+    joined = join.Send("");
+    assert(joined == "a, b, c");
+    assert(join.done());
+
+    // resuming a started one without value throws to the caller
+    TypedCoroutine<std::string, std::string> twice(Join, ", ");
+    twice.Start();
+    bool thrown = false;
+    try
+    {
+        twice.Start();
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    UnusedVariable(thrown);
+    joined = twice.Send("a");
+    assert(joined == "a");
+
+    std::cout << "Generator and TypedCoroutine OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,155 @@
+//
+// Created by xi on 19-3-15.
+//
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+
+#include <asuka/utils/Types.h>
+#include <asuka/coroutine/Reactor.h>
+
+using namespace asuka;
+
+// loopback echo server and clients on one reactor thread
+
+const int kClients = 200;
+const int kMessages = 20;
+
+int g_finished = 0;
+
+int ListenLoopback(uint16_t* port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    assert(fd >= 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    int ret = ::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    assert(ret == 0);
+    ret = ::listen(fd, 1024);
+    assert(ret == 0);
+    socklen_t len = sizeof(addr);
+    ret = ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+    assert(ret == 0);
+    UnusedVariable(ret);
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+void Echo(Reactor* reactor, int fd)
+{
+    char buf[256];
+    ssize_t n;
+    while ((n = reactor->Read(fd, buf, sizeof(buf))) > 0)
+    {
+        ssize_t written = reactor->Write(fd, buf, static_cast<size_t>(n));
+        assert(written == n);
+        UnusedVariable(written);
+    }
+    reactor->Close(fd);
+}
+
+void Server(Reactor* reactor, int listen_fd)
+{
+    while (true)
+    {
+        int fd = reactor->Accept(listen_fd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            break; // listen_fd closed
+        }
+        reactor->Spawn(Echo, reactor, fd);
+    }
+}
+
+void Client(Reactor* reactor, uint16_t port, int index)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    int ret = reactor->Connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    assert(ret == 0);
+    UnusedVariable(ret);
+    for (int i = 0; i < kMessages; ++i)
+    {
+        std::string msg = "client " + std::to_string(index) + " message " + std::to_string(i);
+        reactor->Write(fd, msg.data(), msg.size());
+        std::string reply;
+        while (reply.size() < msg.size())
+        {
+            char buf[64];
+            ssize_t n = reactor->Read(fd, buf, sizeof(buf));
+            assert(n > 0);
+            reply.append(buf, static_cast<size_t>(n));
+        }
+        assert(reply == msg);
+    }
+    reactor->Close(fd);
+    if (++g_finished == kClients)
+    {
+        reactor->Stop();
+    }
+}
+
+// a waiter woken by Close does not touch the fd number, reused at once here
+void TestCloseWakesWaiters()
+{
+    Reactor reactor;
+    int pair[2];
+    int ret = ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, pair);
+    assert(ret == 0);
+    UnusedVariable(ret);
+    int reused[2] = {-1, -1};
+    ssize_t n = 0;
+    int error = 0;
+    reactor.Spawn([&] {
+        char c;
+        n = reactor.Read(pair[0], &c, 1);
+        error = errno;
+        reactor.Stop();
+    });
+    reactor.Spawn([&] {
+        reactor.Close(pair[0]);
+        int r = ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, reused);
+        assert(r == 0 && reused[0] == pair[0]);
+        UnusedVariable(r);
+        // readable, a reader going back to it would get this byte
+        ssize_t w = ::write(reused[1], "x", 1);
+        UnusedVariable(w);
+    });
+    reactor.Loop();
+    assert(n == -1 && error == EBADF);
+    ::close(pair[1]);
+    ::close(reused[0]);
+    ::close(reused[1]);
+    std::cout << "TestCloseWakesWaiters OK" << std::endl;
+}
+
+int main()
+{
+    Reactor reactor;
+    uint16_t port = 0;
+    int listen_fd = ListenLoopback(&port);
+    reactor.Spawn(Server, &reactor, listen_fd);
+    for (int i = 0; i < kClients; ++i)
+    {
+        reactor.Spawn(Client, &reactor, port, i);
+    }
+    reactor.Loop();
+    assert(g_finished == kClients);
+    ::close(listen_fd);
+    std::cout << kClients << " clients echoed " << kMessages << " messages each on one thread" << std::endl;
+    TestCloseWakesWaiters();
+    return 0;
+}
@@ -0,0 +1,94 @@
+//
+// Created by xi on 19-3-12.
+//
+
+#include <assert.h>
+#include <iostream>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <asuka/utils/Types.h>
+#include <asuka/coroutine/Runtime.h>
+
+using namespace asuka;
+
+const int kCoroutines = 1000;
+const int kYields = 20;
+
+std::atomic<int> g_finished(0);
+std::atomic<long> g_sum(0);
+
+void Worker(int index)
+{
+    for (int i = 0; i < kYields; ++i)
+    {
+        g_sum += index;
+        Runtime::Yield();
+    }
+    ++g_finished;
+}
+
+std::atomic<bool> g_parked(false);
+std::atomic<bool> g_woken(false);
+
+void Sleeper()
+{
+    g_parked = true;
+    Runtime::Park();
+    g_woken = true;
+}
+
+template <typename Pred>
+void WaitFor(Pred pred)
+{
+    while (!pred())
+    {
+        std::this_thread::yield();
+    }
+}
+
+int main()
+{
+    Runtime runtime(4);
+    assert(runtime.num_workers() == 4);
+    assert(Runtime::Current() == nullptr);
+
+    for (int i = 0; i < kCoroutines; ++i)
+    {
+        runtime.Spawn(Worker, i);
+    }
+    WaitFor([] { return g_finished.load() == kCoroutines; });
+    assert(g_sum.load() == static_cast<long>(kCoroutines - 1) * kCoroutines / 2 * kYields);
+
+    // park and wake up from another thread
+    CoroutinePtr sleeper(runtime.Spawn(Sleeper));
+    WaitFor([] { return g_parked.load(); });
+    runtime.Ready(sleeper);
+    WaitFor([] { return g_woken.load(); });
+
+    // spawn from coroutines
+    std::atomic<int> children(0);
+    runtime.Spawn([&runtime, &children] {
+        assert(Runtime::Current() == &runtime);
+        for (int i = 0; i < 100; ++i)
+        {
+            runtime.Spawn([&children] { ++children; });
+        }
+    });
+    WaitFor([&children] { return children.load() == 100; });
+
+    uint64_t resumed = 0;
+    for (const auto& stats : runtime.Stats())
+    {
+        resumed += stats.resumed;
+        assert(stats.utilization >= 0.0 && stats.utilization <= 1.0);
+    }
+    assert(resumed >= kCoroutines * (kYields + 1));
+    UnusedVariable(resumed);
+    std::cout << "Runtime resumed " << resumed << " times on "
+              << runtime.num_workers() << " workers" << std::endl;
+    return 0;
+}
@@ -0,0 +1,105 @@
+//
+// Created by xi on 19-3-8.
+//
+
+#include <assert.h>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <asuka/utils/Types.h>
+#include <asuka/coroutine/Coroutine.h>
+
+using namespace asuka;
+
+// coroutines interleave on one shared stack, locals must survive the copies
+
+int Fib(int n)
+{
+    return n < 2 ? n : Fib(n - 1) + Fib(n - 2);
+}
+
+std::string Worker(int index, int rounds)
+{
+    char local[256];
+    for (size_t i = 0; i < sizeof(local); ++i)
+    {
+        local[i] = static_cast<char>(index + static_cast<int>(i));
+    }
+    int sum = 0;
+    for (int i = 0; i < rounds; ++i)
+    {
+        sum += Fib(index % 10);
+        VoidPtr msg = Coroutine::Yield(std::make_shared<int>(index * 1000 + i));
+        assert(!msg || *std::static_pointer_cast<int>(msg) == i);
+    }
+    for (size_t i = 0; i < sizeof(local); ++i)
+    {
+        assert(local[i] == static_cast<char>(index + static_cast<int>(i)));
+    }
+    return std::to_string(index) + ":" + std::to_string(sum);
+}
+
+// a Send rejected for the same shared stack leaves no value behind
+void TestSameStackRejected()
+{
+    SharedStackPtr shared_stack(std::make_shared<SharedStack>());
+    CoroutinePtr other = Coroutine::CreateCoroutineOnSharedStack(shared_stack, [] { Coroutine::Yield(); });
+    Coroutine::Send(other);
+    bool thrown = false;
+    CoroutinePtr sender = Coroutine::CreateCoroutineOnSharedStack(shared_stack, [&other, &thrown] {
+        try
+        {
+            Coroutine::Send(other, std::make_shared<int>(1));
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+        Coroutine::Yield();
+    });
+    VoidPtr value = Coroutine::Send(sender);
+    assert(thrown);
+    assert(!value);
+    UnusedVariable(thrown);
+    UnusedVariable(value);
+    std::cout << "TestSameStackRejected OK" << std::endl;
+}
+
+int main()
+{
+    const int kCoroutines = 16;
+    const int kRounds = 50;
+
+    SharedStackPtr shared_stack(std::make_shared<SharedStack>());
+    std::vector<CoroutinePtr> coroutines;
+    for (int i = 0; i < kCoroutines; ++i)
+    {
+        coroutines.push_back(Coroutine::CreateCoroutineOnSharedStack(shared_stack, Worker, i, kRounds));
+    }
+    for (int round = 0; round < kRounds; ++round)
+    {
+        for (int i = 0; i < kCoroutines; ++i)
+        {
+            VoidPtr value = round == 0 ? Coroutine::Send(coroutines[i])
+                                       : Coroutine::Send(coroutines[i], std::make_shared<int>(round - 1));
+            assert(*std::static_pointer_cast<int>(value) == i * 1000 + round);
+            UnusedVariable(value);
+        }
+    }
+    for (int i = 0; i < kCoroutines; ++i)
+    {
+        VoidPtr result = Coroutine::Send(coroutines[i], std::make_shared<int>(kRounds - 1));
+        std::string expect = std::to_string(i) + ":" + std::to_string(Fib(i % 10) * kRounds);
+        assert(*std::static_pointer_cast<std::string>(result) == expect);
+        UnusedVariable(result);
+        // parked coroutines only keep their live frames
+        assert(coroutines[i]->max_saved_size() > sizeof(char[256]));
+        assert(coroutines[i]->max_saved_size() < SharedStack::kDefaultSharedStackSize);
+    }
+    std::cout << kCoroutines << " coroutines on one shared stack, max saved "
+              << coroutines[0]->max_saved_size() << " bytes" << std::endl;
+    TestSameStackRejected();
+    return 0;
+}
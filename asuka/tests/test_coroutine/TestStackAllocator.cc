@@ -0,0 +1,111 @@
+//
+// Created by xi on 19-3-4.
+//
+
+#include <assert.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <iostream>
+
+#include <asuka/utils/Types.h>
+#include <asuka/coroutine/Coroutine.h>
+
+using namespace asuka;
+
+int Recurse(int depth)
+{
+    volatile char buf[1024];
+    buf[0] = static_cast<char>(depth);
+    if (depth > 1024 * 1024)
+    {
+        return 0;
+    }
+    return Recurse(depth + 1) + buf[0];
+}
+
+void Overflow()
+{
+    Recurse(0);
+}
+
+// a pooled allocator remembering the last stack it gave
+class RecordingStackAllocator : public StackAllocator
+{
+public:
+    Stack Allocate(size_t size) override
+    {
+        Stack stack = pooled_.Allocate(size);
+        last_base_ = stack.base;
+        return stack;
+    }
+
+    void Deallocate(const Stack& stack) override
+    {
+        pooled_.Deallocate(stack);
+    }
+
+    char* last_base() const
+    {
+        return last_base_;
+    }
+
+private:
+    PooledStackAllocator pooled_;
+    char* last_base_ = nullptr;
+};
+
+int main()
+{
+    PooledStackAllocator allocator;
+
+    // freed stack is reused by the same size class
+    Stack s1 = allocator.Allocate(8 * 1024);
+    assert(s1.size >= 8 * 1024);
+    s1.base[0] = 1;
+    s1.base[s1.size - 1] = 1;
+    allocator.Deallocate(s1);
+    Stack s2 = allocator.Allocate(8 * 1024);
+    assert(s2.base == s1.base);
+    Stack s3 = allocator.Allocate(64 * 1024);
+    assert(s3.base != s2.base && s3.size >= 64 * 1024);
+    allocator.Deallocate(s2);
+    allocator.Deallocate(s3);
+
+    // coroutine stack is reused after the coroutine is destroyed
+    StackAllocator* default_allocator = StackAllocator::Default();
+    RecordingStackAllocator recording;
+    StackAllocator::SetDefault(&recording);
+    char* first_base = nullptr;
+    {
+        CoroutinePtr co1(Coroutine::CreateCoroutine([] { return 1; }));
+        first_base = recording.last_base();
+        VoidPtr value = Coroutine::Send(co1);
+        assert(*std::static_pointer_cast<int>(value) == 1);
+        UnusedVariable(value);
+    }
+    {
+        CoroutinePtr co2(Coroutine::CreateCoroutine([] { return 2; }));
+        assert(recording.last_base() == first_base);
+        VoidPtr value = Coroutine::Send(co2);
+        assert(*std::static_pointer_cast<int>(value) == 2);
+        UnusedVariable(value);
+    }
+    StackAllocator::SetDefault(default_allocator);
+    UnusedVariable(first_base);
+
+    // stack overflow hits the guard page
+    pid_t pid = ::fork();
+    assert(pid >= 0);
+    if (pid == 0)
+    {
+        CoroutinePtr co(Coroutine::CreateCoroutine(Overflow));
+        Coroutine::Send(co);
+        _exit(0);
+    }
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+    std::cout << "stack overflow is caught by guard page" << std::endl;
+    return 0;
+}
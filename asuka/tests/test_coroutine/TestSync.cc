@@ -0,0 +1,187 @@
+//
+// Created by xi on 19-3-20.
+//
+
+#include <assert.h>
+#include <iostream>
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+#include <asuka/utils/Types.h>
+#include <asuka/coroutine/Runtime.h>
+#include <asuka/coroutine/Sync.h>
+
+using namespace asuka;
+
+const int kCoroutines = 1000;
+const int kRounds = 100;
+
+// the lock is held across Runtime::Yield, other coroutines of the worker keep running
+void Increase(CoMutex* mutex, long* counter, WaitGroup* wg)
+{
+    for (int i = 0; i < kRounds; ++i)
+    {
+        std::lock_guard<CoMutex> lock(*mutex);
+        long value = *counter;
+        if (i % 10 == 0)
+        {
+            Runtime::Yield();
+        }
+        *counter = value + 1;
+    }
+    wg->Done();
+}
+
+struct Channel
+{
+    CoMutex mutex;
+    CoConditionVariable not_empty;
+    std::deque<int> items;
+    bool closed = false;
+};
+
+void Produce(Channel* channel, int n)
+{
+    for (int i = 1; i <= n; ++i)
+    {
+        std::lock_guard<CoMutex> lock(channel->mutex);
+        channel->items.push_back(i);
+        channel->not_empty.NotifyOne();
+    }
+    std::lock_guard<CoMutex> lock(channel->mutex);
+    channel->closed = true;
+    channel->not_empty.NotifyAll();
+}
+
+void Consume(Channel* channel, std::atomic<long>* sum, WaitGroup* wg)
+{
+    while (true)
+    {
+        std::unique_lock<CoMutex> lock(channel->mutex);
+        channel->not_empty.Wait(channel->mutex, [channel] {
+            return !channel->items.empty() || channel->closed;
+        });
+        if (channel->items.empty())
+        {
+            break;
+        }
+        *sum += channel->items.front();
+        channel->items.pop_front();
+    }
+    wg->Done();
+}
+
+void Limited(CoSemaphore* sem, std::atomic<int>* inside, std::atomic<int>* max_inside, WaitGroup* wg)
+{
+    sem->Acquire();
+    int now = ++*inside;
+    int max = max_inside->load();
+    while (now > max && !max_inside->compare_exchange_weak(max, now))
+    {
+    }
+    Runtime::Yield();
+    --*inside;
+    sem->Release();
+    wg->Done();
+}
+
+int main()
+{
+    Runtime runtime(4);
+
+    // mutual exclusion, main thread waits on WaitGroup
+    {
+        CoMutex mutex;
+        long counter = 0;
+        WaitGroup wg;
+        wg.Add(kCoroutines);
+        for (int i = 0; i < kCoroutines; ++i)
+        {
+            runtime.Spawn(Increase, &mutex, &counter, &wg);
+        }
+        wg.Wait();
+        assert(counter == static_cast<long>(kCoroutines) * kRounds);
+        bool locked = mutex.TryLock();
+        assert(locked);
+        mutex.Unlock();
+        UnusedVariable(counter);
+        UnusedVariable(locked);
+    }
+
+    // producer and consumers on a condition variable
+    {
+        Channel channel;
+        std::atomic<long> sum(0);
+        const int kItems = 10000;
+        const int kConsumers = 16;
+        WaitGroup wg;
+        wg.Add(kConsumers);
+        for (int i = 0; i < kConsumers; ++i)
+        {
+            runtime.Spawn(Consume, &channel, &sum, &wg);
+        }
+        runtime.Spawn(Produce, &channel, kItems);
+        wg.Wait();
+        assert(sum == static_cast<long>(kItems) * (kItems + 1) / 2);
+    }
+
+    // at most kPermits coroutines inside
+    {
+        const int kPermits = 3;
+        CoSemaphore sem(kPermits);
+        std::atomic<int> inside(0);
+        std::atomic<int> max_inside(0);
+        WaitGroup wg;
+        wg.Add(kCoroutines);
+        for (int i = 0; i < kCoroutines; ++i)
+        {
+            runtime.Spawn(Limited, &sem, &inside, &max_inside, &wg);
+        }
+        wg.Wait();
+        assert(max_inside <= kPermits && max_inside > 0);
+        int acquired = 0;
+        while (sem.TryAcquire())
+        {
+            ++acquired;
+        }
+        assert(acquired == kPermits);
+        UnusedVariable(acquired);
+    }
+
+    // WaitGroup waited in coroutines too
+    {
+        WaitGroup start;
+        WaitGroup done;
+        std::atomic<int> passed(0);
+        start.Add(1);
+        done.Add(kCoroutines);
+        for (int i = 0; i < kCoroutines; ++i)
+        {
+            runtime.Spawn([&] {
+                start.Wait();
+                ++passed;
+                done.Done();
+            });
+        }
+        assert(passed == 0);
+        start.Done();
+        done.Wait();
+        assert(passed == kCoroutines);
+
+        bool thrown = false;
+        try
+        {
+            done.Done();
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+        UnusedVariable(thrown);
+    }
+
+    std::cout << "sync test passed" << std::endl;
+    return 0;
+}
@@ -2,6 +2,736 @@
 // Created by xi on 19-2-19.
 //
 
+#include <assert.h>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <asuka/utils/Types.h>
+#include <asuka/utils/EventLoopScheduler.h>
 #include <asuka/futures/Future.h>
 #include <asuka/futures/Helper.h>
-#include <asuka/futures/Try.h>
\ No newline at end of file
+#include <asuka/futures/Try.h>
+
+using namespace asuka;
+
+void TestThen()
+{
+    // value before Then
+    {
+        Promise<int> pm;
+        auto fut = pm.GetFuture();
+        pm.SetValue(1);
+        assert(fut.IsReady());
+        int result = 0;
+        fut.Then([&result](int v) { result = v; });
+        assert(result == 1);
+    }
+    // value after Then
+    {
+        Promise<int> pm;
+        auto fut = pm.GetFuture();
+        int result = 0;
+        auto next = fut.Then([&result](int v) { result = v; return std::to_string(v); });
+        assert(result == 0);
+        assert(!next.IsReady());
+        pm.SetValue(2);
+        assert(result == 2);
+        auto str = next.Wait();
+        assert(str.Value() == "2");
+    }
+    // only the first value counts
+    {
+        Promise<int> pm;
+        auto fut = pm.GetFuture();
+        pm.SetValue(1);
+        pm.SetValue(2);
+        auto v = fut.Wait();
+        assert(v.Value() == 1);
+    }
+    // chained, void and Try
+    {
+        Promise<int> pm;
+        int result = 0;
+        bool called = false;
+        auto last = pm.GetFuture()
+            .Then([](int v) { return v + 1; })
+            .Then([&result](int&& v) { result = v; })
+            .Then([&called](Try<void>&& t) { called = t.HasValue(); });
+        pm.SetValue(1);
+        assert(result == 2);
+        assert(called);
+        assert(last.IsReady());
+    }
+    // a generic lambda gets the value, a Try one the Try
+    {
+        Promise<int> pm;
+        int result = 0;
+        bool has_value = false;
+        auto last = pm.GetFuture()
+            .Then([&result](auto v) { result = v; return v + 1; })
+            .Then([&has_value](Try<int>&& t) { has_value = t.HasValue(); });
+        pm.SetValue(1);
+        assert(result == 1);
+        assert(has_value);
+        assert(last.IsReady());
+    }
+    // future of void
+    {
+        Promise<void> pm;
+        int result = 0;
+        pm.GetFuture().Then([&result] { result = 1; });
+        pm.SetValue();
+        assert(result == 1);
+    }
+    std::cout << "Then test passed" << std::endl;
+}
+
+void TestException()
+{
+    // skips callbacks not taking Try
+    {
+        Promise<int> pm;
+        bool skipped = true;
+        bool caught = false;
+        pm.GetFuture()
+            .Then([&skipped](int v) { skipped = false; return v; })
+            .Then([&caught](Try<int>&& t) { caught = t.HasException(); });
+        pm.SetException(std::make_exception_ptr(std::runtime_error("error")));
+        assert(skipped);
+        assert(caught);
+    }
+    // thrown by callback
+    {
+        Promise<int> pm;
+        auto fut = pm.GetFuture().Then([](int) -> int { throw std::runtime_error("error"); });
+        pm.SetValue(1);
+        auto t = fut.Wait();
+        assert(t.HasException());
+    }
+    {
+        auto fut = MakeExceptionFuture<int>(std::runtime_error("error"));
+        auto t = fut.Wait();
+        assert(t.HasException());
+    }
+    std::cout << "Exception test passed" << std::endl;
+}
+
+void TestFutureReturn()
+{
+    Promise<int> outer;
+    Promise<std::string> inner;
+    auto inner_future = std::make_shared<Future<std::string>>(inner.GetFuture());
+    std::string result;
+    outer.GetFuture()
+        .Then([inner_future](int) { return std::move(*inner_future); })
+        .Then([&result](std::string&& s) { result = s; });
+    outer.SetValue(1);
+    assert(result.empty());
+    inner.SetValue(std::string("inner"));
+    assert(result == "inner");
+
+    // Unwrap
+    Promise<Future<int>> nested;
+    Promise<int> value;
+    auto unwrapped = nested.GetFuture().Unwrap();
+    nested.SetValue(value.GetFuture());
+    assert(!unwrapped.IsReady());
+    value.SetValue(3);
+    auto v = unwrapped.Wait();
+    assert(v.Value() == 3);
+    std::cout << "Future return test passed" << std::endl;
+}
+
+void TestWait()
+{
+    Promise<int> pm;
+    auto fut = pm.GetFuture();
+    std::thread t([&pm] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        pm.SetValue(1);
+    });
+    auto v = fut.Wait();
+    assert(v.Value() == 1);
+    t.join();
+
+    // wait more than once
+    bool thrown = false;
+    try
+    {
+        fut.Wait();
+    }
+    catch (std::runtime_error& e)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+
+    Promise<int> never;
+    auto late = never.GetFuture();
+    thrown = false;
+    try
+    {
+        late.Wait(std::chrono::milliseconds(10));
+    }
+    catch (std::runtime_error& e)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    UnusedVariable(thrown);
+    // the callback left by Wait outlives it
+    never.SetValue(1);
+    std::cout << "Wait test passed" << std::endl;
+}
+
+void TestTimeout()
+{
+    EventLoopScheduler sched;
+    std::thread loop([&sched] { sched.Loop(); });
+
+    std::atomic<int> timeouts(0);
+    Promise<int> late;
+    auto late_future = late.GetFuture();
+    late_future.OnTimeout(std::chrono::milliseconds(10), [&timeouts] { ++timeouts; }, &sched);
+
+    Promise<int> early;
+    auto early_future = early.GetFuture();
+    early_future.OnTimeout(std::chrono::milliseconds(10), [&timeouts] { timeouts += 100; }, &sched);
+    early.SetValue(1);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    assert(timeouts == 1);
+    // dropped after timeout
+    late.SetValue(1);
+    assert(!late_future.IsReady());
+
+    // Wait gives up when the future times out
+    Promise<int> waited;
+    auto waited_future = waited.GetFuture();
+    waited_future.OnTimeout(std::chrono::milliseconds(10), [] {}, &sched);
+    auto start = std::chrono::steady_clock::now();
+    bool thrown = false;
+    try
+    {
+        waited_future.Wait(std::chrono::seconds(10));
+    }
+    catch (std::runtime_error& e)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    UnusedVariable(thrown);
+    UnusedVariable(start);
+
+    // callbacks run in the scheduler
+    Promise<int> pm;
+    std::atomic<bool> in_loop(false);
+    auto fut = pm.GetFuture().Then(&sched, [&sched, &in_loop](int v) {
+        in_loop = sched.IsInLoopThread();
+        return v;
+    });
+    pm.SetValue(1);
+    auto v = fut.Wait();
+    assert(v.Value() == 1);
+    assert(in_loop);
+
+    // continuations for the loop run inline once in it
+    {
+        const int kStages = 5;
+        uint64_t saved = sched.hops_saved();
+        Promise<int> chain;
+        auto last = chain.GetFuture();
+        for (int i = 0; i < kStages; ++i)
+        {
+            last = last.Then(&sched, [&sched](int n) {
+                assert(sched.IsInLoopThread());
+                return n + 1;
+            });
+        }
+        // set outside the loop, only the first stage goes through the queue
+        chain.SetValue(0);
+        auto result = last.Wait();
+        assert(result.Value() == kStages);
+        assert(sched.hops_saved() - saved == kStages - 1);
+
+        // set in the loop, none does
+        saved = sched.hops_saved();
+        Promise<int> in_loop_chain;
+        auto in_loop_last = in_loop_chain.GetFuture();
+        for (int i = 0; i < kStages; ++i)
+        {
+            in_loop_last = in_loop_last.Then(&sched, [](int n) { return n + 1; });
+        }
+        sched.Schedule([&in_loop_chain] { in_loop_chain.SetValue(0); });
+        result = in_loop_last.Wait();
+        assert(result.Value() == kStages);
+        assert(sched.hops_saved() - saved == kStages);
+        UnusedVariable(saved);
+    }
+    // deep chains stop nesting and go through the queue
+    {
+        const int kStages = 1000;
+        Promise<int> chain;
+        auto last = chain.GetFuture();
+        for (int i = 0; i < kStages; ++i)
+        {
+            last = last.Then(&sched, [](int n) { return n + 1; });
+        }
+        sched.Schedule([&chain] { chain.SetValue(0); });
+        auto result = last.Wait();
+        assert(result.Value() == kStages);
+    }
+
+    sched.Stop();
+    loop.join();
+    std::cout << "Timeout test passed" << std::endl;
+}
+
+void TestRace()
+{
+    // SetValue and Then racing from two threads, the callback runs exactly once
+    const int kRounds = 10000;
+    std::atomic<int> called(0);
+    for (int i = 0; i < kRounds; ++i)
+    {
+        Promise<int> pm;
+        auto fut = pm.GetFuture();
+        std::thread t([&pm, i] { pm.SetValue(i); });
+        fut.Then([&called, i](int v) {
+            assert(v == i);
+            UnusedVariable(v);
+            ++called;
+        });
+        t.join();
+    }
+    assert(called == kRounds);
+    UnusedVariable(called);
+    std::cout << "Race test passed" << std::endl;
+}
+
+void TestWhen()
+{
+    // all, in order of the futures whatever the order of completion
+    {
+        std::vector<Promise<int>> pms(5);
+        std::vector<Future<int>> futs;
+        for (auto& pm : pms)
+        {
+            futs.push_back(pm.GetFuture());
+        }
+        auto all = WhenAll(futs.begin(), futs.end());
+        for (int i = 4; i >= 0; --i)
+        {
+            assert(!all.IsReady());
+            if (i == 2)
+            {
+                pms[i].SetException(std::make_exception_ptr(std::runtime_error("error")));
+            }
+            else
+            {
+                pms[i].SetValue(i * 10);
+            }
+        }
+        auto results = all.Wait().Value();
+        assert(results.size() == 5);
+        assert(results[0].Value() == 0);
+        assert(results[2].HasException());
+        assert(results[4].Value() == 40);
+    }
+    {
+        std::vector<Future<int>> none;
+        auto all = WhenAll(none.begin(), none.end());
+        assert(all.IsReady());
+    }
+    // variadic, of different types
+    {
+        Promise<int> pm1;
+        Promise<std::string> pm2;
+        Promise<void> pm3;
+        auto all = WhenAll(pm1.GetFuture(), pm2.GetFuture(), pm3.GetFuture());
+        pm3.SetValue();
+        pm2.SetValue(std::string("2"));
+        assert(!all.IsReady());
+        pm1.SetValue(1);
+        auto results = all.Wait().Value();
+        assert(std::get<0>(results).Value() == 1);
+        assert(std::get<1>(results).Value() == "2");
+        assert(std::get<2>(results).HasValue());
+    }
+    {
+        auto all = WhenAll();
+        assert(all.IsReady());
+    }
+    // any, the first wins
+    {
+        std::vector<Promise<int>> pms(3);
+        std::vector<Future<int>> futs;
+        for (auto& pm : pms)
+        {
+            futs.push_back(pm.GetFuture());
+        }
+        auto any = WhenAny(futs.begin(), futs.end());
+        pms[1].SetValue(1);
+        pms[0].SetValue(0);
+        auto result = any.Wait().Value();
+        assert(result.first == 1);
+        assert(result.second.Value() == 1);
+    }
+    {
+        Promise<int> pm1;
+        Promise<int> pm2;
+        auto any = WhenAny(pm1.GetFuture(), pm2.GetFuture());
+        pm2.SetValue(2);
+        auto result = any.Wait().Value();
+        assert(result.first == 1);
+        assert(result.second.Value() == 2);
+    }
+    {
+        std::vector<Future<int>> none;
+        auto any = WhenAny(none.begin(), none.end());
+        auto result = any.Wait();
+        assert(result.HasException());
+        UnusedVariable(result);
+    }
+    // n, in order of completion
+    {
+        std::vector<Promise<int>> pms(4);
+        std::vector<Future<int>> futs;
+        for (auto& pm : pms)
+        {
+            futs.push_back(pm.GetFuture());
+        }
+        auto n = WhenN(2, futs.begin(), futs.end());
+        pms[3].SetValue(3);
+        assert(!n.IsReady());
+        pms[1].SetValue(1);
+        pms[0].SetValue(0);
+        auto results = n.Wait().Value();
+        assert(results.size() == 2);
+        assert(results[0].first == 3);
+        assert(results[1].first == 1);
+        assert(results[1].second.Value() == 1);
+    }
+    // completed from many threads
+    {
+        const int kFutures = 1000;
+        std::vector<Promise<int>> pms(kFutures);
+        std::vector<Future<int>> futs;
+        for (auto& pm : pms)
+        {
+            futs.push_back(pm.GetFuture());
+        }
+        auto all = WhenAll(futs.begin(), futs.end());
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&pms, t] {
+                for (int i = t; i < kFutures; i += 4)
+                {
+                    pms[i].SetValue(i);
+                }
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        auto results = all.Wait().Value();
+        for (int i = 0; i < kFutures; ++i)
+        {
+            assert(results[i].Value() == i);
+        }
+    }
+    std::cout << "When test passed" << std::endl;
+}
+
+// counts live instances
+struct Counted
+{
+    static std::atomic<int> alive;
+
+    Counted() { ++alive; }
+    Counted(const Counted&) { ++alive; }
+    Counted(Counted&&) { ++alive; }
+    Counted& operator=(const Counted&) = default;
+    Counted& operator=(Counted&&) = default;
+    ~Counted() { --alive; }
+};
+
+std::atomic<int> Counted::alive(0);
+
+void TestRelease()
+{
+    static_assert(alignof(detail::State<int>) == detail::kCacheLineSize, "State is cache line aligned");
+    // values and callback captures are released with the last handle
+    {
+        Promise<Counted> pm;
+        auto fut = pm.GetFuture()
+            .Then([c = Counted()](Counted&& v) { return std::move(v); })
+            .Then([](Counted&& v) { return std::move(v); });
+        pm.SetValue(Counted());
+        assert(fut.IsReady());
+    }
+    assert(Counted::alive == 0);
+    {
+        Promise<Counted> pm;
+        pm.GetFuture().Then([c = Counted()](Counted&& ) {});
+        // never set
+    }
+    assert(Counted::alive == 0);
+    std::cout << "Release test passed" << std::endl;
+}
+
+bool IsCancelled(const Try<int>& t)
+{
+    try
+    {
+        t.Check();
+    }
+    catch (const FutureCancelled&)
+    {
+        return true;
+    }
+    catch (...)
+    {
+    }
+    return false;
+}
+
+void TestCancel()
+{
+    // the stages after the cancel point are dropped, the producer is told
+    {
+        Promise<int> pm;
+        int handled = 0;
+        int ran = 0;
+        pm.SetInterruptHandler([&handled] { ++handled; });
+        auto fut = pm.GetFuture()
+            .Then([&ran](int v) { ++ran; return v + 1; })
+            .Then([&ran, c = Counted()](int v) { ++ran; return v + 1; });
+        assert(!pm.IsCancelled());
+        fut.Cancel();
+        assert(pm.IsCancelled());
+        assert(handled == 1);
+        assert(fut.IsReady());
+        auto result = fut.Wait();
+        assert(IsCancelled(result));
+        UnusedVariable(result);
+        // a late value goes nowhere
+        pm.SetValue(1);
+        assert(ran == 0);
+        // a handler set after the cancel runs at once
+        pm.SetInterruptHandler([&handled] { ++handled; });
+        assert(handled == 2);
+    }
+    assert(Counted::alive == 0);
+    // a ready future keeps its value
+    {
+        Promise<int> pm;
+        auto fut = pm.GetFuture();
+        pm.SetValue(1);
+        fut.Cancel();
+        int value = fut.Wait().Value();
+        assert(value == 1);
+        UnusedVariable(value);
+    }
+    // cancelled while queued on a scheduler
+    {
+        EventLoopScheduler loop;
+        Promise<int> pm;
+        bool ran = false;
+        auto fut = pm.GetFuture().Then(&loop, [&ran](int v) { ran = true; return v; });
+        pm.SetValue(1);
+        fut.Cancel();
+        loop.Schedule([&loop] { loop.Stop(); });
+        loop.Loop();
+        assert(!ran);
+        auto result = fut.Wait();
+        assert(IsCancelled(result));
+        UnusedVariable(result);
+    }
+    // the inner future of a future-returning Then, and of Unwrap
+    {
+        Promise<int> outer;
+        Promise<int> inner;
+        bool inner_cancelled = false;
+        inner.SetInterruptHandler([&inner_cancelled] { inner_cancelled = true; });
+        auto fut = outer.GetFuture().Then([&inner](int) { return inner.GetFuture(); });
+        outer.SetValue(1);
+        fut.Cancel();
+        assert(inner_cancelled);
+        auto result = fut.Wait();
+        assert(IsCancelled(result));
+        UnusedVariable(result);
+
+        Promise<Future<int>> outer2;
+        Promise<int> inner2;
+        auto unwrapped = outer2.GetFuture().Unwrap();
+        outer2.SetValue(inner2.GetFuture());
+        unwrapped.Cancel();
+        assert(inner2.IsCancelled());
+        UnusedVariable(inner_cancelled);
+    }
+    // WhenAny cancels the losers once it has a winner, WhenN those not taken
+    {
+        std::vector<Promise<int>> pms(3);
+        std::vector<Future<int>> futs;
+        for (auto& pm : pms)
+        {
+            futs.push_back(pm.GetFuture());
+        }
+        auto any = WhenAny(futs.begin(), futs.end());
+        pms[1].SetValue(1);
+        assert(!pms[1].IsCancelled());
+        assert(pms[0].IsCancelled());
+        assert(pms[2].IsCancelled());
+        size_t winner = any.Wait().Value().first;
+        assert(winner == 1);
+        UnusedVariable(winner);
+
+        std::vector<Promise<int>> pms2(3);
+        std::vector<Future<int>> futs2;
+        for (auto& pm : pms2)
+        {
+            futs2.push_back(pm.GetFuture());
+        }
+        auto n = WhenN(2, futs2.begin(), futs2.end());
+        pms2[2].SetValue(2);
+        pms2[0].SetValue(0);
+        assert(pms2[1].IsCancelled());
+        assert(!pms2[0].IsCancelled());
+        size_t taken = n.Wait().Value().size();
+        assert(taken == 2);
+        UnusedVariable(taken);
+    }
+    // cancelling the result of WhenAny cancels all of them
+    {
+        Promise<int> pm1;
+        Promise<int> pm2;
+        auto any = WhenAny(pm1.GetFuture(), pm2.GetFuture());
+        any.Cancel();
+        assert(pm1.IsCancelled());
+        assert(pm2.IsCancelled());
+    }
+    // cancelled from another thread while the producer polls
+    {
+        Promise<int> pm;
+        auto fut = pm.GetFuture().Then([](int v) { return v; });
+        std::thread producer([pm = std::move(pm)]() mutable {
+            while (!pm.IsCancelled())
+            {
+                std::this_thread::yield();
+            }
+            pm.SetValue(0);
+        });
+        fut.Cancel();
+        producer.join();
+        auto result = fut.Wait();
+        assert(IsCancelled(result));
+        UnusedVariable(result);
+    }
+    std::cout << "Cancel test passed" << std::endl;
+}
+
+void TestHedge()
+{
+    EventLoopScheduler loop;
+    std::thread loop_thread([&loop] { loop.Loop(); });
+    HedgeStats stats;
+    const auto kDelay = std::chrono::milliseconds(5);
+
+    // in time: no backup
+    {
+        Promise<int> first;
+        std::atomic<int> backups(0);
+        auto fut = Hedge(first.GetFuture(), kDelay, [&backups] {
+            ++backups;
+            return MakeReadyFuture(2);
+        }, &loop, &stats);
+        first.SetValue(1);
+        int value = fut.Wait().Value();
+        assert(value == 1);
+        UnusedVariable(value);
+        std::this_thread::sleep_for(kDelay * 4);
+        assert(backups == 0);
+        // ready already: returned as is
+        int ready = Hedge(MakeReadyFuture(3), kDelay, [] { return MakeReadyFuture(4); }, &loop).Wait().Value();
+        assert(ready == 3);
+        UnusedVariable(ready);
+    }
+    assert(stats.requests == 1 && stats.hedged == 0 && stats.backup_won == 0);
+    // late: the backup wins, the first is cancelled
+    {
+        Promise<int> first;
+        auto fut = Hedge(first.GetFuture(), kDelay, [] { return MakeReadyFuture(2); }, &loop, &stats);
+        int value = fut.Wait().Value();
+        assert(value == 2);
+        UnusedVariable(value);
+        assert(first.IsCancelled());
+    }
+    assert(stats.requests == 2 && stats.hedged == 1 && stats.backup_won == 1);
+    // late, and still first: the backup is cancelled
+    {
+        Promise<int> first;
+        std::atomic<bool> made(false);
+        Promise<int> backup;
+        auto fut = Hedge(first.GetFuture(), kDelay, [&made, &backup] {
+            auto f = backup.GetFuture();
+            made = true;
+            return f;
+        }, &loop, &stats);
+        while (!made)
+        {
+            std::this_thread::yield();
+        }
+        first.SetValue(1);
+        int value = fut.Wait().Value();
+        assert(value == 1);
+        UnusedVariable(value);
+        // made is set before the timer thread holds the backup, the one
+        // seeing the other done cancels it, maybe after Wait returns
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!backup.IsCancelled() && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::yield();
+        }
+        assert(backup.IsCancelled());
+        assert(!first.IsCancelled());
+    }
+    assert(stats.requests == 3 && stats.hedged == 2 && stats.backup_won == 1);
+    // cancelling the result cancels both attempts
+    {
+        Promise<int> first;
+        auto fut = Hedge(first.GetFuture(), kDelay, [] { return MakeReadyFuture(2); }, &loop);
+        fut.Cancel();
+        assert(first.IsCancelled());
+        auto result = fut.Wait();
+        assert(IsCancelled(result));
+        UnusedVariable(result);
+        std::this_thread::sleep_for(kDelay * 4);
+    }
+    loop.Stop();
+    loop_thread.join();
+    std::cout << "Hedge test passed" << std::endl;
+}
+
+int main()
+{
+    TestThen();
+    TestException();
+    TestFutureReturn();
+    TestWait();
+    TestTimeout();
+    TestRace();
+    TestWhen();
+    TestRelease();
+    TestCancel();
+    TestHedge();
+    return 0;
+}
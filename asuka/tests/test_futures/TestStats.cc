@@ -0,0 +1,112 @@
+//
+// Created by xi on 19-4-6.
+//
+
+#include <assert.h>
+#include <iostream>
+#include <thread>
+
+#include <asuka/utils/Types.h>
+#include <asuka/utils/EventLoopScheduler.h>
+#include <asuka/futures/Future.h>
+#include <asuka/futures/Stats.h>
+
+using namespace asuka;
+
+void TestHistogram()
+{
+    // buckets cover every value, in order, within 12.5%
+    int last = -1;
+    for (uint64_t v = 0; v < 100000; ++v)
+    {
+        int bucket = LatencyHistogram::BucketOf(v);
+        assert(bucket == last || bucket == last + 1);
+        assert(LatencyHistogram::LowerBound(bucket) <= v);
+        assert(v < 8 || static_cast<double>(v - LatencyHistogram::LowerBound(bucket)) <= 0.125 * static_cast<double>(v));
+        last = bucket;
+        UnusedVariable(bucket);
+    }
+    assert(LatencyHistogram::BucketOf(UINT64_MAX) == LatencyHistogram::kBuckets - 1);
+    UnusedVariable(last);
+
+    LatencyHistogram h;
+    for (uint64_t v = 1; v <= 1000; ++v)
+    {
+        h.Record(v);
+    }
+    assert(h.count() == 1000);
+    assert(h.max() == 1000);
+    assert(h.Mean() == 500.5);
+    uint64_t median = h.Percentile(50);
+    assert(median >= 448 && median <= 500);
+    uint64_t p99 = h.Percentile(99);
+    assert(p99 >= 896 && p99 <= 990);
+    UnusedVariable(median);
+    UnusedVariable(p99);
+
+    LatencyHistogram before(h);
+    h.Record(5000);
+    LatencyHistogram since(h);
+    since.Subtract(before);
+    assert(since.count() == 1);
+    assert(since.Percentile(50) == LatencyHistogram::LowerBound(LatencyHistogram::BucketOf(5000)));
+
+    LatencyHistogram merged;
+    merged.Merge(h);
+    merged.Merge(since);
+    assert(merged.count() == 1002);
+    std::cout << "TestHistogram OK" << std::endl;
+}
+
+void TestFutureStats()
+{
+    FutureStats before = FutureStats::Snapshot();
+    const int kChains = 100;
+    const int kStages = 5;
+    {
+        EventLoopScheduler loop;
+        std::thread loop_thread([&loop] { loop.Loop(); });
+        for (int i = 0; i < kChains; ++i)
+        {
+            Promise<int> pm;
+            auto fut = pm.GetFuture();
+            for (int stage = 0; stage < kStages; ++stage)
+            {
+                // every other stage goes through the loop
+                fut = stage % 2 == 0 ? fut.Then([](int v) { return v + 1; })
+                                     : fut.Then(&loop, [](int v) { return v + 1; });
+            }
+            pm.SetValue(i);
+            int value = fut.Wait().Value();
+            assert(value == i + kStages);
+            UnusedVariable(value);
+        }
+        loop.Stop();
+        loop_thread.join();
+    }
+    FutureStats stats = FutureStats::Snapshot().Since(before);
+    if (FutureStats::kEnabled)
+    {
+        // the loop thread has exited, its records are kept
+        assert(stats.completion.count() == static_cast<uint64_t>(kChains * (kStages + 1)));
+        // stage 1 is queued, stage 3 runs inline as it follows it in the loop
+        assert(stats.queueing.count() == static_cast<uint64_t>(kChains));
+        assert(stats.depth.max() == kStages);
+        assert(stats.depth.Percentile(0) == 0);
+    }
+    else
+    {
+        assert(stats.completion.count() == 0);
+        assert(stats.queueing.count() == 0);
+        assert(stats.depth.count() == 0);
+    }
+    UnusedVariable(stats);
+    std::cout << "TestFutureStats OK" << std::endl;
+}
+
+int main()
+{
+    TestHistogram();
+    TestFutureStats();
+    return 0;
+}
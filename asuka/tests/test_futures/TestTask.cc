@@ -0,0 +1,203 @@
+//
+// Created by xi on 19-4-1.
+//
+
+#include <assert.h>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#include <asuka/utils/Types.h>
+#include <asuka/futures/Task.h>
+
+using namespace asuka;
+
+// counts the frames, frees them through the default pool
+class CountingFrameAllocator : public FrameAllocator
+{
+public:
+    void* Allocate(size_t size) override
+    {
+        ++allocated;
+        return pooled.Allocate(size);
+    }
+
+    void Deallocate(void* p, size_t size) override
+    {
+        ++deallocated;
+        pooled.Deallocate(p, size);
+    }
+
+    PooledFrameAllocator pooled;
+    long allocated = 0;
+    long deallocated = 0;
+};
+
+CountingFrameAllocator g_frames;
+
+Task<int> Value(int n)
+{
+    co_return n;
+}
+
+Task<int> Add(int a, int b)
+{
+    int x = co_await Value(a);
+    int y = co_await Value(b);
+    co_return x + y;
+}
+
+Task<void> Throw()
+{
+    throw std::runtime_error("failed");
+    co_return;
+}
+
+Task<int> Catch()
+{
+    try
+    {
+        co_await Throw();
+    }
+    catch (const std::runtime_error&)
+    {
+        co_return -1;
+    }
+    co_return 0;
+}
+
+void TestTask()
+{
+    int sum = Add(1, 2).Start().Wait().Value();
+    assert(sum == 3);
+    int caught = Catch().Start().Wait().Value();
+    assert(caught == -1);
+    UnusedVariable(sum);
+    UnusedVariable(caught);
+
+    auto t = Throw().Start().Wait();
+    assert(t.HasException());
+    UnusedVariable(t);
+
+    // lazy: nothing runs before it is started
+    bool ran = false;
+    auto lazy = [](bool* flag) -> Task<void> {
+        *flag = true;
+        co_return;
+    };
+    Task<void> task = lazy(&ran);
+    assert(!ran);
+    assert(!task.IsReady());
+    std::move(task).Start().Wait();
+    assert(ran);
+
+    // a Task never started is destroyed with its frame
+    {
+        Task<int> never = Value(1);
+        UnusedVariable(never);
+    }
+
+    // AsTry does not throw
+    auto as_try = []() -> Task<bool> {
+        Try<void> r = co_await Throw().AsTry();
+        co_return r.HasException();
+    };
+    bool has_exception = as_try().Start().Wait().Value();
+    assert(has_exception);
+    UnusedVariable(has_exception);
+    std::cout << "TestTask OK" << std::endl;
+}
+
+Task<long> Sum(long n)
+{
+    if (n == 0)
+    {
+        co_return 0;
+    }
+    co_return n + co_await Sum(n - 1);
+}
+
+// every level finishes by transferring to its awaiter, the stack does not grow
+// NOTE: g++ makes the transfer a tail call only when optimizing, clang always
+#if defined(__clang__) || defined(__OPTIMIZE__)
+const long kDepth = 1000 * 1000;
+#else
+const long kDepth = 10 * 1000;
+#endif
+
+void TestDeepChain()
+{
+    long sum = Sum(kDepth).Start().Wait().Value();
+    assert(sum == kDepth * (kDepth + 1) / 2);
+    UnusedVariable(sum);
+    std::cout << "TestDeepChain OK" << std::endl;
+}
+
+Task<int> AwaitFuture(Future<int> future)
+{
+    Try<int> t = co_await std::move(future);
+    co_return t.HasException() ? -1 : t.Value() * 2;
+}
+
+void TestAwaitFuture()
+{
+    // ready, no suspension
+    int ready = AwaitFuture(MakeReadyFuture(1)).Start().Wait().Value();
+    assert(ready == 2);
+
+    // completed later in this thread, resumed by SetValue
+    Promise<int> pm;
+    Future<int> result = AwaitFuture(pm.GetFuture()).Start();
+    assert(!result.IsReady());
+    pm.SetValue(2);
+    assert(result.IsReady());
+    int later = result.Wait().Value();
+    assert(later == 4);
+
+    // completed in another thread, resumed there
+    Promise<int> pm2;
+    Future<int> result2 = AwaitFuture(pm2.GetFuture()).Start();
+    std::thread t([&pm2] { pm2.SetValue(3); });
+    int other_thread = result2.Wait().Value();
+    assert(other_thread == 6);
+    t.join();
+
+    Promise<int> pm3;
+    Future<int> result3 = AwaitFuture(pm3.GetFuture()).Start();
+    pm3.SetException(std::make_exception_ptr(std::runtime_error("failed")));
+    int failed = result3.Wait().Value();
+    assert(failed == -1);
+    UnusedVariable(ready);
+    UnusedVariable(later);
+    UnusedVariable(other_thread);
+    UnusedVariable(failed);
+    std::cout << "TestAwaitFuture OK" << std::endl;
+}
+
+void TestFrameAllocator()
+{
+    assert(g_frames.allocated > 0);
+    assert(g_frames.allocated == g_frames.deallocated);
+
+    // frames of the same size class are recycled
+    PooledFrameAllocator pooled;
+    void* p = pooled.Allocate(200);
+    pooled.Deallocate(p, 200);
+    void* q = pooled.Allocate(208);
+    assert(p == q);
+    pooled.Deallocate(q, 208);
+    void* large = pooled.Allocate(4096);
+    pooled.Deallocate(large, 4096);
+    UnusedVariable(q);
+    std::cout << "TestFrameAllocator OK" << std::endl;
+}
+
+int main()
+{
+    FrameAllocator::SetDefault(&g_frames);
+    TestTask();
+    TestDeepChain();
+    TestAwaitFuture();
+    TestFrameAllocator();
+    return 0;
+}
@@ -0,0 +1,128 @@
+//
+// Created by xi on 19-4-5.
+//
+
+#include <assert.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <asuka/utils/Types.h>
+#include <asuka/futures/Try.h>
+
+using namespace asuka;
+
+// the state tag takes one byte after the storage
+template <typename T>
+constexpr size_t CompactSize()
+{
+    size_t storage = std::max(sizeof(T), sizeof(std::exception_ptr));
+    size_t align = std::max(alignof(T), alignof(std::exception_ptr));
+    return (storage + 1 + align - 1) / align * align;
+}
+
+static_assert(sizeof(Try<int>) <= CompactSize<int>(), "Try<int> is compact");
+static_assert(sizeof(Try<char>) <= CompactSize<char>(), "Try<char> is compact");
+static_assert(sizeof(Try<double>) <= CompactSize<double>(), "Try<double> is compact");
+static_assert(sizeof(Try<std::string>) <= CompactSize<std::string>(), "Try<std::string> is compact");
+static_assert(sizeof(Try<std::pair<long, long>>) <= CompactSize<std::pair<long, long>>(),
+              "Try<std::pair<long, long>> is compact");
+static_assert(std::is_nothrow_move_constructible_v<Try<int>>, "moving a Try does not throw");
+static_assert(std::is_nothrow_move_constructible_v<Try<std::string>>, "moving a Try does not throw");
+static_assert(std::is_nothrow_move_assignable_v<Try<std::string>>, "moving a Try does not throw");
+
+std::exception_ptr Failure()
+{
+    return std::make_exception_ptr(std::runtime_error("failed"));
+}
+
+bool IsFailure(const Try<int>& t)
+{
+    try
+    {
+        t.Check();
+    }
+    catch (const std::runtime_error& e)
+    {
+        return std::string(e.what()) == "failed";
+    }
+    return false;
+}
+
+// a trivially destructible T: values, and the exception by reference
+void TestTrivial()
+{
+    Try<int> value(1);
+    Try<int> copied(value);
+    assert(copied.HasValue() && copied.Value() == 1);
+    Try<int> moved(std::move(copied));
+    assert(moved.HasValue() && moved.Value() == 1);
+
+    Try<int> failed(Failure());
+    Try<int> failed_copy(failed);
+    assert(failed_copy.HasException() && IsFailure(failed_copy));
+    assert(IsFailure(failed));
+    Try<int> failed_moved(std::move(failed_copy));
+    assert(IsFailure(failed_moved));
+
+    // between states
+    Try<int> t;
+    assert(!t.HasValue() && !t.HasException());
+    t = failed;
+    assert(IsFailure(t));
+    t = value;
+    assert(t.Value() == 1);
+    t = std::move(failed_moved);
+    assert(IsFailure(t));
+    t = Try<int>();
+    assert(!t.HasValue() && !t.HasException());
+
+    // the exception is shared, not copied, and released with the last Try
+    std::weak_ptr<int> watched;
+    {
+        auto owner = std::make_shared<int>(1);
+        watched = owner;
+        Try<int> holder(std::make_exception_ptr(owner));
+        owner.reset();
+        Try<int> second(holder);
+        Try<int> third(std::move(holder));
+        assert(!watched.expired());
+        UnusedVariable(second);
+        UnusedVariable(third);
+    }
+    assert(watched.expired());
+    UnusedVariable(watched);
+    std::cout << "TestTrivial OK" << std::endl;
+}
+
+void TestNonTrivial()
+{
+    std::string text(100, 'x');
+    Try<std::string> value(text);
+    Try<std::string> copied(value);
+    assert(copied.Value() == text);
+    assert(value.Value() == text);
+    Try<std::string> moved(std::move(copied));
+    assert(moved.Value() == text);
+
+    Try<std::string> t(Failure());
+    assert(t.HasException());
+    t = moved;
+    assert(t.Value() == text);
+    t = Try<std::string>(Failure());
+    assert(t.HasException());
+    t = std::move(moved);
+    assert(t.Value() == text);
+    UnusedVariable(text);
+    std::cout << "TestNonTrivial OK" << std::endl;
+}
+
+int main()
+{
+    TestTrivial();
+    TestNonTrivial();
+    return 0;
+}
@@ -0,0 +1,105 @@
+//
+// Created by xi on 19-3-22.
+//
+
+#include <assert.h>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <asuka/utils/Types.h>
+#include <asuka/utils/EventLoopScheduler.h>
+
+using namespace asuka;
+
+using Clock = std::chrono::steady_clock;
+
+int main()
+{
+    EventLoopScheduler sched;
+    std::thread loop([&sched] { sched.Loop(); });
+
+    // tasks from other threads run in the loop thread, in order
+    const int kThreads = 4;
+    const int kTasks = 10000;
+    std::atomic<int> done(0);
+    std::vector<int> last(kThreads, -1);
+    std::atomic<bool> in_order(true);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < kTasks; ++i)
+            {
+                sched.Schedule([&, t, i] {
+                    assert(sched.IsInLoopThread());
+                    assert(sched.IsCurrent());
+                    if (last[t] + 1 != i)
+                    {
+                        in_order = false;
+                    }
+                    last[t] = i;
+                    ++done;
+                });
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    while (done < kThreads * kTasks)
+    {
+        std::this_thread::yield();
+    }
+    assert(in_order);
+    assert(!sched.IsCurrent());
+
+    // timers never fire early, and fire in order of deadline
+    std::atomic<int> fired(0);
+    std::vector<int> order;
+    auto start = Clock::now();
+    std::vector<Clock::duration> elapsed(3);
+    for (int ms : {30, 10, 20})
+    {
+        sched.SchedulerLater(std::chrono::milliseconds(ms), [&, ms] {
+            elapsed[ms / 10 - 1] = Clock::now() - start;
+            order.push_back(ms);
+            ++fired;
+        });
+    }
+    while (fired < 3)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert((order == std::vector<int>{10, 20, 30}));
+    for (int i = 0; i < 3; ++i)
+    {
+        assert(elapsed[i] >= std::chrono::milliseconds(10 * (i + 1)));
+    }
+
+    // cancel in the loop thread
+    std::atomic<bool> cancelled(false);
+    std::atomic<bool> kept(false);
+    sched.Schedule([&] {
+        TimerId id = sched.RunAfter(std::chrono::milliseconds(5), [&cancelled] { cancelled = true; });
+        sched.RunAfter(std::chrono::milliseconds(10), [&kept] { kept = true; });
+        bool first = sched.Cancel(id);
+        bool second = sched.Cancel(id);
+        assert(first && !second);
+        UnusedVariable(first);
+        UnusedVariable(second);
+    });
+    while (!kept)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(!cancelled);
+
+    sched.Stop();
+    loop.join();
+    std::cout << "event loop scheduler test passed" << std::endl;
+    return 0;
+}
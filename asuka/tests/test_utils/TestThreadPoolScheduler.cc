@@ -0,0 +1,135 @@
+//
+// Created by xi on 19-3-30.
+//
+
+#include <assert.h>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <asuka/utils/Types.h>
+#include <asuka/utils/ThreadPoolScheduler.h>
+
+using namespace asuka;
+
+int main()
+{
+    ThreadPoolScheduler pool(4);
+    assert(pool.threads() == 4);
+    assert(!pool.IsCurrent());
+
+    // from other threads, every task runs once in a worker
+    {
+        const int kThreads = 4;
+        const int kTasks = 20000;
+        std::vector<std::atomic<int>> runs(kThreads * kTasks);
+        for (auto& r : runs)
+        {
+            r = 0;
+        }
+        std::atomic<int> done(0);
+        std::atomic<bool> in_pool(true);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t)
+        {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < kTasks; ++i)
+                {
+                    pool.Schedule([&, t, i] {
+                        if (!pool.IsCurrent())
+                        {
+                            in_pool = false;
+                        }
+                        ++runs[static_cast<size_t>(t * kTasks + i)];
+                        ++done;
+                    });
+                }
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        while (done < kThreads * kTasks)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert(in_pool);
+        for (auto& r : runs)
+        {
+            assert(r == 1);
+            UnusedVariable(r);
+        }
+    }
+
+    // tasks spawning tasks stay in the workers' deques and get stolen
+    {
+        std::atomic<int> leaves(0);
+        const int kDepth = 14;
+        std::function<void (int)> spawn = [&](int depth) {
+            if (depth == kDepth)
+            {
+                ++leaves;
+                return;
+            }
+            pool.Schedule([&spawn, depth] { spawn(depth + 1); });
+            pool.Schedule([&spawn, depth] { spawn(depth + 1); });
+        };
+        pool.Schedule([&spawn] { spawn(0); });
+        while (leaves < (1 << kDepth))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // workers sleep when idle and wake up for new work
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::atomic<bool> ran(false);
+        pool.Schedule([&ran] { ran = true; });
+        while (!ran)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // timers run in the workers, never early
+    {
+        std::atomic<bool> fired(false);
+        std::atomic<bool> in_pool(false);
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration elapsed;
+        pool.SchedulerLater(std::chrono::milliseconds(20), [&] {
+            elapsed = std::chrono::steady_clock::now() - start;
+            in_pool = pool.IsCurrent();
+            fired = true;
+        });
+        while (!fired)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert(in_pool);
+        assert(elapsed >= std::chrono::milliseconds(20));
+    }
+
+    // tasks left are dropped by the destructor
+    {
+        ThreadPoolScheduler small(1);
+        std::atomic<bool> release(false);
+        small.Schedule([&release] {
+            while (!release)
+            {
+                std::this_thread::yield();
+            }
+        });
+        for (int i = 0; i < 100; ++i)
+        {
+            small.Schedule([] {});
+        }
+        release = true;
+    }
+    std::cout << "thread pool scheduler test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,103 @@
+//
+// Created by xi on 19-3-22.
+//
+
+#include <assert.h>
+#include <stdint.h>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <asuka/utils/Types.h>
+#include <asuka/utils/TimerWheel.h>
+
+using namespace asuka;
+
+int main()
+{
+    // every timer fires exactly at its tick, across all levels
+    {
+        TimerWheel wheel(100);
+        std::mt19937_64 rng(42);
+        const int kTimers = 20000;
+        std::vector<uint64_t> expires;
+        std::vector<uint64_t> fired_at(kTimers, 0);
+        uint64_t now = 100;
+        for (int i = 0; i < kTimers; ++i)
+        {
+            // near ones and ones of every level
+            uint64_t delay = rng() % (1ULL << (8 + 6 * (i % 5)));
+            expires.push_back(now + delay);
+            wheel.Add(now + delay, [&fired_at, &now, i] { fired_at[i] = now; });
+        }
+        assert(wheel.size() == kTimers);
+        size_t fired = 0;
+        while (wheel.size() > 0)
+        {
+            uint64_t next = wheel.NextWakeTick();
+            assert(next >= wheel.tick());
+            now = next;
+            fired += wheel.Advance(now);
+        }
+        assert(fired == kTimers);
+        for (int i = 0; i < kTimers; ++i)
+        {
+            assert(fired_at[i] == expires[i]);
+        }
+        UnusedVariable(fired);
+    }
+
+    // cancel, stale ids, timers added by callbacks
+    {
+        TimerWheel wheel;
+        int count = 0;
+        TimerId a = wheel.Add(10, [&count] { count += 1; });
+        TimerId b = wheel.Add(10, [&count] { count += 10; });
+        TimerId far = wheel.Add(1000000, [&count] { count += 100; });
+        bool cancelled = wheel.Cancel(b);
+        assert(cancelled);
+        cancelled = wheel.Cancel(b);
+        assert(!cancelled);
+        cancelled = wheel.Cancel(TimerId());
+        assert(!cancelled);
+        // b's node is reused, the old id does not cancel it
+        TimerId c = wheel.Add(5, [&] {
+            count += 1000;
+            // in the past: fires on the same Advance
+            wheel.Add(0, [&count] { count += 10000; });
+        });
+        cancelled = wheel.Cancel(b);
+        assert(!cancelled);
+        size_t fired = wheel.Advance(9);
+        assert(fired == 2);
+        assert(count == 11000);
+        cancelled = wheel.Cancel(c);
+        assert(!cancelled);
+        fired = wheel.Advance(10);
+        assert(fired == 1);
+        assert(count == 11001);
+        cancelled = wheel.Cancel(a);
+        assert(!cancelled);
+        cancelled = wheel.Cancel(far);
+        assert(cancelled);
+        assert(wheel.size() == 0);
+        assert(wheel.NextWakeTick() == UINT64_MAX);
+        UnusedVariable(cancelled);
+        UnusedVariable(fired);
+    }
+
+    // a callback cancels a timer of the same tick
+    {
+        TimerWheel wheel;
+        int count = 0;
+        TimerId second;
+        wheel.Add(3, [&] { ++count; wheel.Cancel(second); });
+        second = wheel.Add(3, [&count] { count += 100; });
+        wheel.Advance(3);
+        assert(count == 1);
+        assert(wheel.size() == 0);
+    }
+
+    std::cout << "timer wheel test passed" << std::endl;
+    return 0;
+}
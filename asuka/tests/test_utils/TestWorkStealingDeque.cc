@@ -0,0 +1,192 @@
+//
+// Created by xi on 19-3-30.
+//
+
+#include <assert.h>
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <asuka/utils/Types.h>
+#include <asuka/utils/MpmcQueue.h>
+#include <asuka/utils/WorkStealingDeque.h>
+
+using namespace asuka;
+
+void TestDeque()
+{
+    // owner alone: LIFO, and grows past the initial capacity
+    {
+        WorkStealingDeque<int> deque(4);
+        std::vector<int> items(100);
+        for (auto& item : items)
+        {
+            deque.Push(&item);
+        }
+        for (int i = 99; i >= 0; --i)
+        {
+            int* item = deque.Pop();
+            assert(item == &items[i]);
+            UnusedVariable(item);
+        }
+        int* rest = deque.Pop();
+        assert(rest == nullptr);
+        UnusedVariable(rest);
+        assert(deque.Empty());
+    }
+    // thieves take FIFO
+    {
+        WorkStealingDeque<int> deque(4);
+        std::vector<int> items(3);
+        for (auto& item : items)
+        {
+            deque.Push(&item);
+        }
+        int* first = deque.Steal();
+        assert(first == &items[0]);
+        UnusedVariable(first);
+    }
+    // every item is taken exactly once, by the owner or a thief
+    {
+        const int kItems = 200000;
+        const int kThieves = 3;
+        WorkStealingDeque<int> deque(16);
+        std::vector<int> items(kItems, 0);
+        std::vector<std::atomic<int>> taken(kItems);
+        for (auto& t : taken)
+        {
+            t = 0;
+        }
+        std::atomic<bool> done(false);
+        auto take = [&items, &taken](int* item) {
+            ++taken[static_cast<size_t>(item - items.data())];
+        };
+        std::vector<std::thread> thieves;
+        for (int t = 0; t < kThieves; ++t)
+        {
+            thieves.emplace_back([&deque, &done, &take] {
+                while (!done)
+                {
+                    if (int* item = deque.Steal())
+                    {
+                        take(item);
+                    }
+                }
+            });
+        }
+        for (int i = 0; i < kItems; ++i)
+        {
+            deque.Push(&items[i]);
+            if (i % 3 == 0)
+            {
+                if (int* item = deque.Pop())
+                {
+                    take(item);
+                }
+            }
+        }
+        while (int* item = deque.Pop())
+        {
+            take(item);
+        }
+        done = true;
+        for (auto& t : thieves)
+        {
+            t.join();
+        }
+        for (auto& t : taken)
+        {
+            assert(t == 1);
+            UnusedVariable(t);
+        }
+    }
+    std::cout << "work stealing deque test passed" << std::endl;
+}
+
+void TestMpmcQueue()
+{
+    {
+        MpmcQueue<int> queue(4);
+        std::vector<int> items(5);
+        for (int i = 0; i < 4; ++i)
+        {
+            bool pushed = queue.TryPush(&items[i]);
+            assert(pushed);
+            UnusedVariable(pushed);
+        }
+        bool full = !queue.TryPush(&items[4]);
+        assert(full);
+        UnusedVariable(full);
+        for (int i = 0; i < 4; ++i)
+        {
+            int* item = queue.TryPop();
+            assert(item == &items[i]);
+            UnusedVariable(item);
+        }
+        int* rest = queue.TryPop();
+        assert(rest == nullptr);
+        UnusedVariable(rest);
+    }
+    // producers and consumers, each item popped once
+    {
+        const int kProducers = 3;
+        const int kConsumers = 3;
+        const int kItems = 100000;
+        MpmcQueue<int> queue(1024);
+        std::vector<int> items(kProducers * kItems);
+        std::vector<std::atomic<int>> taken(items.size());
+        for (auto& t : taken)
+        {
+            t = 0;
+        }
+        std::atomic<int> popped(0);
+        std::vector<std::thread> threads;
+        for (int p = 0; p < kProducers; ++p)
+        {
+            threads.emplace_back([&, p] {
+                for (int i = 0; i < kItems; ++i)
+                {
+                    while (!queue.TryPush(&items[static_cast<size_t>(p * kItems + i)]))
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (int c = 0; c < kConsumers; ++c)
+        {
+            threads.emplace_back([&] {
+                while (popped < kProducers * kItems)
+                {
+                    if (int* item = queue.TryPop())
+                    {
+                        ++taken[static_cast<size_t>(item - items.data())];
+                        ++popped;
+                    }
+                    else
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        for (auto& t : taken)
+        {
+            assert(t == 1);
+            UnusedVariable(t);
+        }
+    }
+    std::cout << "mpmc queue test passed" << std::endl;
+}
+
+int main()
+{
+    TestDeque();
+    TestMpmcQueue();
+    return 0;
+}
@@ -0,0 +1,214 @@
+//
+// Created by xi on 19-3-22.
+//
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <algorithm>
+#include <stdexcept>
+#include <asuka/utils/Types.h>
+#include <asuka/utils/EventLoopScheduler.h>
+
+namespace asuka
+{
+
+namespace
+{
+
+const int64_t kNanosPerTick = 1000 * 1000; // 1 ms
+
+int64_t MonotonicNanos()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+void Drain(int fd)
+{
+    uint64_t value;
+    ssize_t n = ::read(fd, &value, sizeof(value));
+    UnusedVariable(n);
+}
+
+} // namespace
+
+thread_local EventLoopScheduler* EventLoopScheduler::current_ = nullptr;
+
+EventLoopScheduler::EventLoopScheduler() :
+    wakeup_fd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    timer_fd_(::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+    stopping_(false),
+    start_ns_(MonotonicNanos()),
+    armed_tick_(UINT64_MAX),
+    wheel_(0)
+{
+    if (wakeup_fd_ < 0 || timer_fd_ < 0)
+    {
+        throw std::runtime_error("EventLoopScheduler: eventfd or timerfd_create failed");
+    }
+}
+
+EventLoopScheduler::~EventLoopScheduler()
+{
+    ::close(timer_fd_);
+    ::close(wakeup_fd_);
+}
+
+EventLoopScheduler* EventLoopScheduler::Current()
+{
+    return current_;
+}
+
+uint64_t EventLoopScheduler::NowTick() const
+{
+    return static_cast<uint64_t>((MonotonicNanos() - start_ns_) / kNanosPerTick);
+}
+
+uint64_t EventLoopScheduler::ExpireTick(std::chrono::milliseconds duration) const
+{
+    int64_t delay = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    int64_t expire_ns = MonotonicNanos() - start_ns_ + std::max<int64_t>(delay, 0);
+    // round up, never fire early
+    return static_cast<uint64_t>((expire_ns + kNanosPerTick - 1) / kNanosPerTick);
+}
+
+void EventLoopScheduler::Schedule(std::function<void ()> func)
+{
+    bool wakeup;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // the loop is already woken up for a non-empty queue
+        wakeup = pending_.empty() && !IsInLoopThread();
+        pending_.push_back(std::move(func));
+    }
+    if (wakeup)
+    {
+        uint64_t one = 1;
+        ssize_t n = ::write(wakeup_fd_, &one, sizeof(one));
+        UnusedVariable(n);
+    }
+}
+
+void EventLoopScheduler::SchedulerLater(std::chrono::milliseconds duration, std::function<void ()> func)
+{
+    if (IsInLoopThread())
+    {
+        wheel_.Add(ExpireTick(duration), std::move(func));
+        return;
+    }
+    uint64_t expire = ExpireTick(duration);
+    Schedule([this, expire, f = std::move(func)] () mutable {
+        wheel_.Add(expire, std::move(f));
+    });
+}
+
+TimerId EventLoopScheduler::RunAfter(std::chrono::milliseconds duration, std::function<void ()> func)
+{
+    assert(IsInLoopThread());
+    return wheel_.Add(ExpireTick(duration), std::move(func));
+}
+
+bool EventLoopScheduler::Cancel(const TimerId& id)
+{
+    assert(IsInLoopThread());
+    return wheel_.Cancel(id);
+}
+
+void EventLoopScheduler::Stop()
+{
+    stopping_ = true;
+    uint64_t one = 1;
+    ssize_t n = ::write(wakeup_fd_, &one, sizeof(one));
+    UnusedVariable(n);
+}
+
+void EventLoopScheduler::Loop()
+{
+    assert(current_ == nullptr);
+    current_ = this;
+    while (!stopping_.load(std::memory_order_acquire))
+    {
+        RunPending();
+        wheel_.Advance(NowTick());
+        bool idle;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            idle = pending_.empty();
+        }
+        if (idle)
+        {
+            ArmTimer(wheel_.NextWakeTick());
+        }
+        Poll(idle);
+    }
+    current_ = nullptr;
+}
+
+void EventLoopScheduler::RunPending()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_.swap(pending_);
+    }
+    for (auto& func : running_)
+    {
+        func();
+    }
+    running_.clear();
+}
+
+void EventLoopScheduler::ArmTimer(uint64_t tick)
+{
+    if (tick == armed_tick_)
+    {
+        return;
+    }
+    struct itimerspec spec = {};
+    if (tick != UINT64_MAX)
+    {
+        int64_t when = start_ns_ + static_cast<int64_t>(tick) * kNanosPerTick;
+        spec.it_value.tv_sec = when / (1000 * 1000 * 1000);
+        spec.it_value.tv_nsec = when % (1000 * 1000 * 1000);
+    }
+    // all zero disarms
+    if (::timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) != 0)
+    {
+        throw std::runtime_error("EventLoopScheduler: timerfd_settime failed");
+    }
+    armed_tick_ = tick;
+}
+
+void EventLoopScheduler::Poll(bool block)
+{
+    struct pollfd fds[2] = {
+        {wakeup_fd_, POLLIN, 0},
+        {timer_fd_, POLLIN, 0}
+    };
+    int n = ::poll(fds, 2, block ? -1 : 0);
+    if (n < 0)
+    {
+        if (errno == EINTR)
+        {
+            return;
+        }
+        throw std::runtime_error("EventLoopScheduler: poll failed");
+    }
+    if (fds[0].revents & POLLIN)
+    {
+        Drain(wakeup_fd_);
+    }
+    if (fds[1].revents & POLLIN)
+    {
+        Drain(timer_fd_);
+        // one-shot, it has to be armed again even for the same tick
+        armed_tick_ = UINT64_MAX;
+    }
+}
+
+} // namespace asuka
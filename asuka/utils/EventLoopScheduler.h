@@ -0,0 +1,112 @@
+//
+// Created by xi on 19-3-22.
+//
+
+#ifndef ASUKA_EVENTLOOPSCHEDULER_H
+#define ASUKA_EVENTLOOPSCHEDULER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <asuka/utils/Scheduler.h>
+#include <asuka/utils/TimerWheel.h>
+
+namespace asuka
+{
+
+// Scheduler running everything on the thread calling Loop.
+// Other threads hand work over through a queue and wake the loop by eventfd,
+// timers are kept in a TimerWheel of 1 ms ticks and the loop sleeps on
+// a timerfd armed for the next wheel tick that has work.
+//
+//     EventLoopScheduler sched;
+//     std::thread t([&] { sched.Loop(); });
+//     future.Then(&sched, f);
+//     ...
+//     sched.Stop();
+//     t.join();
+class EventLoopScheduler : public Scheduler
+{
+public:
+    EventLoopScheduler();
+    ~EventLoopScheduler() override;
+
+    // thread safe, func runs in the loop thread
+    void Schedule(std::function<void ()> func) override;
+
+    // thread safe, called outside the loop thread the timer is added by the loop
+    void SchedulerLater(std::chrono::milliseconds duration, std::function<void ()> func) override;
+
+    // like SchedulerLater but cancellable, loop thread only
+    TimerId RunAfter(std::chrono::milliseconds duration, std::function<void ()> func);
+
+    // loop thread only, false if the timer has fired or been cancelled
+    bool Cancel(const TimerId& id);
+
+    // run until Stop, tasks and timers left are dropped
+    void Loop();
+
+    // thread safe
+    void Stop();
+
+    bool IsInLoopThread() const
+    {
+        return current_ == this;
+    }
+
+    bool IsCurrent() const override
+    {
+        return IsInLoopThread();
+    }
+
+    // the scheduler running Loop in this thread
+    static EventLoopScheduler* Current();
+
+    // timers not fired yet, loop thread only
+    size_t timers() const
+    {
+        return wheel_.size();
+    }
+
+private:
+    uint64_t NowTick() const;
+
+    uint64_t ExpireTick(std::chrono::milliseconds duration) const;
+
+    void RunPending();
+
+    void ArmTimer(uint64_t tick);
+
+    void Poll(bool block);
+
+private:
+    int wakeup_fd_;
+
+    int timer_fd_;
+
+    std::atomic<bool> stopping_;
+
+    // CLOCK_MONOTONIC when constructed, tick 0
+    int64_t start_ns_;
+
+    // the tick timer_fd_ is armed for, UINT64_MAX if disarmed
+    uint64_t armed_tick_;
+
+    TimerWheel wheel_;
+
+    std::mutex mutex_;
+    std::vector<std::function<void ()>> pending_;
+
+    // swapped with pending_, keeps its capacity
+    std::vector<std::function<void ()>> running_;
+
+    static thread_local EventLoopScheduler* current_;
+};
+
+} // namespace asuka
+
+#endif //ASUKA_EVENTLOOPSCHEDULER_H
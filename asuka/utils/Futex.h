@@ -0,0 +1,42 @@
+//
+// Created by xi on 19-3-28.
+//
+
+#ifndef ASUKA_FUTEX_H
+#define ASUKA_FUTEX_H
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <atomic>
+
+namespace asuka
+{
+
+inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// sleeps while *word == expected, at most timeout if given,
+// returns on wake up, timeout, signal or spuriously
+inline void FutexWait(std::atomic<uint32_t>* word, uint32_t expected, const struct timespec* timeout)
+{
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32 bit word");
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+}
+
+inline void FutexWake(std::atomic<uint32_t>* word, int count)
+{
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+} // namespace asuka
+
+#endif //ASUKA_FUTEX_H
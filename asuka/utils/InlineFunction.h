@@ -0,0 +1,94 @@
+//
+// Created by xi on 19-3-18.
+//
+
+#ifndef ASUKA_INLINEFUNCTION_H
+#define ASUKA_INLINEFUNCTION_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace asuka
+{
+
+// Callable of Signature stored in place when it fits in kInlineSize bytes,
+// otherwise on heap. Unlike std::function it never allocates for small
+// callables and does not require them to be copyable.
+template <size_t kInlineSize, typename Signature = void ()>
+class InlineFunction;
+
+template <size_t kInlineSize, typename R, typename... Args>
+class InlineFunction<kInlineSize, R (Args...)>
+{
+public:
+    InlineFunction() :
+        invoke_(nullptr),
+        destroy_(nullptr)
+    {}
+
+    ~InlineFunction()
+    {
+        Reset();
+    }
+
+    // non-copyable
+    InlineFunction(const InlineFunction&) = delete;
+    InlineFunction& operator=(const InlineFunction&) = delete;
+
+    template <typename F>
+    void Emplace(F&& f)
+    {
+        using FuncType = std::decay_t<F>;
+        Reset();
+        if constexpr (sizeof(FuncType) <= kInlineSize && alignof(FuncType) <= alignof(std::max_align_t))
+        {
+            new (&storage_) FuncType(std::forward<F>(f));
+            invoke_ = [](void* p, Args... args) -> R {
+                return (*static_cast<FuncType*>(p))(std::forward<Args>(args)...);
+            };
+            destroy_ = [](void* p) { static_cast<FuncType*>(p)->~FuncType(); };
+        }
+        else
+        {
+            *reinterpret_cast<FuncType**>(&storage_) = new FuncType(std::forward<F>(f));
+            invoke_ = [](void* p, Args... args) -> R {
+                return (**static_cast<FuncType**>(p))(std::forward<Args>(args)...);
+            };
+            destroy_ = [](void* p) { delete *static_cast<FuncType**>(p); };
+        }
+    }
+
+    void Reset()
+    {
+        if (destroy_)
+        {
+            destroy_(&storage_);
+        }
+        invoke_ = nullptr;
+        destroy_ = nullptr;
+    }
+
+    R operator()(Args... args)
+    {
+        return invoke_(&storage_, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const
+    {
+        return invoke_ != nullptr;
+    }
+
+private:
+    // ahead of storage_, so that an owner can keep it close to its own hot fields
+    R (*invoke_)(void*, Args...);
+
+    void (*destroy_)(void*);
+
+    std::aligned_storage_t<kInlineSize, alignof(std::max_align_t)> storage_;
+};
+
+} // namespace asuka
+
+#endif //ASUKA_INLINEFUNCTION_H
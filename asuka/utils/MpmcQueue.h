@@ -0,0 +1,142 @@
+//
+// Created by xi on 19-3-30.
+//
+
+#ifndef ASUKA_MPMCQUEUE_H
+#define ASUKA_MPMCQUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+
+namespace asuka
+{
+
+// Bounded multi-producer multi-consumer queue of pointers, Dmitry Vyukov's:
+// each cell carries a sequence number telling whether it is ready for the
+// producer or the consumer of a position, so a push or pop is one CAS on
+// the position and no lock.
+template <typename T>
+class MpmcQueue
+{
+public:
+    explicit MpmcQueue(size_t capacity) :
+        mask_(RoundUp(capacity) - 1),
+        cells_(new Cell[mask_ + 1]),
+        push_pos_(0),
+        pop_pos_(0)
+    {
+        for (size_t i = 0; i <= mask_; ++i)
+        {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // non-copyable
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    // false if full
+    bool TryPush(T* item)
+    {
+        size_t pos = push_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true)
+        {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (push_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = push_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->item = item;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // nullptr if empty
+    T* TryPop()
+    {
+        size_t pos = pop_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true)
+        {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (pop_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return nullptr;
+            }
+            else
+            {
+                pos = pop_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        T* item = cell->item;
+        cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return item;
+    }
+
+    // racy, a hint
+    bool Empty() const
+    {
+        return push_pos_.load(std::memory_order_relaxed) <= pop_pos_.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T* item = nullptr;
+    };
+
+    static size_t RoundUp(size_t n)
+    {
+        size_t size = 2;
+        while (size < n)
+        {
+            size <<= 1;
+        }
+        return size;
+    }
+
+private:
+    const size_t mask_;
+
+    std::unique_ptr<Cell[]> cells_;
+
+    alignas(64) std::atomic<size_t> push_pos_;
+
+    alignas(64) std::atomic<size_t> pop_pos_;
+};
+
+} // namespace asuka
+
+#endif //ASUKA_MPMCQUEUE_H
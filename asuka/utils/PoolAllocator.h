@@ -0,0 +1,163 @@
+//
+// Created by xi on 19-3-18.
+//
+
+#ifndef ASUKA_POOLALLOCATOR_H
+#define ASUKA_POOLALLOCATOR_H
+
+#include <stddef.h>
+#include <new>
+
+namespace asuka
+{
+
+namespace detail
+{
+
+// per-thread free list of fixed size blocks,
+// a block freed in another thread goes to that thread's list
+template <size_t kSize, size_t kAlign>
+class FreeList
+{
+public:
+    static void* Allocate()
+    {
+        Cache& cache = cache_;
+        if (!destroyed_ && cache.head)
+        {
+            Node* node = cache.head;
+            cache.head = node->next;
+            --cache.count;
+            return node;
+        }
+        return New();
+    }
+
+    static void Deallocate(void* p)
+    {
+        Cache& cache = cache_;
+        if (!destroyed_ && cache.count < kMaxCached)
+        {
+            Node* node = static_cast<Node*>(p);
+            node->next = cache.head;
+            cache.head = node;
+            ++cache.count;
+            return;
+        }
+        Delete(p);
+    }
+
+private:
+    struct Node
+    {
+        Node* next;
+    };
+
+    struct Cache
+    {
+        ~Cache()
+        {
+            while (head)
+            {
+                Node* node = head;
+                head = node->next;
+                Delete(node);
+            }
+            destroyed_ = true;
+        }
+
+        Node* head = nullptr;
+        size_t count = 0;
+    };
+
+    static constexpr size_t kBlockSize = kSize < sizeof(Node) ? sizeof(Node) : kSize;
+    static constexpr size_t kBlockAlign = kAlign < alignof(Node) ? alignof(Node) : kAlign;
+    static constexpr size_t kMaxCached = 1024;
+
+    // the aligned operator new is memalign, slower and with more overhead per block,
+    // only for over-aligned blocks
+    static void* New()
+    {
+        if constexpr (kBlockAlign > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        {
+            return ::operator new(kBlockSize, std::align_val_t(kBlockAlign));
+        }
+        else
+        {
+            return ::operator new(kBlockSize);
+        }
+    }
+
+    static void Delete(void* p)
+    {
+        if constexpr (kBlockAlign > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        {
+            ::operator delete(p, std::align_val_t(kBlockAlign));
+        }
+        else
+        {
+            ::operator delete(p);
+        }
+    }
+
+    static thread_local Cache cache_;
+    // set when cache_ is destroyed at thread exit, blocks freed later go to heap
+    static thread_local bool destroyed_;
+};
+
+template <size_t kSize, size_t kAlign>
+thread_local typename FreeList<kSize, kAlign>::Cache FreeList<kSize, kAlign>::cache_;
+
+template <size_t kSize, size_t kAlign>
+thread_local bool FreeList<kSize, kAlign>::destroyed_ = false;
+
+} // namespace detail
+
+// std allocator recycling single objects through a per-thread free list,
+// for std::allocate_shared so that object and control block are reused together
+template <typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    PoolAllocator() noexcept = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+        if (n != 1)
+        {
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+        }
+        return static_cast<T*>(detail::FreeList<sizeof(T), alignof(T)>::Allocate());
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (n != 1)
+        {
+            ::operator delete(p, std::align_val_t(alignof(T)));
+            return;
+        }
+        detail::FreeList<sizeof(T), alignof(T)>::Deallocate(p);
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept
+    {
+        return false;
+    }
+};
+
+} // namespace asuka
+
+#endif //ASUKA_POOLALLOCATOR_H
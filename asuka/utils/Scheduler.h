@@ -5,16 +5,27 @@
 #ifndef ASUKA_SCHEDULER_H
 #define ASUKA_SCHEDULER_H
 
+#include <stdint.h>
+#include <atomic>
 #include <chrono>
 #include <functional>
 
 namespace asuka
 {
 
+namespace detail
+{
+class InlineScope;
+} // namespace detail
+
+// A scheduler is identified by its address, it is neither copied nor moved.
 class Scheduler
 {
 public:
-    Scheduler() = default;
+    Scheduler() :
+        hops_saved_(0)
+    {}
+
     virtual ~Scheduler() = default;
 
     // non-copyable
@@ -29,6 +40,31 @@ public:
 
     virtual void SchedulerLater(std::chrono::milliseconds duration, std::function<void ()> func) = 0;
     virtual void Schedule(std::function<void ()> func) = 0;
+
+    // true if the calling thread is running this scheduler's tasks,
+    // so that a task for it can run right here, false if unknown
+    virtual bool IsCurrent() const
+    {
+        return false;
+    }
+
+    // tasks run inline instead of going through Schedule because IsCurrent
+    uint64_t hops_saved() const
+    {
+        return hops_saved_.load(std::memory_order_relaxed);
+    }
+
+private:
+    // counted by the inline path of Future::Then only
+    friend class detail::InlineScope;
+
+    void AddHopSaved()
+    {
+        hops_saved_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> hops_saved_;
 };
 
 } // namespace asuka
@@ -0,0 +1,260 @@
+//
+// Created by xi on 19-3-30.
+//
+
+#include <limits.h>
+#include <algorithm>
+#include <new>
+#include <utility>
+#include <asuka/utils/Futex.h>
+#include <asuka/utils/PoolAllocator.h>
+#include <asuka/utils/ThreadPoolScheduler.h>
+
+namespace asuka
+{
+
+namespace detail
+{
+
+struct PoolTask
+{
+    explicit PoolTask(std::function<void ()>&& f) :
+        func(std::move(f))
+    {}
+
+    std::function<void ()> func;
+};
+
+} // namespace detail
+
+namespace
+{
+
+const size_t kInjectionCapacity = 1 << 16;
+
+// rounds of looking for work, yielding in between, before a worker sleeps
+const int kIdleRounds = 2;
+
+detail::PoolTask* NewTask(std::function<void ()>&& func)
+{
+    void* p = PoolAllocator<detail::PoolTask>().allocate(1);
+    return new (p) detail::PoolTask(std::move(func));
+}
+
+void DeleteTask(detail::PoolTask* task)
+{
+    task->~PoolTask();
+    PoolAllocator<detail::PoolTask>().deallocate(task, 1);
+}
+
+// xorshift, picks the first victim to steal from
+uint64_t NextRandom(uint64_t* state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+} // namespace
+
+thread_local ThreadPoolScheduler* ThreadPoolScheduler::current_ = nullptr;
+thread_local size_t ThreadPoolScheduler::current_index_ = 0;
+
+ThreadPoolScheduler::ThreadPoolScheduler(size_t threads) :
+    injection_(kInjectionCapacity),
+    stopping_(false),
+    epoch_(0),
+    sleepers_(0),
+    searching_(0),
+    steals_(0)
+{
+    if (threads == 0)
+    {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    // all deques exist before any worker may steal from them
+    for (size_t i = 0; i < threads; ++i)
+    {
+        workers_.emplace_back(new Worker());
+    }
+    for (size_t i = 0; i < threads; ++i)
+    {
+        workers_[i]->thread = std::thread([this, i] { Run(i); });
+    }
+    timer_thread_ = std::thread([this] { timers_.Loop(); });
+}
+
+ThreadPoolScheduler::~ThreadPoolScheduler()
+{
+    timers_.Stop();
+    timer_thread_.join();
+    stopping_.store(true, std::memory_order_release);
+    epoch_.fetch_add(1, std::memory_order_release);
+    FutexWake(&epoch_, INT_MAX);
+    for (auto& worker : workers_)
+    {
+        worker->thread.join();
+    }
+    for (auto& worker : workers_)
+    {
+        while (detail::PoolTask* task = worker->deque.Pop())
+        {
+            DeleteTask(task);
+        }
+    }
+    while (detail::PoolTask* task = injection_.TryPop())
+    {
+        DeleteTask(task);
+    }
+}
+
+void ThreadPoolScheduler::Schedule(std::function<void ()> func)
+{
+    detail::PoolTask* task = NewTask(std::move(func));
+    if (current_ == this)
+    {
+        workers_[current_index_]->deque.Push(task);
+    }
+    else
+    {
+        while (!injection_.TryPush(task))
+        {
+            // full, let the workers drain it
+            std::this_thread::yield();
+        }
+    }
+    Notify();
+}
+
+void ThreadPoolScheduler::SchedulerLater(std::chrono::milliseconds duration, std::function<void ()> func)
+{
+    timers_.SchedulerLater(duration, [this, f = std::move(func)] () mutable {
+        Schedule(std::move(f));
+    });
+}
+
+bool ThreadPoolScheduler::IsCurrent() const
+{
+    return current_ == this;
+}
+
+void ThreadPoolScheduler::Run(size_t index)
+{
+    current_ = this;
+    current_index_ = index;
+    uint64_t rand = index * 0x9E3779B97F4A7C15ULL + 1;
+    int idle = 0;
+    bool searching = false;
+    while (!stopping_.load(std::memory_order_acquire))
+    {
+        detail::PoolTask* task = FindTask(index, &rand);
+        if (task)
+        {
+            if (searching)
+            {
+                searching = false;
+                // the last one looking for work found some, there may be more
+                if (searching_.fetch_sub(1, std::memory_order_seq_cst) == 1)
+                {
+                    Notify();
+                }
+            }
+            idle = 0;
+            task->func();
+            DeleteTask(task);
+            continue;
+        }
+        if (!searching)
+        {
+            searching = true;
+            searching_.fetch_add(1, std::memory_order_seq_cst);
+        }
+        if (++idle < kIdleRounds)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            idle = 0;
+            // leaves searching while asleep, back to it when woken
+            Park();
+        }
+    }
+    current_ = nullptr;
+}
+
+detail::PoolTask* ThreadPoolScheduler::FindTask(size_t index, uint64_t* rand)
+{
+    if (detail::PoolTask* task = workers_[index]->deque.Pop())
+    {
+        return task;
+    }
+    if (detail::PoolTask* task = injection_.TryPop())
+    {
+        return task;
+    }
+    size_t n = workers_.size();
+    size_t start = static_cast<size_t>(NextRandom(rand) % n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        size_t victim = (start + i) % n;
+        if (victim == index)
+        {
+            continue;
+        }
+        if (detail::PoolTask* task = workers_[victim]->deque.Steal())
+        {
+            steals_.fetch_add(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+bool ThreadPoolScheduler::HasWork() const
+{
+    if (!injection_.Empty())
+    {
+        return true;
+    }
+    for (auto& worker : workers_)
+    {
+        if (!worker->deque.Empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPoolScheduler::Park()
+{
+    uint32_t epoch = epoch_.load(std::memory_order_acquire);
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    searching_.fetch_sub(1, std::memory_order_seq_cst);
+    // pairs with the fence in Notify: either we see the task or it sees us
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!HasWork() && !stopping_.load(std::memory_order_acquire))
+    {
+        FutexWait(&epoch_, epoch, nullptr);
+    }
+    searching_.fetch_add(1, std::memory_order_seq_cst);
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ThreadPoolScheduler::Notify()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // a worker looking for work finds it, or wakes another when it does
+    if (searching_.load(std::memory_order_relaxed) == 0 &&
+        sleepers_.load(std::memory_order_relaxed) > 0)
+    {
+        epoch_.fetch_add(1, std::memory_order_release);
+        FutexWake(&epoch_, 1);
+    }
+}
+
+} // namespace asuka
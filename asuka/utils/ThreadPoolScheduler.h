@@ -0,0 +1,123 @@
+//
+// Created by xi on 19-3-30.
+//
+
+#ifndef ASUKA_THREADPOOLSCHEDULER_H
+#define ASUKA_THREADPOOLSCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <asuka/utils/Scheduler.h>
+#include <asuka/utils/EventLoopScheduler.h>
+#include <asuka/utils/MpmcQueue.h>
+#include <asuka/utils/WorkStealingDeque.h>
+
+namespace asuka
+{
+
+namespace detail
+{
+
+struct PoolTask;
+
+} // namespace detail
+
+// Scheduler running tasks on a fixed set of worker threads.
+// Each worker has a Chase-Lev deque: tasks scheduled from a worker go to its
+// own deque and are popped LIFO, idle workers steal FIFO from the others.
+// Tasks from other threads go through a bounded lock-free injection queue,
+// a full queue makes Schedule yield until there is room.
+// Workers with nothing to do sleep on a futex. A new task wakes one only when
+// no worker is looking for work, a searching worker that finds a task wakes
+// the next one, so a burst spreads without waking everybody for each task.
+// Timers of SchedulerLater are kept by an EventLoopScheduler thread of the pool
+// and hand their function to the workers when they fire.
+//
+//     ThreadPoolScheduler pool(4);
+//     future.Then(&pool, f);
+class ThreadPoolScheduler : public Scheduler
+{
+public:
+    // threads 0 takes std::thread::hardware_concurrency()
+    explicit ThreadPoolScheduler(size_t threads = 0);
+
+    // tasks not run yet are dropped
+    ~ThreadPoolScheduler() override;
+
+    // thread safe
+    void Schedule(std::function<void ()> func) override;
+
+    // thread safe, func runs in a worker
+    void SchedulerLater(std::chrono::milliseconds duration, std::function<void ()> func) override;
+
+    // true in a worker of this pool
+    bool IsCurrent() const override;
+
+    size_t threads() const
+    {
+        return workers_.size();
+    }
+
+    // tasks taken from another worker's deque
+    uint64_t steals() const
+    {
+        return steals_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Worker
+    {
+        Worker() :
+            deque(256)
+        {}
+
+        WorkStealingDeque<detail::PoolTask> deque;
+        std::thread thread;
+    };
+
+    void Run(size_t index);
+
+    detail::PoolTask* FindTask(size_t index, uint64_t* rand);
+
+    bool HasWork() const;
+
+    void Park();
+
+    void Notify();
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    MpmcQueue<detail::PoolTask> injection_;
+
+    std::atomic<bool> stopping_;
+
+    // futex word of sleeping workers, bumped to wake them
+    alignas(64) std::atomic<uint32_t> epoch_;
+
+    std::atomic<int> sleepers_;
+
+    // workers between running out of tasks and going to sleep
+    std::atomic<int> searching_;
+
+    std::atomic<uint64_t> steals_;
+
+    EventLoopScheduler timers_;
+
+    std::thread timer_thread_;
+
+    // the pool and index of the worker running in this thread
+    static thread_local ThreadPoolScheduler* current_;
+    static thread_local size_t current_index_;
+};
+
+} // namespace asuka
+
+#endif //ASUKA_THREADPOOLSCHEDULER_H
@@ -0,0 +1,286 @@
+//
+// Created by xi on 19-3-22.
+//
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <asuka/utils/TimerWheel.h>
+
+namespace asuka
+{
+
+namespace
+{
+
+const size_t kNearBits = 8;
+const size_t kNearSlots = 1 << kNearBits; // 256
+const uint64_t kNearMask = kNearSlots - 1;
+const size_t kLevelBits = 6;
+const size_t kLevelSlots = 1 << kLevelBits; // 64
+const uint64_t kLevelMask = kLevelSlots - 1;
+const size_t kLevels = 4;
+const size_t kSlots = kNearSlots + kLevels * kLevelSlots;
+const size_t kChunkSize = 1024;
+
+} // namespace
+
+namespace detail
+{
+
+// list nodes and slot heads, a head's seq is always 0
+struct Timer
+{
+    Timer* prev = this;
+    Timer* next = this;
+    uint64_t expire = 0;
+    uint64_t seq = 0;
+    size_t slot = 0;
+    std::function<void ()> func;
+};
+
+} // namespace detail
+
+namespace
+{
+
+bool Empty(const detail::Timer* head)
+{
+    return head->next == head;
+}
+
+void Unlink(detail::Timer* timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer;
+    timer->next = timer;
+}
+
+void PushBack(detail::Timer* head, detail::Timer* timer)
+{
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+// move all of from to the empty list to
+void Splice(detail::Timer* from, detail::Timer* to)
+{
+    assert(Empty(to));
+    if (Empty(from))
+    {
+        return;
+    }
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    from->next = from;
+    from->prev = from;
+}
+
+} // namespace
+
+const uint64_t TimerWheel::kMaxTicks = (1ULL << (kNearBits + kLevels * kLevelBits)) - 1;
+
+TimerWheel::TimerWheel(uint64_t now_tick) :
+    tick_(now_tick),
+    size_(0),
+    next_seq_(0),
+    slots_(new Timer[kSlots]),
+    free_list_(nullptr)
+{
+    memset(bitmap_, 0, sizeof(bitmap_));
+}
+
+TimerWheel::~TimerWheel() = default;
+
+TimerId TimerWheel::Add(uint64_t expire_tick, std::function<void ()> func)
+{
+    Timer* timer = NewTimer();
+    timer->expire = std::max(expire_tick, tick_);
+    timer->expire = std::min(timer->expire, tick_ + kMaxTicks);
+    timer->seq = ++next_seq_;
+    timer->func = std::move(func);
+    Place(timer);
+    ++size_;
+    return TimerId(timer, timer->seq);
+}
+
+bool TimerWheel::Cancel(const TimerId& id)
+{
+    Timer* timer = id.timer_;
+    if (timer == nullptr || timer->seq != id.seq_)
+    {
+        return false;
+    }
+    size_t slot = timer->slot;
+    Unlink(timer);
+    if (slot < kNearSlots && Empty(&slots_[slot]))
+    {
+        bitmap_[slot / 64] &= ~(1ULL << (slot % 64));
+    }
+    FreeTimer(timer);
+    --size_;
+    return true;
+}
+
+void TimerWheel::Place(Timer* timer)
+{
+    uint64_t expire = timer->expire;
+    uint64_t delta = expire - tick_;
+    size_t slot;
+    if (delta < kNearSlots)
+    {
+        slot = static_cast<size_t>(expire & kNearMask);
+        bitmap_[slot / 64] |= 1ULL << (slot % 64);
+    }
+    else
+    {
+        size_t level = 0;
+        while (level + 1 < kLevels && delta >= 1ULL << (kNearBits + (level + 1) * kLevelBits))
+        {
+            ++level;
+        }
+        size_t index = static_cast<size_t>((expire >> (kNearBits + level * kLevelBits)) & kLevelMask);
+        slot = kNearSlots + level * kLevelSlots + index;
+    }
+    timer->slot = slot;
+    PushBack(&slots_[slot], timer);
+}
+
+void TimerWheel::Cascade(size_t level, size_t index)
+{
+    Timer list;
+    Splice(&slots_[kNearSlots + level * kLevelSlots + index], &list);
+    while (!Empty(&list))
+    {
+        Timer* timer = list.next;
+        Unlink(timer);
+        Place(timer);
+    }
+}
+
+int TimerWheel::FindSlot(size_t from) const
+{
+    for (size_t word = from / 64; word < 4; ++word)
+    {
+        uint64_t bits = bitmap_[word];
+        if (word == from / 64)
+        {
+            bits &= ~0ULL << (from % 64);
+        }
+        if (bits)
+        {
+            return static_cast<int>(word * 64 + static_cast<size_t>(__builtin_ctzll(bits)));
+        }
+    }
+    return -1;
+}
+
+size_t TimerWheel::Advance(uint64_t now_tick)
+{
+    size_t fired = 0;
+    while (tick_ <= now_tick)
+    {
+        if (size_ == 0)
+        {
+            tick_ = now_tick + 1;
+            break;
+        }
+        size_t index = static_cast<size_t>(tick_ & kNearMask);
+        if (index == 0)
+        {
+            // level 0 wraps around, bring down the next slot of each level that wraps too
+            for (size_t level = 0; level < kLevels; ++level)
+            {
+                size_t slot = static_cast<size_t>((tick_ >> (kNearBits + level * kLevelBits)) & kLevelMask);
+                Cascade(level, slot);
+                if (slot != 0)
+                {
+                    break;
+                }
+            }
+        }
+        // skip empty slots
+        int found = FindSlot(index);
+        if (found < 0)
+        {
+            tick_ = std::min((tick_ | kNearMask) + 1, now_tick + 1);
+            continue;
+        }
+        if (static_cast<size_t>(found) != index)
+        {
+            tick_ = std::min(tick_ + (static_cast<size_t>(found) - index), now_tick + 1);
+            continue;
+        }
+        ++tick_;
+        Timer list;
+        Splice(&slots_[index], &list);
+        bitmap_[index / 64] &= ~(1ULL << (index % 64));
+        // func may add or cancel timers, including those still in list
+        while (!Empty(&list))
+        {
+            Timer* timer = list.next;
+            Unlink(timer);
+            std::function<void ()> func(std::move(timer->func));
+            FreeTimer(timer);
+            --size_;
+            ++fired;
+            func();
+        }
+    }
+    return fired;
+}
+
+uint64_t TimerWheel::NextWakeTick() const
+{
+    if (size_ == 0)
+    {
+        return UINT64_MAX;
+    }
+    size_t index = static_cast<size_t>(tick_ & kNearMask);
+    int found = index == 0 ? -1 : FindSlot(index);
+    if (found >= 0)
+    {
+        return tick_ + (static_cast<size_t>(found) - index);
+    }
+    // timers of other levels are cascaded at the next round
+    if (index != 0)
+    {
+        return (tick_ | kNearMask) + 1;
+    }
+    return tick_;
+}
+
+detail::Timer* TimerWheel::NewTimer()
+{
+    if (free_list_ == nullptr)
+    {
+        chunks_.emplace_back(new Timer[kChunkSize]);
+        Timer* chunk = chunks_.back().get();
+        for (size_t i = 0; i < kChunkSize; ++i)
+        {
+            chunk[i].next = free_list_;
+            free_list_ = &chunk[i];
+        }
+    }
+    Timer* timer = free_list_;
+    free_list_ = timer->next;
+    timer->prev = timer;
+    timer->next = timer;
+    return timer;
+}
+
+void TimerWheel::FreeTimer(Timer* timer)
+{
+    // stale TimerId no longer matches
+    timer->seq = 0;
+    timer->func = nullptr;
+    timer->next = free_list_;
+    free_list_ = timer;
+}
+
+} // namespace asuka
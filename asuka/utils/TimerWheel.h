@@ -0,0 +1,124 @@
+//
+// Created by xi on 19-3-22.
+//
+
+#ifndef ASUKA_TIMERWHEEL_H
+#define ASUKA_TIMERWHEEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace asuka
+{
+
+namespace detail
+{
+
+struct Timer;
+
+} // namespace detail
+
+// handle of a timer for Cancel, stays safe to use after the timer fires
+class TimerId
+{
+public:
+    TimerId() :
+        timer_(nullptr),
+        seq_(0)
+    {}
+
+private:
+    friend class TimerWheel;
+
+    TimerId(detail::Timer* timer, uint64_t seq) :
+        timer_(timer),
+        seq_(seq)
+    {}
+
+    detail::Timer* timer_;
+
+    uint64_t seq_;
+};
+
+// Hierarchical timing wheel like the Linux kernel's: 256 slots of one tick,
+// then 4 levels of 64 slots each covering 64 times the level below, 2^32 ticks in all.
+// Timers are cascaded down a level when the level below wraps around,
+// so Add and Cancel are O(1) and Advance is O(1) amortized per tick and timer.
+// Timer nodes come from a free list and are never returned to the heap
+// before the wheel is destroyed.
+// NOTE: not thread safe
+class TimerWheel
+{
+public:
+    // ticks before now_tick are considered passed
+    explicit TimerWheel(uint64_t now_tick = 0);
+    ~TimerWheel();
+
+    // non-copyable
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // func is called by the Advance reaching expire_tick,
+    // a passed expire_tick fires on the next Advance, at most 2^32 - 1 ticks ahead
+    TimerId Add(uint64_t expire_tick, std::function<void ()> func);
+
+    // false if the timer has fired or been cancelled
+    bool Cancel(const TimerId& id);
+
+    // fire timers expiring at or before now_tick, return the number fired
+    size_t Advance(uint64_t now_tick);
+
+    // no timer fires before the returned tick, Advance shall be called then,
+    // UINT64_MAX if no timer
+    uint64_t NextWakeTick() const;
+
+    // the next tick to be advanced
+    uint64_t tick() const
+    {
+        return tick_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    static const uint64_t kMaxTicks;
+
+private:
+    using Timer = detail::Timer;
+
+    void Place(Timer* timer);
+
+    void Cascade(size_t level, size_t index);
+
+    Timer* NewTimer();
+
+    void FreeTimer(Timer* timer);
+
+    int FindSlot(size_t from) const;
+
+private:
+    uint64_t tick_;
+
+    size_t size_;
+
+    uint64_t next_seq_;
+
+    // list heads, level 0 slots first
+    std::unique_ptr<Timer[]> slots_;
+
+    // occupied slots of level 0
+    uint64_t bitmap_[4];
+
+    std::vector<std::unique_ptr<Timer[]>> chunks_;
+
+    Timer* free_list_;
+};
+
+} // namespace asuka
+
+#endif //ASUKA_TIMERWHEEL_H
@@ -0,0 +1,159 @@
+//
+// Created by xi on 19-3-30.
+//
+
+#ifndef ASUKA_WORKSTEALINGDEQUE_H
+#define ASUKA_WORKSTEALINGDEQUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace asuka
+{
+
+// Chase-Lev deque of pointers, with the C11 memory orders of
+// Le et al. "Correct and Efficient Work-Stealing for Weak Memory Models".
+// The owner pushes and pops at the bottom, any thread steals from the top.
+// The ring doubles when full; the old ones are kept until the deque is
+// destroyed because a thief may still read them.
+template <typename T>
+class WorkStealingDeque
+{
+public:
+    explicit WorkStealingDeque(size_t capacity = 256) :
+        top_(0),
+        bottom_(0)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        rings_.emplace_back(new Ring(size));
+        ring_.store(rings_.back().get(), std::memory_order_relaxed);
+    }
+
+    // non-copyable
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // owner only
+    void Push(T* item)
+    {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        if (bottom - top > static_cast<int64_t>(ring->mask))
+        {
+            ring = Grow(ring, top, bottom);
+        }
+        ring->Put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    // owner only, the last pushed, nullptr if empty
+    T* Pop()
+    {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        if (top > bottom)
+        {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T* item = ring->Get(bottom);
+        if (top == bottom)
+        {
+            // the last one, race thieves for it
+            if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                              std::memory_order_relaxed))
+            {
+                item = nullptr;
+            }
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // any thread, the first pushed, nullptr if empty or lost a race
+    T* Steal()
+    {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom)
+        {
+            return nullptr;
+        }
+        Ring* ring = ring_.load(std::memory_order_acquire);
+        T* item = ring->Get(top);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return item;
+    }
+
+    // racy unless called by the owner
+    bool Empty() const
+    {
+        return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Ring
+    {
+        explicit Ring(size_t size) :
+            mask(size - 1),
+            items(new std::atomic<T*>[size])
+        {}
+
+        T* Get(int64_t i) const
+        {
+            return items[static_cast<size_t>(i) & mask].load(std::memory_order_relaxed);
+        }
+
+        void Put(int64_t i, T* item)
+        {
+            items[static_cast<size_t>(i) & mask].store(item, std::memory_order_relaxed);
+        }
+
+        size_t mask;
+        std::unique_ptr<std::atomic<T*>[]> items;
+    };
+
+    Ring* Grow(Ring* ring, int64_t top, int64_t bottom)
+    {
+        rings_.emplace_back(new Ring((ring->mask + 1) * 2));
+        Ring* bigger = rings_.back().get();
+        for (int64_t i = top; i < bottom; ++i)
+        {
+            bigger->Put(i, ring->Get(i));
+        }
+        ring_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+private:
+    // top_ is written by thieves, keep it off the owner's line
+    alignas(64) std::atomic<int64_t> top_;
+
+    alignas(64) std::atomic<int64_t> bottom_;
+
+    std::atomic<Ring*> ring_;
+
+    // owner only
+    std::vector<std::unique_ptr<Ring>> rings_;
+};
+
+} // namespace asuka
+
+#endif //ASUKA_WORKSTEALINGDEQUE_H